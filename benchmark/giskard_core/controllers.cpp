@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <benchmark/benchmark.h>
+#include <giskard_core/giskard_core.hpp>
+
+// Cost of every step in the life of the controllers in test_data, from
+// reading their YAML to the steady-state control cycle.
+namespace
+{
+  std::string test_data(const std::string& filename)
+  {
+    return std::string(GISKARD_CORE_TEST_DATA_DIR) + "/" + filename;
+  }
+
+  giskard_core::QPControllerSpec load_spec(const std::string& filename)
+  {
+    return YAML::LoadFile(test_data(filename)).as<giskard_core::QPControllerSpec>();
+  }
+
+  Eigen::VectorXd some_observables(size_t num_observables)
+  {
+    Eigen::VectorXd result(num_observables);
+    for(size_t i=0; i<num_observables; ++i)
+      result(i) = 0.1 * (i % 7) + 0.05;
+    return result;
+  }
+
+  // Moves the joints along the last command, like a robot following the
+  // controller at 100Hz would.
+  class Integrator
+  {
+    public:
+      Integrator(const giskard_core::QPController& controller)
+      {
+        const std::vector<std::string>& names = controller.get_controllable_names();
+        for(size_t i=0; i<names.size(); ++i)
+          if(controller.get_scope().has_input<giskard_core::Scope::JointInput>(names[i]))
+            joints_.push_back(std::make_pair(i, controller.get_joint_input_handle(names[i]).idx_));
+      }
+
+      void integrate(const Eigen::VectorXd& command, Eigen::VectorXd& observables) const
+      {
+        for(size_t i=0; i<joints_.size(); ++i)
+          observables(joints_[i].second) += 0.01 * command(joints_[i].first);
+      }
+
+    private:
+      // index of the command, and index of the observable
+      std::vector< std::pair<size_t, size_t> > joints_;
+  };
+}
+
+static void BM_ControllerParseYaml(benchmark::State& state, const std::string& filename)
+{
+  for (auto _ : state)
+    benchmark::DoNotOptimize(YAML::LoadFile(test_data(filename)));
+}
+
+static void BM_ControllerDecode(benchmark::State& state, const std::string& filename)
+{
+  YAML::Node node = YAML::LoadFile(test_data(filename));
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(node.as<giskard_core::QPControllerSpec>());
+}
+
+static void BM_ControllerGenerate(benchmark::State& state, const std::string& filename)
+{
+  giskard_core::QPControllerSpec spec = load_spec(filename);
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(giskard_core::generate(spec));
+}
+
+static void BM_ControllerStart(benchmark::State& state, const std::string& filename)
+{
+  giskard_core::QPController controller = giskard_core::generate(load_spec(filename));
+  Eigen::VectorXd observables = some_observables(controller.get_input_size());
+
+  for (auto _ : state)
+    if(!controller.start(observables, 100))
+    {
+      state.SkipWithError("Could not start the controller.");
+      break;
+    }
+}
+
+// Also reports the p99 of the update time, and the mean working set
+// recalculations, from the statistics of the controller.
+static void BM_ControllerUpdate(benchmark::State& state, const std::string& filename)
+{
+  giskard_core::QPController controller = giskard_core::generate(load_spec(filename));
+  Integrator integrator(controller);
+  Eigen::VectorXd observables = some_observables(controller.get_input_size());
+  if(!controller.start(observables, 100))
+  {
+    state.SkipWithError("Could not start the controller.");
+    return;
+  }
+  controller.enable_statistics(10000);
+
+  for (auto _ : state)
+  {
+    if(!controller.update(observables, 100))
+    {
+      state.SkipWithError("Could not update the controller.");
+      break;
+    }
+    integrator.integrate(controller.get_command(), observables);
+  }
+
+  const giskard_core::UpdateStatistics& statistics = controller.get_statistics();
+  state.counters["p99_us"] = 1e6 * statistics.summarize_total_time().p99_;
+  state.counters["nWSR"] = statistics.summarize(&giskard_core::UpdateRecord::nWSR_).mean_;
+}
+
+#define GISKARD_CONTROLLER_BENCHMARKS(name, filename) \
+  BENCHMARK_CAPTURE(BM_ControllerParseYaml, name, std::string(filename)); \
+  BENCHMARK_CAPTURE(BM_ControllerDecode, name, std::string(filename)); \
+  BENCHMARK_CAPTURE(BM_ControllerGenerate, name, std::string(filename)); \
+  BENCHMARK_CAPTURE(BM_ControllerStart, name, std::string(filename)); \
+  BENCHMARK_CAPTURE(BM_ControllerUpdate, name, std::string(filename))
+
+GISKARD_CONTROLLER_BENCHMARKS(pr2_cart_cart, "pr2_cart_cart_control.yaml");
+GISKARD_CONTROLLER_BENCHMARKS(pr2_qp_position, "pr2_qp_position_control.yaml");
+GISKARD_CONTROLLER_BENCHMARKS(flying_cup, "flying_cup_approach_motion.yaml");
+
+// Synthetic controllers from 7 to 140 joints and from 10 to 1000 soft
+// constraints, with one branch and one goal per 7 joints, and as many hard
+// constraints as joints. Reports the mean time of the steps of an update,
+// with the default solver (0), the DiagonalQPSolver (1) or the
+// ActiveSetQPSolver (2). The latter only runs on QPs with fewer than 100
+// variables, which it is meant for.
+static void BM_SyntheticControllerUpdate(benchmark::State& state)
+{
+  giskard_core::SyntheticControllerOptions options;
+  options.num_joints_ = state.range(0);
+  options.num_branches_ = std::max<size_t>(1, options.num_joints_ / 7);
+  options.num_soft_constraints_ = state.range(1);
+  options.num_hard_constraints_ = options.num_joints_;
+  options.num_goal_inputs_ = options.num_branches_;
+  giskard_core::QPController controller = giskard_core::generate(
+      giskard_core::synthesize_controller(options).as<giskard_core::QPControllerSpec>());
+  if(state.range(2) == 1)
+    controller.set_solver(giskard_core::DiagonalQPSolver());
+  else if(state.range(2) == 2)
+    controller.set_solver(giskard_core::ActiveSetQPSolver());
+  Integrator integrator(controller);
+  Eigen::VectorXd observables = some_observables(controller.get_input_size());
+  if(!controller.start(observables, 1000))
+  {
+    state.SkipWithError("Could not start the controller.");
+    return;
+  }
+  controller.enable_statistics(10000);
+
+  for (auto _ : state)
+  {
+    if(!controller.update(observables, 1000))
+    {
+      state.SkipWithError("Could not update the controller.");
+      break;
+    }
+    integrator.integrate(controller.get_command(), observables);
+  }
+
+  const giskard_core::UpdateStatistics& statistics = controller.get_statistics();
+  state.counters["evaluation_us"] = 1e6 * statistics.summarize(&giskard_core::UpdateRecord::evaluation_time_).mean_;
+  state.counters["copy_us"] = 1e6 * statistics.summarize(&giskard_core::UpdateRecord::copy_time_).mean_;
+  state.counters["solve_us"] = 1e6 * statistics.summarize(&giskard_core::UpdateRecord::solve_time_).mean_;
+  state.counters["nWSR"] = statistics.summarize(&giskard_core::UpdateRecord::nWSR_).mean_;
+}
+
+static void SyntheticControllerSizes(benchmark::internal::Benchmark* benchmark)
+{
+  const int num_joints[] = {7, 35, 140};
+  for(size_t i=0; i<3; ++i)
+    for(int num_soft_constraints = 10; num_soft_constraints <= 1000; num_soft_constraints *= 10)
+      for(int solver = 0; solver <= 2; ++solver)
+        if(solver < 2 || num_joints[i] + num_soft_constraints < 100)
+          benchmark->Args({num_joints[i], num_soft_constraints, solver});
+}
+BENCHMARK(BM_SyntheticControllerUpdate)->Apply(SyntheticControllerSizes);
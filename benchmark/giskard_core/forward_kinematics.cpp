@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <benchmark/benchmark.h>
+#include <giskard_core/giskard_core.hpp>
+#include <urdf/model.h>
+#include <kdl_parser/kdl_parser.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
+
+// Forward kinematics as expression graphs against the recursive solvers of
+// KDL on the same chains, for the pose alone and with the Jacobian.
+namespace
+{
+  std::string test_data(const std::string& filename)
+  {
+    return std::string(GISKARD_CORE_TEST_DATA_DIR) + "/" + filename;
+  }
+
+  struct Chain
+  {
+    std::string urdf_, base_, tip_;
+    // if empty, the expression is extracted from the URDF
+    std::string yaml_;
+  };
+
+  Chain pr2_left_arm()
+  {
+    Chain chain = {"pr2.urdf", "base_link", "l_wrist_roll_link", ""};
+    return chain;
+  }
+
+  Chain pr2_left_arm_single_expression()
+  {
+    Chain chain = {"pr2.urdf", "torso_lift_link", "l_wrist_roll_link", "pr2_left_arm_single_expression.yaml"};
+    return chain;
+  }
+
+  Chain boxy_left_arm()
+  {
+    Chain chain = {"boxy.urdf", "base_footprint", "left_gripper_tool_frame", ""};
+    return chain;
+  }
+
+  KDL::Chain kdl_chain(const Chain& chain)
+  {
+    urdf::Model urdf;
+    KDL::Tree tree;
+    KDL::Chain result;
+    if(!urdf.initFile(test_data(chain.urdf_)) || !kdl_parser::treeFromUrdfModel(urdf, tree) ||
+        !tree.getChain(chain.base_, chain.tip_, result))
+      throw std::runtime_error("Could not load chain from '" + chain.base_ + "' to '" +
+          chain.tip_ + "' in '" + chain.urdf_ + "'.");
+    return result;
+  }
+
+  KDL::Expression<KDL::Frame>::Ptr frame_expression(const Chain& chain)
+  {
+    if(!chain.yaml_.empty())
+    {
+      giskard_core::ScopeSpec scope_spec;
+      scope_spec.push_back({"fk", YAML::LoadFile(test_data(chain.yaml_)).as<giskard_core::FrameSpecPtr>()});
+      return giskard_core::generate(scope_spec).find_frame_expression("fk");
+    }
+
+    YAML::Node node = giskard_core::extract_expression(chain.base_, chain.tip_, test_data(chain.urdf_));
+    return giskard_core::generate(node.as<giskard_core::ScopeSpec>()).find_frame_expression("fk");
+  }
+
+  std::vector<double> some_joint_values(size_t num_joints)
+  {
+    std::vector<double> result(num_joints);
+    for(size_t i=0; i<num_joints; ++i)
+      result[i] = 0.1 * (i % 7) + 0.05;
+    return result;
+  }
+}
+
+static void BM_FKDecode(benchmark::State& state, const Chain& chain)
+{
+  YAML::Node node = chain.yaml_.empty() ?
+    giskard_core::extract_expression(chain.base_, chain.tip_, test_data(chain.urdf_)) :
+    YAML::LoadFile(test_data(chain.yaml_));
+
+  for (auto _ : state)
+    if(chain.yaml_.empty())
+      benchmark::DoNotOptimize(node.as<giskard_core::ScopeSpec>());
+    else
+      benchmark::DoNotOptimize(node.as<giskard_core::FrameSpecPtr>());
+}
+
+static void BM_FKExpression(benchmark::State& state, const Chain& chain)
+{
+  KDL::Expression<KDL::Frame>::Ptr expression = frame_expression(chain);
+  std::vector<double> q = some_joint_values(expression->number_of_derivatives());
+
+  for (auto _ : state)
+  {
+    q[0] += 1e-6;
+    expression->setInputValues(q);
+    benchmark::DoNotOptimize(expression->value());
+  }
+}
+
+static void BM_FKSolver(benchmark::State& state, const Chain& chain)
+{
+  KDL::Chain kdl = kdl_chain(chain);
+  KDL::ChainFkSolverPos_recursive solver(kdl);
+  std::vector<double> values = some_joint_values(kdl.getNrOfJoints());
+  KDL::JntArray q(kdl.getNrOfJoints());
+  for(size_t i=0; i<values.size(); ++i)
+    q(i) = values[i];
+  KDL::Frame frame;
+
+  for (auto _ : state)
+  {
+    q(0) += 1e-6;
+    solver.JntToCart(q, frame);
+    benchmark::DoNotOptimize(frame);
+  }
+}
+
+static void BM_FKJacobianExpression(benchmark::State& state, const Chain& chain)
+{
+  KDL::Expression<KDL::Frame>::Ptr expression = frame_expression(chain);
+  std::vector<double> q = some_joint_values(expression->number_of_derivatives());
+  KDL::Jacobian jacobian(q.size());
+
+  for (auto _ : state)
+  {
+    q[0] += 1e-6;
+    expression->setInputValues(q);
+    benchmark::DoNotOptimize(expression->value());
+    for(size_t i=0; i<q.size(); ++i)
+      jacobian.setColumn(i, expression->derivative(i));
+    benchmark::DoNotOptimize(jacobian.data);
+  }
+}
+
+static void BM_FKJacobianSolver(benchmark::State& state, const Chain& chain)
+{
+  KDL::Chain kdl = kdl_chain(chain);
+  KDL::ChainFkSolverPos_recursive fk_solver(kdl);
+  KDL::ChainJntToJacSolver jacobian_solver(kdl);
+  std::vector<double> values = some_joint_values(kdl.getNrOfJoints());
+  KDL::JntArray q(kdl.getNrOfJoints());
+  for(size_t i=0; i<values.size(); ++i)
+    q(i) = values[i];
+  KDL::Frame frame;
+  KDL::Jacobian jacobian(kdl.getNrOfJoints());
+
+  for (auto _ : state)
+  {
+    q(0) += 1e-6;
+    fk_solver.JntToCart(q, frame);
+    jacobian_solver.JntToJac(q, jacobian);
+    benchmark::DoNotOptimize(frame);
+    benchmark::DoNotOptimize(jacobian.data);
+  }
+}
+
+#define GISKARD_FK_BENCHMARKS(name, chain) \
+  BENCHMARK_CAPTURE(BM_FKDecode, name, chain); \
+  BENCHMARK_CAPTURE(BM_FKExpression, name, chain); \
+  BENCHMARK_CAPTURE(BM_FKSolver, name, chain); \
+  BENCHMARK_CAPTURE(BM_FKJacobianExpression, name, chain); \
+  BENCHMARK_CAPTURE(BM_FKJacobianSolver, name, chain)
+
+GISKARD_FK_BENCHMARKS(pr2_left_arm, pr2_left_arm());
+GISKARD_FK_BENCHMARKS(pr2_left_arm_single_expression, pr2_left_arm_single_expression());
+GISKARD_FK_BENCHMARKS(boxy_left_arm, boxy_left_arm());
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <benchmark/benchmark.h>
+#include <giskard_core/giskard_core.hpp>
+
+namespace
+{
+  size_t num_evaluations = 0;
+
+  // Counts how often its argument is evaluated. Wrapped into a cached expression,
+  // this tells how often a shared sub-graph is evaluated per update of the QP.
+  class EvaluationCounter : public KDL::UnaryExpression<double, double>
+  {
+    public:
+      typedef KDL::UnaryExpression<double, double> UnExpr;
+    public:
+      EvaluationCounter() {}
+      EvaluationCounter(const UnExpr::ArgumentExpr::Ptr& arg) : UnExpr("evaluation_counter", arg) {}
+      virtual double value()
+      {
+        ++num_evaluations;
+        return argument->value();
+      }
+      virtual double derivative(int i)
+      {
+        return argument->derivative(i);
+      }
+      virtual KDL::Expression<double>::Ptr derivativeExpression(int i)
+      {
+        return argument->derivativeExpression(i);
+      }
+      virtual UnExpr::Ptr clone()
+      {
+        UnExpr::Ptr expr(new EvaluationCounter(argument->clone()));
+        return expr;
+      }
+  };
+
+  KDL::Expression<double>::Ptr evaluation_counter(const KDL::Expression<double>::Ptr& arg)
+  {
+    KDL::Expression<double>::Ptr expr(new EvaluationCounter(arg));
+    return expr;
+  }
+
+  // The layout QPProblemBuilder used to have: one expression array, and hence
+  // one optimizer, per block of the QP.
+  class SeparateExpressionArrays
+  {
+    public:
+      SeparateExpressionArrays(const giskard_core::QPProblemBuilder& builder) :
+        arrays_(10)
+      {
+        arrays_[0].set_expressions(builder.get_controllable_lower_bounds());
+        arrays_[1].set_expressions(builder.get_controllable_upper_bounds());
+        arrays_[2].set_expressions(builder.get_controllable_weights());
+        arrays_[3].set_expressions(builder.get_soft_expressions());
+        arrays_[4].set_expressions(builder.get_soft_lower_bounds());
+        arrays_[5].set_expressions(builder.get_soft_upper_bounds());
+        arrays_[6].set_expressions(builder.get_soft_weights());
+        arrays_[7].set_expressions(builder.get_hard_expressions());
+        arrays_[8].set_expressions(builder.get_hard_lower_bounds());
+        arrays_[9].set_expressions(builder.get_hard_upper_bounds());
+      }
+
+      void update(const Eigen::VectorXd& observables)
+      {
+        for(size_t i=0; i<arrays_.size(); ++i)
+          arrays_[i].update(observables.segment(0, arrays_[i].num_inputs()));
+      }
+
+    private:
+      std::vector<KDL::DoubleExpressionArray> arrays_;
+  };
+
+  giskard_core::QPController load_controller(const std::string& filename,
+      const giskard_core::QPProblemOptions& options = giskard_core::QPProblemOptions())
+  {
+    YAML::Node node = YAML::LoadFile(std::string(GISKARD_CORE_TEST_DATA_DIR) + "/" + filename);
+    return giskard_core::generate(node.as<giskard_core::QPControllerSpec>(), options);
+  }
+
+  Eigen::VectorXd some_observables(size_t num_observables)
+  {
+    Eigen::VectorXd result(num_observables);
+    for(size_t i=0; i<num_observables; ++i)
+      result(i) = 0.1 * (i % 7) + 0.05;
+    return result;
+  }
+
+  // A single cached sub-graph shared by a soft constraint, its bounds and a hard constraint.
+  giskard_core::QPProblemBuilder shared_subgraph_problem()
+  {
+    using namespace KDL;
+    Expression<double>::Ptr shared = cached<double>(evaluation_counter(input(0) * input(1)));
+
+    std::vector< Expression<double>::Ptr > controllable_lower, controllable_upper, controllable_weights,
+        soft_expressions, soft_lower, soft_upper, soft_weights, hard_expressions, hard_lower, hard_upper;
+    for(size_t i=0; i<2; ++i)
+    {
+      controllable_lower.push_back(Constant(-0.1));
+      controllable_upper.push_back(Constant(0.1));
+      controllable_weights.push_back(Constant(1.0));
+    }
+
+    soft_expressions.push_back(shared);
+    soft_lower.push_back(Constant(0.5) - shared);
+    soft_upper.push_back(Constant(0.5) - shared);
+    soft_weights.push_back(Constant(10.0));
+
+    hard_expressions.push_back(shared);
+    hard_lower.push_back(Constant(-1.0) - shared);
+    hard_upper.push_back(Constant(1.0) - shared);
+
+    giskard_core::QPProblemBuilder builder;
+    builder.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+        soft_lower, soft_upper, soft_weights, hard_expressions, hard_lower, hard_upper);
+    return builder;
+  }
+}
+
+static void BM_SharedSubgraphSeparateArrays(benchmark::State& state)
+{
+  SeparateExpressionArrays arrays(shared_subgraph_problem());
+  Eigen::VectorXd observables = some_observables(2);
+
+  num_evaluations = 0;
+  size_t num_updates = 0;
+  for (auto _ : state)
+  {
+    arrays.update(observables);
+    ++num_updates;
+  }
+  state.counters["evaluations_per_update"] = static_cast<double>(num_evaluations) / num_updates;
+}
+BENCHMARK(BM_SharedSubgraphSeparateArrays);
+
+static void BM_SharedSubgraphSinglePass(benchmark::State& state)
+{
+  giskard_core::QPProblemBuilder builder = shared_subgraph_problem();
+  Eigen::VectorXd observables = some_observables(2);
+
+  num_evaluations = 0;
+  size_t num_updates = 0;
+  for (auto _ : state)
+  {
+    builder.update(observables);
+    ++num_updates;
+  }
+  state.counters["evaluations_per_update"] = static_cast<double>(num_evaluations) / num_updates;
+}
+BENCHMARK(BM_SharedSubgraphSinglePass);
+
+static void BM_PR2CartCartSeparateArrays(benchmark::State& state)
+{
+  giskard_core::QPController controller = load_controller("pr2_cart_cart_control.yaml");
+  SeparateExpressionArrays arrays(controller.get_qp_builder());
+  Eigen::VectorXd observables = some_observables(controller.get_input_size());
+
+  for (auto _ : state)
+    arrays.update(observables);
+}
+BENCHMARK(BM_PR2CartCartSeparateArrays);
+
+static void BM_PR2CartCartSinglePass(benchmark::State& state)
+{
+  giskard_core::QPController controller = load_controller("pr2_cart_cart_control.yaml");
+  KDL::DoubleExpressionArray expressions;
+  expressions.set_expressions(controller.get_qp_builder().get_expression_array().get_expressions());
+  Eigen::VectorXd observables = some_observables(controller.get_input_size());
+
+  for (auto _ : state)
+    expressions.update(observables.segment(0, expressions.num_inputs()));
+}
+BENCHMARK(BM_PR2CartCartSinglePass);
+
+// NOTE: The cart-cart controller uses slerp, which the tape does not support.
+static void BM_PR2PositionControlUpdateExpressionGraph(benchmark::State& state)
+{
+  giskard_core::QPController controller = load_controller("pr2_qp_position_control.yaml");
+  giskard_core::QPProblemBuilder builder = controller.get_qp_builder();
+  Eigen::VectorXd observables = some_observables(controller.get_input_size());
+
+  for (auto _ : state)
+    builder.update(observables);
+}
+BENCHMARK(BM_PR2PositionControlUpdateExpressionGraph);
+
+static void BM_PR2PositionControlUpdateTape(benchmark::State& state)
+{
+  giskard_core::QPProblemOptions options;
+  options.tape_ = true;
+  giskard_core::QPController controller = load_controller("pr2_qp_position_control.yaml", options);
+  giskard_core::QPProblemBuilder builder = controller.get_qp_builder();
+  Eigen::VectorXd observables = some_observables(controller.get_input_size());
+
+  for (auto _ : state)
+    builder.update(observables);
+}
+BENCHMARK(BM_PR2PositionControlUpdateTape);
@@ -0,0 +1,587 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_ACTIVE_SET_QP_SOLVER_HPP
+#define GISKARD_CORE_ACTIVE_SET_QP_SOLVER_HPP
+
+#include <giskard_core/qp_solver.hpp>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace giskard_core
+{
+  // Small dense active-set solver without dependencies, for QPs with up to
+  // about 100 variables. It implements the dual method of Goldfarb and
+  // Idnani: it starts from the unconstrained minimum, and keeps adding the
+  // most violated bound or constraint to the active set, dropping others
+  // where needed, until the solution is feasible. Unlike a primal method, it
+  // does not need a feasible point to start from, which the hard constraints
+  // do not offer.
+  // Hotstarts begin on the active set of the last run, without iterations,
+  // and only drop those of its inequalities whose multipliers turned
+  // negative. Cold starts with a guess prefer its violated bounds and
+  // constraints over the others. If H is constant, see
+  // QPProblemBuilder::has_constant_matrices, hotstarts also keep its
+  // factorization.
+  // NOTE: H has to be positive definite, and the QP dense and not empty. All
+  //       memory is allocated in init, so solving does not allocate.
+  class ActiveSetQPSolver : public QPSolver
+  {
+    public:
+      ActiveSetQPSolver() : num_weights_( 0 ), num_constraints_( 0 ), num_active_( 0 ),
+        num_seeded_( 0 ), tolerance_( 1e-9 ), initialised_( false ), solved_( false ),
+        factorized_( false ), H_( 0 ), g_( 0 ),
+        A_( 0 ), lb_( 0 ), ub_( 0 ), lbA_( 0 ), ubA_( 0 ) {}
+
+      virtual QPSolver* clone() const
+      {
+        return new ActiveSetQPSolver(*this);
+      }
+
+      virtual void init(const QPProblemBuilder& qp)
+      {
+        if(qp.is_sparse())
+          throw std::invalid_argument("ActiveSetQPSolver: Only supports dense QPs.");
+        if(qp.num_weights() == 0)
+          throw std::invalid_argument("ActiveSetQPSolver: Needs at least one variable.");
+
+        num_weights_ = qp.num_weights();
+        num_constraints_ = qp.num_constraints();
+        size_t n = num_weights_;
+        L_ = Eigen::MatrixXd::Zero(n, n);
+        J_ = Eigen::MatrixXd::Zero(n, n);
+        J_factorized_ = Eigen::MatrixXd::Zero(n, n);
+        R_ = Eigen::MatrixXd::Zero(n, n);
+        x_ = Eigen::VectorXd::Zero(n);
+        d_ = Eigen::VectorXd::Zero(n);
+        z_ = Eigen::VectorXd::Zero(n);
+        r_ = Eigen::VectorXd::Zero(n + 1);
+        u_ = Eigen::VectorXd::Zero(n + 1);
+        normal_ = Eigen::VectorXd::Zero(n);
+        active_.assign(n + 1, 0);
+        seeded_.assign(n + 1, 0);
+        is_active_.assign(num_inequalities(), false);
+        preferred_.assign(num_inequalities(), false);
+        num_active_ = 0;
+        num_seeded_ = 0;
+        initialised_ = false;
+        solved_ = false;
+        factorized_ = false;
+      }
+
+      virtual qpOASES::returnValue solve(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime, const QPWorkingSet* guess)
+      {
+        std::fill(preferred_.begin(), preferred_.end(), false);
+        if(guess)
+        {
+          for(size_t i=0; i<guess->bounds_.size(); ++i)
+            if(guess->bounds_[i] != 0)
+              preferred_[bound_index(i, guess->bounds_[i] < 0)] = true;
+          for(size_t i=0; i<guess->constraints_.size(); ++i)
+            if(guess->constraints_[i] != 0)
+              preferred_[constraint_index(i, guess->constraints_[i] < 0)] = true;
+        }
+
+        num_seeded_ = 0;
+        factorized_ = false;
+        initialised_ = true;
+        return run(qp, nWSR, cputime);
+      }
+
+      virtual qpOASES::returnValue hotstart(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime)
+      {
+        std::fill(preferred_.begin(), preferred_.end(), false);
+        for(size_t i=0; i<num_active_; ++i)
+          preferred_[active_[i]] = true;
+        std::copy(active_.begin(), active_.begin() + num_active_, seeded_.begin());
+        num_seeded_ = num_active_;
+
+        if(!qp.has_constant_matrices())
+          factorized_ = false;
+        return run(qp, nWSR, cputime);
+      }
+
+      virtual bool is_initialised() const
+      {
+        return initialised_;
+      }
+
+      virtual bool is_solved() const
+      {
+        return solved_;
+      }
+
+      virtual void get_primal_solution(Eigen::VectorXd& x) const
+      {
+        x = x_;
+      }
+
+      virtual void get_working_set(QPWorkingSet& working_set)
+      {
+        std::fill(working_set.bounds_.begin(), working_set.bounds_.end(), 0);
+        std::fill(working_set.constraints_.begin(), working_set.constraints_.end(), 0);
+        for(size_t i=0; i<num_active_; ++i)
+        {
+          size_t index = active_[i];
+          int status = (index % 2 == 0) ? -1 : 1;
+          if(index < 2 * num_weights_)
+            working_set.bounds_[index / 2] = status;
+          else
+            working_set.constraints_[(index - 2 * num_weights_) / 2] = status;
+        }
+      }
+
+      virtual size_t get_active_set_size() const
+      {
+        return num_active_;
+      }
+
+    private:
+      // Every bound and every constraint is a pair of inequalities n^T x >= b,
+      // first the lower one with n = e_j or a_k, then the upper one with the
+      // negated normal. The bounds come first.
+      size_t num_weights_, num_constraints_;
+      // Cholesky factor of H, and J = L^-T rotated along with the active set.
+      // The first columns of J span the normals of the active inequalities,
+      // which R relates to the rotated normals: J^T N = [R; 0]. The rotations
+      // start over from J_factorized_ = L^-T in every run.
+      Eigen::MatrixXd L_, J_, J_factorized_, R_;
+      Eigen::VectorXd x_, d_, z_, r_, u_, normal_;
+      // the active set, and the one that the next run starts on
+      std::vector<size_t> active_, seeded_;
+      std::vector<bool> is_active_, preferred_;
+      size_t num_active_, num_seeded_;
+      double tolerance_;
+      bool initialised_, solved_, factorized_;
+      // QP of the current call
+      const QPProblemBuilder::Matrix* H_;
+      const Eigen::VectorXd* g_;
+      const QPProblemBuilder::Matrix* A_;
+      const Eigen::VectorXd *lb_, *ub_, *lbA_, *ubA_;
+
+      size_t num_inequalities() const
+      {
+        return 2 * (num_weights_ + num_constraints_);
+      }
+
+      size_t bound_index(size_t bound, bool lower) const
+      {
+        return 2 * bound + (lower ? 0 : 1);
+      }
+
+      size_t constraint_index(size_t constraint, bool lower) const
+      {
+        return 2 * (num_weights_ + constraint) + (lower ? 0 : 1);
+      }
+
+      // Value of n^T x - b for the inequality, which is negative if violated.
+      double slack(size_t index) const
+      {
+        bool lower = (index % 2 == 0);
+        if(index < 2 * num_weights_)
+        {
+          size_t j = index / 2;
+          return lower ? x_(j) - (*lb_)(j) : (*ub_)(j) - x_(j);
+        }
+
+        size_t k = (index - 2 * num_weights_) / 2;
+        double ax = A_->row(k).dot(x_);
+        return lower ? ax - (*lbA_)(k) : (*ubA_)(k) - ax;
+      }
+
+      void set_normal(size_t index)
+      {
+        double sign = (index % 2 == 0) ? 1.0 : -1.0;
+        if(index < 2 * num_weights_)
+        {
+          normal_.setZero();
+          normal_(index / 2) = sign;
+        }
+        else
+          normal_ = sign * A_->row((index - 2 * num_weights_) / 2).transpose();
+      }
+
+      // Right-hand side b of the inequality n^T x >= b.
+      double rhs(size_t index) const
+      {
+        bool lower = (index % 2 == 0);
+        if(index < 2 * num_weights_)
+          return lower ? (*lb_)(index / 2) : -(*ub_)(index / 2);
+
+        size_t k = (index - 2 * num_weights_) / 2;
+        return lower ? (*lbA_)(k) : -(*ubA_)(k);
+      }
+
+      qpOASES::returnValue run(const QPProblemBuilder& qp, int& nWSR, double* cputime)
+      {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        double budget = cputime ? *cputime : 0.0;
+        int max_nWSR = nWSR;
+        nWSR = 0;
+
+        H_ = &qp.get_H();
+        g_ = &qp.get_g();
+        A_ = &qp.get_A();
+        lb_ = &qp.get_lb();
+        ub_ = &qp.get_ub();
+        lbA_ = &qp.get_lbA();
+        ubA_ = &qp.get_ubA();
+
+        solved_ = false;
+        qpOASES::returnValue return_value = iterate(max_nWSR, nWSR, start, budget);
+        solved_ = (return_value == qpOASES::SUCCESSFUL_RETURN);
+
+        if(cputime)
+          *cputime = std::chrono::duration<double>(Clock::now() - start).count();
+        return return_value;
+      }
+
+      qpOASES::returnValue iterate(int max_nWSR, int& nWSR,
+          const std::chrono::steady_clock::time_point& start, double budget)
+      {
+        if(!factorized_ && !factorize())
+          return qpOASES::RET_INIT_FAILED;
+        factorized_ = true;
+
+        // the minimum on the seeded active set, or else the unconstrained
+        // minimum x = -H^-1 g = -J J^T g
+        size_t n = num_weights_;
+        double R_norm = 1.0;
+        if(!seed(R_norm))
+        {
+          J_ = J_factorized_;
+          num_active_ = 0;
+          std::fill(is_active_.begin(), is_active_.end(), false);
+          R_norm = 1.0;
+          d_.noalias() = J_.transpose() * (*g_);
+          x_.noalias() = -J_ * d_;
+        }
+
+        while(true)
+        {
+          // pick the inequality to add
+          size_t p = 0;
+          double s_p = -tolerance_;
+          bool found = false, found_preferred = false;
+          for(size_t i=0; i<num_inequalities(); ++i)
+          {
+            if(is_active_[i])
+              continue;
+            double s = slack(i);
+            if(!(s < -tolerance_))
+              continue;
+            if((preferred_[i] && !found_preferred) || (preferred_[i] == found_preferred && s < s_p))
+            {
+              p = i;
+              s_p = s;
+              found = true;
+              found_preferred = preferred_[i];
+            }
+          }
+          if(!found)
+            return qpOASES::SUCCESSFUL_RETURN;
+
+          set_normal(p);
+          u_(num_active_) = 0.0;
+          active_[num_active_] = p;
+
+          // steps towards satisfying p, dropping others on the way if needed
+          while(true)
+          {
+            if(nWSR >= max_nWSR || out_of_time(start, budget))
+              return qpOASES::RET_MAX_NWSR_REACHED;
+            ++nWSR;
+
+            d_.noalias() = J_.transpose() * normal_;
+            // primal direction z = J_2 d_2, dual direction r = R^-1 d_1
+            z_.noalias() = J_.rightCols(n - num_active_) * d_.tail(n - num_active_);
+            for(int i=static_cast<int>(num_active_)-1; i>=0; --i)
+            {
+              double sum = d_(i);
+              for(size_t j=i+1; j<num_active_; ++j)
+                sum -= R_(i, j) * r_(j);
+              r_(i) = sum / R_(i, i);
+            }
+
+            // partial step that keeps the multipliers non-negative
+            double t1 = std::numeric_limits<double>::infinity();
+            size_t l = 0;
+            for(size_t k=0; k<num_active_; ++k)
+              if(r_(k) > 0.0 && u_(k) / r_(k) < t1)
+              {
+                t1 = u_(k) / r_(k);
+                l = active_[k];
+              }
+
+            // full step that satisfies p
+            double t2 = std::numeric_limits<double>::infinity();
+            if(z_.squaredNorm() > std::numeric_limits<double>::epsilon())
+              t2 = -s_p / z_.dot(normal_);
+
+            double t = std::min(t1, t2);
+            if(std::isinf(t))
+              return qpOASES::RET_QP_INFEASIBLE;
+
+            if(std::isinf(t2))
+            {
+              // only a step in the dual space
+              u_.head(num_active_) -= t * r_.head(num_active_);
+              u_(num_active_) += t;
+              drop(l);
+              continue;
+            }
+
+            x_ += t * z_;
+            u_.head(num_active_) -= t * r_.head(num_active_);
+            u_(num_active_) += t;
+
+            if(t == t2)
+            {
+              if(!add(R_norm))
+                return qpOASES::RET_QP_INFEASIBLE;
+              is_active_[p] = true;
+              break;
+            }
+
+            drop(l);
+            s_p = slack(p);
+          }
+        }
+      }
+
+      static bool out_of_time(const std::chrono::steady_clock::time_point& start, double budget)
+      {
+        return budget > 0.0 && std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count() > budget;
+      }
+
+      // Adds the seeded inequalities to the active set without any steps, and
+      // moves x to the minimum on the active set. Then drops the inequality
+      // with the most negative multiplier until none is left. Fails if a
+      // seeded normal depends linearly on the others.
+      bool seed(double& R_norm)
+      {
+        J_ = J_factorized_;
+        num_active_ = 0;
+        std::fill(is_active_.begin(), is_active_.end(), false);
+        for(size_t i=0; i<num_seeded_; ++i)
+        {
+          size_t p = seeded_[i];
+          set_normal(p);
+          d_.noalias() = J_.transpose() * normal_;
+          active_[num_active_] = p;
+          if(!add(R_norm))
+            return false;
+          is_active_[p] = true;
+        }
+
+        while(true)
+        {
+          minimize_on_active_set();
+
+          size_t l = 0;
+          double u_l = -tolerance_;
+          bool found = false;
+          for(size_t k=0; k<num_active_; ++k)
+            if(u_(k) < u_l)
+            {
+              l = active_[k];
+              u_l = u_(k);
+              found = true;
+            }
+          if(!found)
+            return true;
+
+          u_(num_active_) = 0.0;
+          drop(l);
+        }
+      }
+
+      // Sets x to the minimum with all active inequalities as equalities,
+      // x = J_1 R^-T b - J_2 J_2^T g, and u to their multipliers,
+      // u = R^-1 (R^-T b + J_1^T g).
+      void minimize_on_active_set()
+      {
+        size_t n = num_weights_;
+        size_t k = num_active_;
+        d_.noalias() = J_.transpose() * (*g_);
+        for(size_t i=0; i<k; ++i)
+        {
+          double sum = rhs(active_[i]);
+          for(size_t j=0; j<i; ++j)
+            sum -= R_(j, i) * r_(j);
+          r_(i) = sum / R_(i, i);
+        }
+        x_.noalias() = J_.leftCols(k) * r_.head(k);
+        x_.noalias() -= J_.rightCols(n - k) * d_.tail(n - k);
+        for(int i=static_cast<int>(k)-1; i>=0; --i)
+        {
+          double sum = r_(i) + d_(i);
+          for(size_t j=i+1; j<k; ++j)
+            sum -= R_(i, j) * u_(j);
+          u_(i) = sum / R_(i, i);
+        }
+      }
+
+      // Computes L and J_factorized_ = L^-T. Fails if H is not positive
+      // definite.
+      bool factorize()
+      {
+        size_t n = num_weights_;
+        const QPProblemBuilder::Matrix& H = *H_;
+        for(size_t j=0; j<n; ++j)
+        {
+          double sum = H(j, j);
+          for(size_t k=0; k<j; ++k)
+            sum -= L_(j, k) * L_(j, k);
+          if(!(sum > 0.0))
+            return false;
+          L_(j, j) = std::sqrt(sum);
+          for(size_t i=j+1; i<n; ++i)
+          {
+            double value = H(i, j);
+            for(size_t k=0; k<j; ++k)
+              value -= L_(i, k) * L_(j, k);
+            L_(i, j) = value / L_(j, j);
+          }
+        }
+
+        // column i of J^T = L^-1 by forward substitution on e_i
+        J_factorized_.setZero();
+        for(size_t i=0; i<n; ++i)
+          for(size_t j=i; j<n; ++j)
+          {
+            double sum = (i == j) ? 1.0 : 0.0;
+            for(size_t k=i; k<j; ++k)
+              sum -= L_(j, k) * J_factorized_(i, k);
+            J_factorized_(i, j) = sum / L_(j, j);
+          }
+        return true;
+      }
+
+      // Adds the inequality whose rotated normal is in d to the active set,
+      // rotating J such that only its first columns span the active normals.
+      bool add(double& R_norm)
+      {
+        size_t n = num_weights_;
+        for(size_t j=n-1; j>num_active_; --j)
+        {
+          double cc = d_(j - 1);
+          double ss = d_(j);
+          double h = std::hypot(cc, ss);
+          if(h == 0.0)
+            continue;
+          d_(j) = 0.0;
+          cc /= h;
+          ss /= h;
+          if(cc < 0.0)
+          {
+            cc = -cc;
+            ss = -ss;
+            d_(j - 1) = -h;
+          }
+          else
+            d_(j - 1) = h;
+          double xny = ss / (1.0 + cc);
+          for(size_t k=0; k<n; ++k)
+          {
+            double t1 = J_(k, j - 1);
+            double t2 = J_(k, j);
+            J_(k, j - 1) = t1 * cc + t2 * ss;
+            J_(k, j) = xny * (t1 + J_(k, j - 1)) - t2;
+          }
+        }
+
+        ++num_active_;
+        R_.col(num_active_ - 1).head(num_active_) = d_.head(num_active_);
+
+        // NOTE: The new normal is linearly dependent on the active ones.
+        if(std::abs(d_(num_active_ - 1)) <= std::numeric_limits<double>::epsilon() * R_norm)
+          return false;
+        R_norm = std::max(R_norm, std::abs(d_(num_active_ - 1)));
+        return true;
+      }
+
+      // Drops the active inequality 'index', keeping R upper triangular. The
+      // multiplier of the inequality that is being added moves along.
+      void drop(size_t index)
+      {
+        size_t n = num_weights_;
+        size_t position = 0;
+        while(active_[position] != index)
+          ++position;
+
+        is_active_[index] = false;
+        for(size_t i=position; i+1<num_active_; ++i)
+        {
+          active_[i] = active_[i + 1];
+          u_(i) = u_(i + 1);
+          R_.col(i) = R_.col(i + 1);
+        }
+        active_[num_active_ - 1] = active_[num_active_];
+        u_(num_active_ - 1) = u_(num_active_);
+        active_[num_active_] = 0;
+        u_(num_active_) = 0.0;
+        R_.col(num_active_ - 1).setZero();
+        --num_active_;
+
+        for(size_t j=position; j<num_active_; ++j)
+        {
+          double cc = R_(j, j);
+          double ss = R_(j + 1, j);
+          double h = std::hypot(cc, ss);
+          if(h == 0.0)
+            continue;
+          cc /= h;
+          ss /= h;
+          R_(j + 1, j) = 0.0;
+          if(cc < 0.0)
+          {
+            R_(j, j) = -h;
+            cc = -cc;
+            ss = -ss;
+          }
+          else
+            R_(j, j) = h;
+          double xny = ss / (1.0 + cc);
+          for(size_t k=j+1; k<num_active_; ++k)
+          {
+            double t1 = R_(j, k);
+            double t2 = R_(j + 1, k);
+            R_(j, k) = t1 * cc + t2 * ss;
+            R_(j + 1, k) = xny * (t1 + R_(j, k)) - t2;
+          }
+          for(size_t k=0; k<n; ++k)
+          {
+            double t1 = J_(k, j);
+            double t2 = J_(k, j + 1);
+            J_(k, j) = t1 * cc + t2 * ss;
+            J_(k, j + 1) = xny * (J_(k, j) + t1) - t2;
+          }
+        }
+      }
+  };
+}
+
+#endif // GISKARD_CORE_ACTIVE_SET_QP_SOLVER_HPP
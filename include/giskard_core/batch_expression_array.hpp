@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_BATCH_EXPRESSION_ARRAY_HPP
+#define GISKARD_CORE_BATCH_EXPRESSION_ARRAY_HPP
+
+#include <Eigen/Dense>
+#include <giskard_core/tape_generation.hpp>
+
+namespace giskard_core
+{
+  // Evaluates the same double expressions, and their derivatives w.r.t. the
+  // controllables, for many observable vectors at once. Every register of the
+  // tape holds the values of 'Lanes' states next to each other, so that the
+  // inner loop over the states of a batch maps onto SIMD lanes. Use 4 lanes for
+  // AVX2, and 8 for AVX-512.
+  // NOTE: The compiler only vectorizes these loops if the target allows it,
+  //       e.g. with -O3 -mavx2 or -march=native.
+  template<size_t Lanes = 4>
+  class BatchExpressionArray
+  {
+    public:
+      BatchExpressionArray() : num_observables_( 0 ), num_derivatives_( 0 ), num_expressions_( 0 ) {}
+
+      // The observables of the states follow the layout of the scope generated
+      // for 'controllables', i.e. the controllables come first.
+      void init(const giskard_core::ScopeSpec& scope_spec,
+          const std::vector<giskard_core::DoubleSpecPtr>& expressions,
+          const std::vector<std::string>& controllables)
+      {
+        Tape tape;
+        giskard_core::Scope scope = generate(scope_spec, controllables);
+        TapeGenerator generator(tape, scope);
+        generator.add_scope(scope_spec);
+
+        std::vector<size_t> instructions;
+        for(size_t i=0; i<expressions.size(); ++i)
+          instructions.push_back(generator.generate_double(expressions[i]));
+
+        init(tape, instructions, controllables.size());
+      }
+
+      void init(Tape& tape, const std::vector<size_t>& expressions, size_t num_derivatives)
+      {
+        num_expressions_ = expressions.size();
+        num_derivatives_ = num_derivatives;
+
+        tape.set_num_derivatives(num_derivatives);
+        std::vector<Output> values, derivatives;
+        for(size_t i=0; i<expressions.size(); ++i)
+        {
+          values.push_back(output(i, 0, expressions[i]));
+          const std::map<size_t, size_t>& expression_derivatives = tape.get_derivatives(expressions[i]);
+          for(std::map<size_t, size_t>::const_iterator it=expression_derivatives.begin();
+              it!=expression_derivatives.end(); ++it)
+            derivatives.push_back(output(i, it->first, it->second));
+        }
+
+        std::vector<bool> used(tape.size(), false);
+        for(size_t i=0; i<values.size(); ++i)
+          used[values[i].register_] = true;
+        for(size_t i=0; i<derivatives.size(); ++i)
+          used[derivatives[i].register_] = true;
+        tape.mark_arguments(used);
+
+        std::vector<size_t> register_index(tape.size(), 0);
+        size_t num_registers = 0;
+        for(size_t i=0; i<tape.size(); ++i)
+          if(used[i])
+            register_index[i] = num_registers++;
+        registers_.assign(num_registers * Lanes, 0.0);
+
+        inputs_.clear();
+        program_.clear();
+        num_observables_ = 0;
+        for(size_t i=0; i<tape.size(); ++i)
+        {
+          if(!used[i])
+            continue;
+
+          const TapeInstruction& instruction = tape.get_instruction(i);
+          if(instruction.operation_ == toConstant)
+          {
+            for(size_t l=0; l<Lanes; ++l)
+              registers_[register_index[i] * Lanes + l] = instruction.value_;
+          }
+          else if(instruction.operation_ == toInput)
+          {
+            Input input;
+            input.register_ = register_index[i];
+            input.observable_ = static_cast<size_t>(instruction.value_);
+            inputs_.push_back(input);
+            num_observables_ = std::max(num_observables_, input.observable_ + 1);
+          }
+          else
+          {
+            Instruction compiled;
+            compiled.operation_ = instruction.operation_;
+            compiled.result_ = register_index[i];
+            for(size_t j=0; j<3; ++j)
+              compiled.arguments_[j] = (j < num_arguments(instruction.operation_)) ?
+                  register_index[instruction.arguments_[j]] : 0;
+            program_.push_back(compiled);
+          }
+        }
+
+        value_outputs_ = values;
+        derivative_outputs_ = derivatives;
+        for(size_t i=0; i<value_outputs_.size(); ++i)
+          value_outputs_[i].register_ = register_index[value_outputs_[i].register_];
+        for(size_t i=0; i<derivative_outputs_.size(); ++i)
+          derivative_outputs_[i].register_ = register_index[derivative_outputs_[i].register_];
+
+        values_.resize(0, 0);
+        derivatives_.resize(0, 0);
+      }
+
+      // Every column of 'observables' is one state.
+      void update(const Eigen::MatrixXd& observables)
+      {
+        if(static_cast<size_t>(observables.rows()) < num_observables())
+          throw std::invalid_argument("BatchExpressionArray: Received too few observables.");
+
+        size_t num_states = observables.cols();
+        if(static_cast<size_t>(values_.cols()) != num_states)
+        {
+          values_.resize(num_expressions(), num_states);
+          // structurally zero derivatives are never written
+          derivatives_.setZero(num_expressions(), num_derivatives() * num_states);
+        }
+
+        for(size_t first=0; first<num_states; first+=Lanes)
+        {
+          // the lanes of the last batch that have no state repeat the last one
+          for(size_t i=0; i<inputs_.size(); ++i)
+            for(size_t l=0; l<Lanes; ++l)
+              registers_[inputs_[i].register_ * Lanes + l] =
+                  observables(inputs_[i].observable_, std::min(first + l, num_states - 1));
+
+          run_program();
+
+          size_t num_lanes = std::min(Lanes, num_states - first);
+          for(size_t i=0; i<value_outputs_.size(); ++i)
+            for(size_t l=0; l<num_lanes; ++l)
+              values_(value_outputs_[i].expression_, first + l) =
+                  registers_[value_outputs_[i].register_ * Lanes + l];
+          for(size_t i=0; i<derivative_outputs_.size(); ++i)
+            for(size_t l=0; l<num_lanes; ++l)
+              derivatives_(derivative_outputs_[i].expression_,
+                  (first + l) * num_derivatives() + derivative_outputs_[i].column_) =
+                  registers_[derivative_outputs_[i].register_ * Lanes + l];
+        }
+      }
+
+      // Values of all expressions, one column per state.
+      const Eigen::MatrixXd& get_values() const
+      {
+        return values_;
+      }
+
+      // Jacobian of all expressions w.r.t. the controllables for one state.
+      Eigen::Block<const Eigen::MatrixXd> get_derivatives(size_t state) const
+      {
+        return derivatives_.block(0, state * num_derivatives(), num_expressions(), num_derivatives());
+      }
+
+      size_t num_observables() const
+      {
+        return num_observables_;
+      }
+
+      size_t num_derivatives() const
+      {
+        return num_derivatives_;
+      }
+
+      size_t num_expressions() const
+      {
+        return num_expressions_;
+      }
+
+      size_t num_lanes() const
+      {
+        return Lanes;
+      }
+
+    private:
+      struct Instruction
+      {
+        TapeOperation operation_;
+        size_t result_;
+        size_t arguments_[3];
+      };
+
+      struct Input
+      {
+        size_t register_, observable_;
+      };
+
+      struct Output
+      {
+        size_t expression_, column_, register_;
+      };
+
+      std::vector<Input> inputs_;
+      std::vector<Instruction> program_;
+      std::vector<Output> value_outputs_, derivative_outputs_;
+      std::vector<double> registers_;
+      size_t num_observables_, num_derivatives_, num_expressions_;
+      Eigen::MatrixXd values_, derivatives_;
+
+      static Output output(size_t expression, size_t column, size_t instruction)
+      {
+        Output result;
+        result.expression_ = expression;
+        result.column_ = column;
+        result.register_ = instruction;
+        return result;
+      }
+
+      void run_program()
+      {
+        double* r = registers_.data();
+        for(size_t i=0; i<program_.size(); ++i)
+        {
+          const Instruction& in = program_[i];
+          double* result = r + in.result_ * Lanes;
+          const double* a = r + in.arguments_[0] * Lanes;
+          const double* b = r + in.arguments_[1] * Lanes;
+          const double* c = r + in.arguments_[2] * Lanes;
+          switch(in.operation_)
+          {
+            case toAdd:
+              for(size_t l=0; l<Lanes; ++l) result[l] = a[l] + b[l];
+              break;
+            case toSub:
+              for(size_t l=0; l<Lanes; ++l) result[l] = a[l] - b[l];
+              break;
+            case toMul:
+              for(size_t l=0; l<Lanes; ++l) result[l] = a[l] * b[l];
+              break;
+            case toDiv:
+              for(size_t l=0; l<Lanes; ++l) result[l] = a[l] / b[l];
+              break;
+            case toNeg:
+              for(size_t l=0; l<Lanes; ++l) result[l] = -a[l];
+              break;
+            case toSqrt:
+              for(size_t l=0; l<Lanes; ++l) result[l] = std::sqrt(a[l]);
+              break;
+            case toMin:
+              for(size_t l=0; l<Lanes; ++l) result[l] = std::min(a[l], b[l]);
+              break;
+            case toMax:
+              for(size_t l=0; l<Lanes; ++l) result[l] = std::max(a[l], b[l]);
+              break;
+            case toSelect:
+              for(size_t l=0; l<Lanes; ++l) result[l] = a[l] >= 0.0 ? b[l] : c[l];
+              break;
+            default:
+              for(size_t l=0; l<Lanes; ++l)
+                result[l] = giskard_core::evaluate(in.operation_, a[l], b[l], c[l]);
+          }
+        }
+      }
+  };
+}
+
+#endif // GISKARD_CORE_BATCH_EXPRESSION_ARRAY_HPP
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_CODE_GENERATION_HPP
+#define GISKARD_CORE_CODE_GENERATION_HPP
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <giskard_core/tape_generation.hpp>
+
+namespace giskard_core
+{
+  // Emits self-contained C++ source that evaluates a QPTape in straight-line
+  // code. The source defines two functions with C linkage that match
+  // QPEvaluationFunction and QPDimensionsFunction:
+  //   void <name>(const double* observables, double* H, double* g, double* A,
+  //       double* lb, double* ub, double* lbA, double* ubA);
+  //   void <name>_dimensions(unsigned int* num_observables,
+  //       unsigned int* num_weights, unsigned int* num_constraints);
+  // The layout of H, g, A and the bounds is the one of QPProblemBuilder. The
+  // number of observables is the one of the specification, so that a
+  // controller can tell whether the code was generated for it.
+  class CodeGenerator
+  {
+    public:
+      CodeGenerator(const QPTape& qp) : qp_( qp ) {}
+
+      std::string generate(const std::string& function_name)
+      {
+        mark_used_instructions();
+
+        std::ostringstream out;
+        out << "// Generated by giskard_codegen. Do not edit." << std::endl;
+        out << "#include <algorithm>" << std::endl;
+        out << "#include <cmath>" << std::endl;
+        out << "#include <limits>" << std::endl;
+        out << std::endl;
+
+        out << "extern \"C\" void " << function_name << "_dimensions(unsigned int* num_observables," << std::endl;
+        out << "    unsigned int* num_weights, unsigned int* num_constraints)" << std::endl;
+        out << "{" << std::endl;
+        out << "  *num_observables = " << std::max(qp_.num_observables_, num_observables()) << ";" << std::endl;
+        out << "  *num_weights = " << qp_.num_weights() << ";" << std::endl;
+        out << "  *num_constraints = " << qp_.num_constraints() << ";" << std::endl;
+        out << "}" << std::endl;
+        out << std::endl;
+
+        out << "extern \"C\" void " << function_name << "(const double* observables, double* H, double* g," << std::endl;
+        out << "    double* A, double* lb, double* ub, double* lbA, double* ubA)" << std::endl;
+        out << "{" << std::endl;
+
+        const std::vector<TapeInstruction>& instructions = qp_.tape_.get_instructions();
+        for(size_t i=0; i<instructions.size(); ++i)
+          if(used_[i] && instructions[i].operation_ != toConstant && instructions[i].operation_ != toInput)
+            out << "  const double v" << i << " = " << to_code(instructions[i]) << ";" << std::endl;
+        out << std::endl;
+
+        size_t nw = qp_.num_weights();
+        out << "  for(unsigned int i=0; i<" << nw * nw << "; ++i)" << std::endl;
+        out << "    H[i] = 0.0;" << std::endl;
+        out << "  for(unsigned int i=0; i<" << nw << "; ++i)" << std::endl;
+        out << "    g[i] = 0.0;" << std::endl;
+        out << "  for(unsigned int i=0; i<" << qp_.num_constraints() * nw << "; ++i)" << std::endl;
+        out << "    A[i] = 0.0;" << std::endl;
+        out << std::endl;
+
+        for(size_t i=0; i<qp_.outputs_.size(); ++i)
+          out << "  " << to_code(qp_.outputs_[i].type_) << "[" << qp_.outputs_[i].index_ << "] = " <<
+              to_code(qp_.outputs_[i].instruction_) << ";" << std::endl;
+
+        out << "}" << std::endl;
+        return out.str();
+      }
+
+      // Number of observables read by the generated code. Unlike the number of
+      // inputs of the tape, this ignores inputs that only unused scope entries read.
+      size_t num_observables() const
+      {
+        size_t result = 0;
+        const std::vector<TapeInstruction>& instructions = qp_.tape_.get_instructions();
+        for(size_t i=0; i<used_.size(); ++i)
+          if(used_[i] && instructions[i].operation_ == toInput)
+            result = std::max(result, static_cast<size_t>(instructions[i].value_) + 1);
+        return result;
+      }
+
+      // Number of instructions that end up in the generated code.
+      size_t num_used_instructions() const
+      {
+        size_t result = 0;
+        for(size_t i=0; i<used_.size(); ++i)
+          if(used_[i] && qp_.tape_.get_instruction(i).operation_ != toConstant &&
+              qp_.tape_.get_instruction(i).operation_ != toInput)
+            ++result;
+        return result;
+      }
+
+    private:
+      const QPTape& qp_;
+      std::vector<bool> used_;
+
+      void mark_used_instructions()
+      {
+        used_.assign(qp_.tape_.size(), false);
+        for(size_t i=0; i<qp_.outputs_.size(); ++i)
+          used_[qp_.outputs_[i].instruction_] = true;
+        qp_.tape_.mark_arguments(used_);
+      }
+
+      static std::string to_code(QPOutputType type)
+      {
+        switch(type)
+        {
+          case qoH: return "H";
+          case qoG: return "g";
+          case qoA: return "A";
+          case qoLB: return "lb";
+          case qoUB: return "ub";
+          case qoLBA: return "lbA";
+          default: return "ubA";
+        }
+      }
+
+      static std::string to_code(double value)
+      {
+        if(std::isnan(value))
+          return "std::numeric_limits<double>::quiet_NaN()";
+        if(std::isinf(value))
+          return value > 0 ? "std::numeric_limits<double>::infinity()" :
+              "(-std::numeric_limits<double>::infinity())";
+
+        std::ostringstream out;
+        out.precision(17);
+        out << value;
+        std::string result = out.str();
+        if(result.find_first_of(".e") == std::string::npos)
+          result += ".0";
+        return value < 0 ? "(" + result + ")" : result;
+      }
+
+      // Reference to the value of an instruction. Constants and inputs are
+      // inlined, all other instructions have a variable of their own.
+      std::string to_code(size_t index) const
+      {
+        const TapeInstruction& instruction = qp_.tape_.get_instruction(index);
+        std::ostringstream out;
+        if(instruction.operation_ == toConstant)
+          return to_code(instruction.value_);
+        if(instruction.operation_ == toInput)
+          out << "observables[" << static_cast<size_t>(instruction.value_) << "]";
+        else
+          out << "v" << index;
+        return out.str();
+      }
+
+      std::string to_code(const TapeInstruction& instruction) const
+      {
+        std::string a = to_code(instruction.arguments_[0]);
+        std::string b = num_arguments(instruction.operation_) > 1 ? to_code(instruction.arguments_[1]) : "";
+        std::string c = num_arguments(instruction.operation_) > 2 ? to_code(instruction.arguments_[2]) : "";
+
+        switch(instruction.operation_)
+        {
+          case toAdd: return a + " + " + b;
+          case toSub: return a + " - " + b;
+          case toMul: return a + " * " + b;
+          case toDiv: return a + " / " + b;
+          case toNeg: return "-" + a;
+          case toSin: return "std::sin(" + a + ")";
+          case toCos: return "std::cos(" + a + ")";
+          case toTan: return "std::tan(" + a + ")";
+          case toAsin: return "std::asin(" + a + ")";
+          case toAcos: return "std::acos(" + a + ")";
+          case toAtan: return "std::atan(" + a + ")";
+          case toAtan2: return "std::atan2(" + a + ", " + b + ")";
+          case toSqrt: return "std::sqrt(" + a + ")";
+          case toAbs: return "std::fabs(" + a + ")";
+          case toFmod: return "std::fmod(" + a + ", " + b + ")";
+          case toMin: return "std::min(" + a + ", " + b + ")";
+          case toMax: return "std::max(" + a + ", " + b + ")";
+          case toSelect: return a + " >= 0.0 ? " + b + " : " + c;
+          default:
+            throw std::domain_error("Code generation: Cannot emit operation '" +
+                giskard_core::to_string(instruction.operation_) + "'.");
+        }
+      }
+  };
+
+  inline std::string generate_code(const QPTape& qp, const std::string& function_name)
+  {
+    CodeGenerator generator(qp);
+    return generator.generate(function_name);
+  }
+}
+
+#endif // GISKARD_CORE_CODE_GENERATION_HPP
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_CONTROLLER_SYNTHESIS_HPP
+#define GISKARD_CORE_CONTROLLER_SYNTHESIS_HPP
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include <giskard_core/expression_extraction.hpp>
+
+namespace giskard_core
+{
+  struct SyntheticControllerOptions
+  {
+    SyntheticControllerOptions() : num_joints_( 7 ), num_branches_( 1 ),
+      num_soft_constraints_( 3 ), num_hard_constraints_( 0 ), num_goal_inputs_( 1 ) {}
+
+    size_t num_joints_, num_branches_, num_soft_constraints_, num_hard_constraints_, num_goal_inputs_;
+  };
+
+  // Writes QPControllerSpecs of arbitrary size, to see how the controller
+  // scales beyond the shipped robots. The robot is a tree of revolute joints:
+  // a trunk that is shared by all branches, if there is more than one branch,
+  // and the branches on top of it. The forward kinematics of the trunk and
+  // the branches come from ExpressionExtractor.
+  //
+  // Soft constraint i moves the tip of branch (i % branches) along one axis
+  // towards the goal input (i % goals), or towards a constant point if there
+  // are no goal inputs. Hard constraint i limits a weighted sum of two joints,
+  // so that it always stays a row of A.
+  class ControllerSynthesizer
+  {
+    public:
+      static inline YAML::Node synthesize(const SyntheticControllerOptions& options)
+      {
+        if (options.num_joints_ < options.num_branches_ || options.num_branches_ == 0)
+          throw std::invalid_argument("Controller synthesis: Need at least one joint per branch, and at least one branch.");
+
+        YAML::Node scope;
+
+        // joints are numbered from the trunk upwards
+        size_t num_trunk_joints = options.num_branches_ > 1 ? options.num_joints_ / (options.num_branches_ + 1) : 0;
+        size_t num_branch_joints = options.num_joints_ - num_trunk_joints;
+        size_t joint = 0;
+        if (num_trunk_joints > 0)
+          append(scope, ExpressionExtractor::extract(get_chain("trunk", joint, num_trunk_joints, 0), "trunk"));
+        joint += num_trunk_joints;
+
+        for (size_t b = 0; b < options.num_branches_; ++b)
+        {
+          size_t num_joints = num_branch_joints / options.num_branches_ +
+              (b < num_branch_joints % options.num_branches_ ? 1 : 0);
+          std::string branch = "branch_" + std::to_string(b);
+          KDL::Chain chain = get_chain(branch, joint, num_joints, b);
+          joint += num_joints;
+
+          if (num_trunk_joints > 0)
+          {
+            append(scope, ExpressionExtractor::extract(chain, branch + "_local"));
+            YAML::Node frame_mul;
+            frame_mul[branch]["frame-mul"].push_back("trunk");
+            frame_mul[branch]["frame-mul"].push_back(branch + "_local");
+            scope.push_back(frame_mul);
+          }
+          else
+            append(scope, ExpressionExtractor::extract(chain, branch));
+
+          YAML::Node position;
+          position[branch + "_position"]["origin-of"] = branch;
+          scope.push_back(position);
+          for (size_t axis = 0; axis < 3; ++axis)
+            scope.push_back(get_coordinate(branch + "_" + axis_name(axis), branch + "_position", axis));
+        }
+
+        for (size_t g = 0; g < options.num_goal_inputs_; ++g)
+        {
+          std::string goal = "goal_" + std::to_string(g);
+          YAML::Node input;
+          input[goal]["input-vec3"] = goal;
+          scope.push_back(input);
+          for (size_t axis = 0; axis < 3; ++axis)
+            scope.push_back(get_coordinate(goal + "_" + axis_name(axis), goal, axis));
+        }
+
+        YAML::Node gain;
+        gain["position_gain"] = 2.0;
+        scope.push_back(gain);
+
+        YAML::Node controllable_constraints;
+        for (size_t j = 0; j < options.num_joints_; ++j)
+        {
+          YAML::Node constraint;
+          constraint["controllable-constraint"].push_back(-0.5);
+          constraint["controllable-constraint"].push_back(0.5);
+          constraint["controllable-constraint"].push_back(0.01);
+          constraint["controllable-constraint"].push_back(joint_name(j));
+          controllable_constraints.push_back(constraint);
+        }
+
+        YAML::Node soft_constraints;
+        for (size_t i = 0; i < options.num_soft_constraints_; ++i)
+        {
+          std::string branch = "branch_" + std::to_string(i % options.num_branches_);
+          std::string axis = axis_name((i / options.num_branches_) % 3);
+          YAML::Node goal = options.num_goal_inputs_ > 0 ?
+              YAML::Node("goal_" + std::to_string(i % options.num_goal_inputs_) + "_" + axis) :
+              YAML::Node(0.5);
+
+          YAML::Node error, control, constraint;
+          error["double-sub"].push_back(goal);
+          error["double-sub"].push_back(branch + "_" + axis);
+          control["double-mul"].push_back("position_gain");
+          control["double-mul"].push_back(error);
+          constraint["soft-constraint"].push_back(control);
+          constraint["soft-constraint"].push_back(YAML::Clone(control));
+          constraint["soft-constraint"].push_back(10.0);
+          constraint["soft-constraint"].push_back(branch + "_" + axis);
+          constraint["soft-constraint"].push_back("soft_" + std::to_string(i));
+          soft_constraints.push_back(constraint);
+        }
+
+        YAML::Node hard_constraints;
+        for (size_t i = 0; i < options.num_hard_constraints_; ++i)
+        {
+          std::string name = "hard_" + std::to_string(i);
+          size_t a = i % options.num_joints_;
+          size_t b = (a + 1 + i / options.num_joints_) % options.num_joints_;
+          double weight = 1.0 + 0.1 * (i / options.num_joints_);
+          double limit = 3.0 * (1.0 + weight);
+
+          YAML::Node sum, weighted;
+          weighted["double-mul"].push_back(weight);
+          weighted["double-mul"].push_back(joint_name(b) + "_var");
+          sum[name]["double-add"].push_back(joint_name(a) + "_var");
+          sum[name]["double-add"].push_back(weighted);
+          scope.push_back(sum);
+
+          YAML::Node lower, upper, constraint;
+          lower["double-sub"].push_back(-limit);
+          lower["double-sub"].push_back(name);
+          upper["double-sub"].push_back(limit);
+          upper["double-sub"].push_back(name);
+          constraint["hard-constraint"].push_back(lower);
+          constraint["hard-constraint"].push_back(upper);
+          constraint["hard-constraint"].push_back(name);
+          hard_constraints.push_back(constraint);
+        }
+
+        YAML::Node node;
+        node["scope"] = scope;
+        node["controllable-constraints"] = controllable_constraints;
+        node["soft-constraints"] = soft_constraints;
+        node["hard-constraints"] = hard_constraints;
+        return node;
+      }
+
+      static inline std::string joint_name(size_t joint)
+      {
+        return "joint_" + std::to_string(joint);
+      }
+
+    private:
+      // Serial chain of revolute joints with alternating axes and links of
+      // 10cm. The first link is offset sideways per branch, so that the
+      // branches do not coincide.
+      static inline KDL::Chain get_chain(const std::string& name, size_t first_joint, size_t num_joints, size_t branch)
+      {
+        KDL::Chain chain;
+        chain.addSegment(KDL::Segment(name + "_mount", KDL::Joint(name + "_mount", KDL::Joint::None),
+            KDL::Frame(KDL::Vector(0, 0.2 * branch, 0.1))));
+        for (size_t j = first_joint; j < first_joint + num_joints; ++j)
+        {
+          KDL::Vector axis(j % 3 == 2 ? 1 : 0, j % 3 == 1 ? 1 : 0, j % 3 == 0 ? 1 : 0);
+          KDL::Joint joint(joint_name(j), KDL::Vector::Zero(), axis, KDL::Joint::RotAxis);
+          chain.addSegment(KDL::Segment(joint_name(j) + "_link", joint, KDL::Frame(KDL::Vector(0.1, 0, 0))));
+        }
+        return chain;
+      }
+
+      static inline void append(YAML::Node& scope, const YAML::Node& entries)
+      {
+        for (size_t i = 0; i < entries.size(); ++i)
+          scope.push_back(entries[i]);
+      }
+
+      static inline std::string axis_name(size_t axis)
+      {
+        return axis == 0 ? "x" : (axis == 1 ? "y" : "z");
+      }
+
+      static inline YAML::Node get_coordinate(const std::string& name, const std::string& vector, size_t axis)
+      {
+        YAML::Node coordinate;
+        coordinate[name][axis_name(axis) + "-coord"] = vector;
+        return coordinate;
+      }
+  };
+
+  static YAML::Node synthesize_controller(const SyntheticControllerOptions& options)
+  {
+    return ControllerSynthesizer::synthesize(options);
+  }
+}
+
+#endif // GISKARD_CORE_CONTROLLER_SYNTHESIS_HPP
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_DIAGONAL_QP_SOLVER_HPP
+#define GISKARD_CORE_DIAGONAL_QP_SOLVER_HPP
+
+#include <giskard_core/qp_solver.hpp>
+
+namespace giskard_core
+{
+  // Solves QPs with a diagonal H, i.e. all QPs without least-squares soft
+  // constraints. With x = S y and S = diag(1/sqrt(H_ii)), the QP becomes
+  //   min 0.5 y^T y + (S g)^T y  s.t.  S^-1 lb <= y <= S^-1 ub, lbA <= A S y <= ubA,
+  // which qpOASES solves as a QP with the identity as its Hessian. Hence, H
+  // is neither handed over nor factorized, and A is only scaled column-wise.
+  // The scaling keeps the signs, so working sets are the same for both QPs.
+  // NOTE: All weights have to be positive, otherwise the solver fails with
+  //       RET_INVALID_ARGUMENTS.
+  class DiagonalQPSolver : public QPOasesSolverBase
+  {
+    public:
+      DiagonalQPSolver() : A_values_( 0 ) {}
+
+      virtual QPSolver* clone() const
+      {
+        return new DiagonalQPSolver(*this);
+      }
+
+      virtual void init(const QPProblemBuilder& qp)
+      {
+        if(qp.num_least_squares_soft_constraints() > 0)
+          throw std::invalid_argument("DiagonalQPSolver: Least-squares soft constraints make H non-diagonal.");
+
+        setup_problem(qp, qpOASES::HST_IDENTITY);
+        scale_ = Eigen::VectorXd::Zero(qp.num_weights());
+        g_ = Eigen::VectorXd::Zero(qp.num_weights());
+        lb_ = Eigen::VectorXd::Zero(qp.num_weights());
+        ub_ = Eigen::VectorXd::Zero(qp.num_weights());
+        if(qp.is_sparse())
+        {
+          const QPProblemBuilder::SparseMatrix& A = qp.get_sparse_A();
+          sparse_A_rows_.assign(A.innerIndexPtr(), A.innerIndexPtr() + A.nonZeros());
+          sparse_A_cols_.assign(A.outerIndexPtr(), A.outerIndexPtr() + A.outerSize() + 1);
+          sparse_A_values_.assign(A.nonZeros(), 0.0);
+        }
+        else
+          A_ = QPProblemBuilder::Matrix::Zero(qp.num_constraints(), qp.num_weights());
+        A_view_.reset();
+      }
+
+      virtual qpOASES::returnValue solve(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime, const QPWorkingSet* guess)
+      {
+        if(!scale(qp))
+          return qpOASES::RET_INVALID_ARGUMENTS;
+
+        create_matrix(qp);
+        return init_problem(identity(), g_.data(), A_view_.get(), lb_.data(), ub_.data(),
+            qp.get_lbA().data(), qp.get_ubA().data(), nWSR, cputime, guess);
+      }
+
+      virtual qpOASES::returnValue hotstart(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime)
+      {
+        if(!scale(qp))
+          return qpOASES::RET_INVALID_ARGUMENTS;
+
+        // NOTE: After copying the solver, the view still points into the original.
+        bool new_matrix = !A_view_ || A_values_ != A_values(qp);
+        if(new_matrix)
+          create_matrix(qp);
+
+        return hotstart_problem(identity(), g_.data(), A_view_.get(), lb_.data(), ub_.data(),
+            qp.get_lbA().data(), qp.get_ubA().data(), nWSR, cputime,
+            qp.has_constant_matrices() && !new_matrix);
+      }
+
+      virtual void get_primal_solution(Eigen::VectorXd& x) const
+      {
+        qp_problem_.getPrimalSolution(x.data());
+        x = x.cwiseProduct(scale_);
+      }
+
+    private:
+      // diagonal of S, and the scaled QP apart from lbA and ubA
+      Eigen::VectorXd scale_, g_, lb_, ub_;
+      QPProblemBuilder::Matrix A_;
+      std::vector<double> sparse_A_values_;
+      std::vector<qpOASES::sparse_int_t> sparse_A_rows_, sparse_A_cols_;
+      // qpOASES view on the scaled A
+      boost::shared_ptr<qpOASES::Matrix> A_view_;
+      const double* A_values_;
+
+      static qpOASES::SymmetricMatrix* identity()
+      {
+        return 0;
+      }
+
+      const double* A_values(const QPProblemBuilder& qp) const
+      {
+        return qp.is_sparse() ? sparse_A_values_.data() : A_.data();
+      }
+
+      // Scales the current QP of the builder. Fails for weights that are not
+      // positive.
+      bool scale(const QPProblemBuilder& qp)
+      {
+        if(qp.is_sparse())
+          scale_ = qp.get_sparse_H().diagonal();
+        else
+          scale_ = qp.get_H().diagonal();
+        // NOTE: NaNs never compare greater, so they fail as well.
+        if(scale_.size() > 0 && !(scale_.minCoeff() > 0.0))
+          return false;
+        scale_ = scale_.cwiseSqrt().cwiseInverse();
+
+        g_ = qp.get_g().cwiseProduct(scale_);
+        lb_ = qp.get_lb().cwiseQuotient(scale_);
+        ub_ = qp.get_ub().cwiseQuotient(scale_);
+
+        if(!qp.is_sparse())
+        {
+          A_ = qp.get_A() * scale_.asDiagonal();
+          return true;
+        }
+
+        const QPProblemBuilder::SparseMatrix& A = qp.get_sparse_A();
+        for(int j=0; j<A.outerSize(); ++j)
+          for(int k=A.outerIndexPtr()[j]; k<A.outerIndexPtr()[j+1]; ++k)
+            sparse_A_values_[k] = A.valuePtr()[k] * scale_(j);
+        return true;
+      }
+
+      void create_matrix(const QPProblemBuilder& qp)
+      {
+        A_values_ = A_values(qp);
+        if(qp.is_sparse())
+          A_view_ = boost::shared_ptr<qpOASES::SparseMatrix>(new qpOASES::SparseMatrix(
+              qp.num_constraints(), qp.num_weights(), sparse_A_rows_.data(), sparse_A_cols_.data(),
+              const_cast<double*>(A_values_)));
+        else
+          A_view_ = boost::shared_ptr<qpOASES::DenseMatrix>(new qpOASES::DenseMatrix(
+              A_.rows(), A_.cols(), A_.cols(), const_cast<double*>(A_values_)));
+      }
+  };
+}
+
+#endif // GISKARD_CORE_DIAGONAL_QP_SOLVER_HPP
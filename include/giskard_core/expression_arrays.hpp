@@ -21,6 +21,8 @@
 #ifndef GISKARD_CORE_EXPRESSION_ARRAYS_HPP
 #define GISKARD_CORE_EXPRESSION_ARRAYS_HPP
 
+#include <limits>
+#include <set>
 #include <kdl/expressiontree.hpp>
 
 namespace KDL
@@ -33,6 +35,10 @@ namespace KDL
       typedef typename KDL::AutoDiffTrait<ResultType>::DerivType DerivType;
       typedef typename KDL::Expression<DerivType>::Ptr DerivExpressionTypePtr;
 
+      ExpressionArray() :
+        max_num_derivatives_( std::numeric_limits<size_t>::max() ),
+        num_updated_expressions_( 0 ), evaluate_all_( true ) {}
+
       size_t num_expressions() const
       {
         return expressions_.size();
@@ -46,6 +52,26 @@ namespace KDL
         return result;
       }
 
+      // Number of inputs w.r.t. which derivatives are calculated.
+      size_t num_derivatives() const
+      {
+        return std::min(num_inputs(), max_num_derivatives_);
+      }
+
+      // Restricts the calculation of derivatives to the first inputs, e.g. to the
+      // joints at the front of the observable vector. Derivatives w.r.t. all other
+      // inputs are neither calculated nor stored.
+      void set_max_num_derivatives(size_t max_num_derivatives)
+      {
+        max_num_derivatives_ = max_num_derivatives;
+        prepare_internals();
+      }
+
+      size_t get_max_num_derivatives() const
+      {
+        return max_num_derivatives_;
+      }
+
       const std::vector< ExpressionTypePtr >& get_expressions() const
       {
         return expressions_;
@@ -95,28 +121,54 @@ namespace KDL
         return popped_expression;
       } 
 
+      // NOTE: Expressions that depend on none of the inputs which changed since
+      //       the last update keep their values and derivatives, e.g. the
+      //       weights and gains of a controller while only the joints move.
       void update(const std::vector< double >& inputs)
       {
         optimizer_.setInputValues(inputs);
+        find_changed_inputs(inputs);
         copy_results();
       }
         
       void update(const Eigen::VectorXd& inputs)
       {
         optimizer_.setInputValues(inputs);
+        find_changed_inputs(inputs);
         copy_results();
       }
 
+      // Number of expressions that the last update re-evaluated.
+      size_t num_updated_expressions() const
+      {
+        return num_updated_expressions_;
+      }
+
       const Eigen::Matrix<ResultType, Eigen::Dynamic, 1>& get_values() const
       {
         return values_;
       }
 
-      const Eigen::Matrix<DerivType, Eigen::Dynamic, Eigen::Dynamic> get_derivatives() const
+      const Eigen::Matrix<DerivType, Eigen::Dynamic, Eigen::Dynamic>& get_derivatives() const
       {
         return derivatives_;
       }
 
+      // Inputs w.r.t. which the derivative of an expression is structurally non-zero,
+      // i.e. the inputs it depends on. All other derivatives stay zero.
+      const std::vector<int>& get_nonzero_derivatives(size_t expression_index) const
+      {
+        return nonzero_derivatives_[expression_index];
+      }
+
+      size_t num_nonzero_derivatives() const
+      {
+        size_t result = 0;
+        for(size_t i=0; i<nonzero_derivatives_.size(); ++i)
+          result += nonzero_derivatives_[i].size();
+        return result;
+      }
+
       std::vector<DerivExpressionTypePtr> get_derivative_expressions(size_t expression_index) const
       {
         std::vector<DerivExpressionTypePtr> result;
@@ -129,12 +181,18 @@ namespace KDL
       Eigen::Matrix<ResultType, Eigen::Dynamic, 1> values_;
       Eigen::Matrix<DerivType, Eigen::Dynamic, Eigen::Dynamic> derivatives_;
       std::vector< ExpressionTypePtr > expressions_;
+      std::vector< std::vector<int> > nonzero_derivatives_, dependencies_;
       KDL::ExpressionOptimizer optimizer_;
+      size_t max_num_derivatives_, num_updated_expressions_;
+      std::vector<double> last_inputs_;
+      std::vector<bool> changed_inputs_;
+      bool evaluate_all_;
 
       void prepare_internals()
       {
         prepare_optimizer();
         prepare_eigensizes();
+        prepare_sparsity();
       }
 
       void prepare_optimizer()
@@ -148,7 +206,7 @@ namespace KDL
       std::vector<int> calculate_inputs() const
       {
         std::vector<int> input_vars;
-        for(size_t i=0; i<num_inputs(); ++i)
+        for(size_t i=0; i<num_derivatives(); ++i)
           input_vars.push_back(i);
         return input_vars;
       }
@@ -156,18 +214,78 @@ namespace KDL
       void prepare_eigensizes()
       {
         values_.resize(num_expressions(), 1);
-        derivatives_.resize(num_expressions(), num_inputs());        
+        derivatives_.resize(num_expressions(), num_derivatives());
+        // NOTE: Structural zeros are never written by copy_results.
+        derivatives_.setZero();
+      }
+
+      void prepare_sparsity()
+      {
+        nonzero_derivatives_.resize(num_expressions());
+        dependencies_.resize(num_expressions());
+        for(size_t i=0; i<num_expressions(); ++i)
+        {
+          std::set<int> dependencies;
+          expressions_[i]->getDependencies(dependencies);
+
+          nonzero_derivatives_[i].clear();
+          dependencies_[i].clear();
+          for(std::set<int>::const_iterator it=dependencies.begin(); it!=dependencies.end(); ++it)
+          {
+            if(*it >= 0 && *it < (int) num_derivatives())
+              nonzero_derivatives_[i].push_back(*it);
+            if(*it >= 0)
+              dependencies_[i].push_back(*it);
+          }
+        }
+
+        // the next update evaluates everything
+        evaluate_all_ = true;
+      }
+
+      template<typename InputVector>
+      void find_changed_inputs(const InputVector& inputs)
+      {
+        size_t num_inputs = inputs.size();
+        if(last_inputs_.size() != num_inputs)
+        {
+          evaluate_all_ = true;
+          last_inputs_.resize(num_inputs);
+          changed_inputs_.resize(num_inputs);
+        }
+
+        for(size_t i=0; i<num_inputs; ++i)
+        {
+          // NOTE: NaNs never compare equal, so they always count as changed.
+          changed_inputs_[i] = !(inputs[i] == last_inputs_[i]);
+          last_inputs_[i] = inputs[i];
+        }
+      }
+
+      bool has_changed_dependencies(size_t expression_index) const
+      {
+        const std::vector<int>& dependencies = dependencies_[expression_index];
+        for(size_t i=0; i<dependencies.size(); ++i)
+          if(dependencies[i] >= (int) changed_inputs_.size() || changed_inputs_[dependencies[i]])
+            return true;
+        return false;
       }
 
       void copy_results()
       {
-        derivatives_.setZero();
+        num_updated_expressions_ = 0;
         for(size_t i=0; i<expressions_.size(); ++i)
         {
+          if(!evaluate_all_ && !has_changed_dependencies(i))
+            continue;
+
+          ++num_updated_expressions_;
           values_(i, 0) = expressions_[i]->value();
-          for(size_t j=0; j<expressions_[i]->number_of_derivatives(); ++j)
-            derivatives_(i,j) = expressions_[i]->derivative(j);
+          const std::vector<int>& columns = nonzero_derivatives_[i];
+          for(size_t j=0; j<columns.size(); ++j)
+            derivatives_(i, columns[j]) = expressions_[i]->derivative(columns[j]);
         }
+        evaluate_all_ = false;
       }
   };
 
@@ -32,11 +32,12 @@ namespace giskard_core
   class ExpressionExtractor
   {
     public:
-      static inline YAML::Node extract(const KDL::Chain& chain)
+      // Scope entries for the forward kinematics of the chain. The inputs are
+      // named '<joint>_var', and the whole chain is called 'expression_name'.
+      static inline YAML::Node extract(const KDL::Chain& chain, const std::string& expression_name = "fk")
       {
         std::string var_suffix = "_var";
         std::string frame_suffix = "_frame";
-        std::string expression_name = "fk";
 
         std::vector<YAML::Node> input_vars;
         std::vector<YAML::Node> joint_frames;
@@ -24,14 +24,21 @@
 #include <giskard_core/scope.hpp>
 #include <giskard_core/qp_controller.hpp>
 #include <giskard_core/specifications.hpp>
+#include <algorithm>
+#include <set>
 
 namespace giskard_core
 {
 
 
-  inline giskard_core::Scope generate(const giskard_core::ScopeSpec& scope_spec, const std::vector<std::string>& controllables)
+  inline giskard_core::Scope generate(const giskard_core::ScopeSpec& scope_spec, const std::vector<std::string>& controllables,
+      const giskard_core::SpecCachePtr& spec_cache = giskard_core::SpecCachePtr())
   {
     giskard_core::Scope scope;
+    scope.set_spec_cache(spec_cache);
+    // NOTE: Constant subtrees, e.g. offsets and unit axes of kinematic chains,
+    //       collapse into a single constant when they are generated.
+    scope.set_fold_constants(true);
 
     std::vector<const InputSpec*> temp;
     for(size_t i=0; i<scope_spec.size(); ++i) {
@@ -68,6 +75,12 @@ namespace giskard_core
         case giskard_core::tFrame:
           scope.add_frame_input(temp[i]->get_name()->get_value());
           break;
+        case giskard_core::tQuaternionFrame:
+          scope.add_quaternion_frame_input(temp[i]->get_name()->get_value());
+          break;
+        case giskard_core::tMatrixFrame:
+          scope.add_matrix_frame_input(temp[i]->get_name()->get_value());
+          break;
         default:
           throw std::domain_error("Scope generation: found input of non-supported type.");
       }
@@ -118,17 +131,245 @@ namespace giskard_core
     return generate(scope_spec, empty);
   }
 
-  inline giskard_core::QPController generate(const giskard_core::QPControllerSpec& spec)
+  // Follows double references through the scope specification and returns the
+  // name of the joint input that the given specification boils down to. Returns
+  // an empty string if the specification is not a (referenced) joint input.
+  inline std::string resolve_joint_input_name(const giskard_core::DoubleSpecPtr& spec,
+      const giskard_core::ScopeSpec& scope_spec)
+  {
+    giskard_core::JointInputSpecPtr joint_spec =
+        boost::dynamic_pointer_cast<giskard_core::JointInputSpec>(spec);
+    if (joint_spec)
+      return joint_spec->get_name()->get_value();
+
+    giskard_core::DoubleReferenceSpecPtr ref_spec =
+        boost::dynamic_pointer_cast<giskard_core::DoubleReferenceSpec>(spec);
+    if (!ref_spec)
+      return "";
+
+    // NOTE: references may only point to entries defined earlier in the scope,
+    //       so walking backwards from the end terminates and finds the right one.
+    for (size_t i=scope_spec.size(); i>0; --i)
+      if (scope_spec[i-1].name == ref_spec->get_reference_name())
+      {
+        giskard_core::DoubleSpecPtr entry =
+            boost::dynamic_pointer_cast<giskard_core::DoubleSpec>(scope_spec[i-1].spec);
+        if (!entry || entry == spec)
+          return "";
+        return resolve_joint_input_name(entry, scope_spec);
+      }
+
+    return "";
+  }
+
+  // Returns the index of the controllable whose bounds absorb the given hard
+  // constraint, or the number of controllables if it stays a row of A.
+  inline size_t find_folding_controllable(const giskard_core::HardConstraintSpec& hard_constraint,
+      const giskard_core::ScopeSpec& scope_spec, const std::vector<std::string>& controllable_names)
+  {
+    std::string joint_name = resolve_joint_input_name(hard_constraint.expression_, scope_spec);
+    if(joint_name.empty())
+      return controllable_names.size();
+
+    return std::find(controllable_names.begin(), controllable_names.end(), joint_name) -
+        controllable_names.begin();
+  }
+
+  // Names of the scope entries that 'spec' refers to directly. 'scope' has to
+  // contain all entries that 'spec' refers to.
+  inline std::set<std::string> find_references(const giskard_core::SpecPtr& spec, giskard_core::Scope& scope)
+  {
+    giskard_core::ReferenceLogPtr log(new std::set<std::string>());
+    scope.set_reference_log(log);
+
+    // aliases of other types are parsed as DoubleReferenceSpec, see generate()
+    if(boost::dynamic_pointer_cast<giskard_core::DoubleReferenceSpec>(spec).get())
+      log->insert(boost::dynamic_pointer_cast<giskard_core::DoubleReferenceSpec>(spec)->get_reference_name());
+    else if(boost::dynamic_pointer_cast<giskard_core::DoubleSpec>(spec).get())
+      boost::dynamic_pointer_cast<giskard_core::DoubleSpec>(spec)->get_expression(scope);
+    else if(boost::dynamic_pointer_cast<giskard_core::VectorSpec>(spec).get())
+      boost::dynamic_pointer_cast<giskard_core::VectorSpec>(spec)->get_expression(scope);
+    else if(boost::dynamic_pointer_cast<giskard_core::RotationSpec>(spec).get())
+      boost::dynamic_pointer_cast<giskard_core::RotationSpec>(spec)->get_expression(scope);
+    else if(boost::dynamic_pointer_cast<giskard_core::FrameSpec>(spec).get())
+      boost::dynamic_pointer_cast<giskard_core::FrameSpec>(spec)->get_expression(scope);
+
+    scope.set_reference_log(giskard_core::ReferenceLogPtr());
+    return *log;
+  }
+
+  // Marks the entries named in 'open', and all entries they refer to, as used.
+  inline void mark_used_scope_entries(const giskard_core::ScopeSpec& scope_spec, giskard_core::Scope& scope,
+      std::vector<std::string>& open, std::vector<bool>& used)
+  {
+    while(!open.empty())
+    {
+      std::string name = open.back();
+      open.pop_back();
+
+      size_t index = 0;
+      while(index < scope_spec.size() && scope_spec[index].name != name)
+        ++index;
+      if(index == scope_spec.size() || used[index])
+        continue;
+
+      used[index] = true;
+      std::set<std::string> references = find_references(scope_spec[index].spec, scope);
+      open.insert(open.end(), references.begin(), references.end());
+    }
+  }
+
+  inline std::vector<std::string> get_input_names(const giskard_core::ScopeSpec& scope_spec)
   {
-    std::vector<std::string> controllable_name;
+    std::vector<const InputSpec*> inputs;
+    for(size_t i=0; i<scope_spec.size(); ++i)
+      scope_spec[i].spec->get_input_specs(inputs);
+
+    std::vector<std::string> result;
+    for(size_t i=0; i<inputs.size(); ++i)
+      if(std::find(result.begin(), result.end(), inputs[i]->get_name()->get_value()) == result.end())
+        result.push_back(inputs[i]->get_name()->get_value());
+    return result;
+  }
+
+  // Returns the entries of the scope of 'spec' that its constraints or its
+  // monitored outputs need, directly or through other entries, in their
+  // original order. If no needed entry declares the input of a controllable,
+  // the entry that declares it is kept as well.
+  inline giskard_core::ScopeSpec prune_scope(const giskard_core::QPControllerSpec& spec)
+  {
+    giskard_core::Scope scope = generate(spec.scope_);
+
+    std::vector<giskard_core::DoubleSpecPtr> roots;
+    for(size_t i=0; i<spec.controllable_constraints_.size(); ++i)
+    {
+      roots.push_back(spec.controllable_constraints_[i].lower_);
+      roots.push_back(spec.controllable_constraints_[i].upper_);
+      roots.push_back(spec.controllable_constraints_[i].weight_);
+    }
+    for(size_t i=0; i<spec.soft_constraints_.size(); ++i)
+    {
+      roots.push_back(spec.soft_constraints_[i].lower_);
+      roots.push_back(spec.soft_constraints_[i].upper_);
+      roots.push_back(spec.soft_constraints_[i].weight_);
+      roots.push_back(spec.soft_constraints_[i].expression_);
+    }
+    for(size_t i=0; i<spec.hard_constraints_.size(); ++i)
+    {
+      roots.push_back(spec.hard_constraints_[i].lower_);
+      roots.push_back(spec.hard_constraints_[i].upper_);
+      roots.push_back(spec.hard_constraints_[i].expression_);
+    }
+
+    std::vector<std::string> open;
+    for(size_t i=0; i<roots.size(); ++i)
+    {
+      std::set<std::string> references = find_references(roots[i], scope);
+      open.insert(open.end(), references.begin(), references.end());
+    }
+    for(size_t i=0; i<spec.monitored_outputs_.size(); ++i)
+    {
+      if(!scope.has_double_expression(spec.monitored_outputs_[i]) &&
+         !scope.has_vector_expression(spec.monitored_outputs_[i]) &&
+         !scope.has_rotation_expression(spec.monitored_outputs_[i]) &&
+         !scope.has_frame_expression(spec.monitored_outputs_[i]))
+        throw std::domain_error("Scope pruning: Could not find monitored output '" +
+            spec.monitored_outputs_[i] + "' in scope.");
+      open.push_back(spec.monitored_outputs_[i]);
+    }
+
+    std::vector<bool> used(spec.scope_.size(), false);
+    mark_used_scope_entries(spec.scope_, scope, open, used);
+
+    giskard_core::ScopeSpec used_entries;
+    for(size_t i=0; i<spec.scope_.size(); ++i)
+      if(used[i])
+        used_entries.push_back(spec.scope_[i]);
+    std::vector<std::string> used_inputs = get_input_names(used_entries);
+
+    for(size_t i=0; i<spec.controllable_constraints_.size(); ++i)
+    {
+      std::string name = spec.controllable_constraints_[i].input_->get_value();
+      if(std::find(used_inputs.begin(), used_inputs.end(), name) != used_inputs.end())
+        continue;
+
+      // prefer plain declarations, e.g. 'q: {input-joint: q}'
+      size_t index = spec.scope_.size();
+      for(size_t j=0; j<spec.scope_.size(); ++j)
+      {
+        std::vector<const InputSpec*> inputs;
+        spec.scope_[j].spec->get_input_specs(inputs);
+        bool declares_input = false;
+        for(size_t k=0; k<inputs.size(); ++k)
+          if(inputs[k]->get_name()->get_value() == name && inputs[k]->get_type() == giskard_core::tJoint)
+            declares_input = true;
+        if(!declares_input)
+          continue;
+
+        if(index == spec.scope_.size())
+          index = j;
+        if(dynamic_cast<const InputSpec*>(spec.scope_[j].spec.get()))
+        {
+          index = j;
+          break;
+        }
+      }
+
+      if(index < spec.scope_.size())
+      {
+        open.push_back(spec.scope_[index].name);
+        mark_used_scope_entries(spec.scope_, scope, open, used);
+      }
+    }
+
+    giskard_core::ScopeSpec result;
+    for(size_t i=0; i<spec.scope_.size(); ++i)
+      if(used[i])
+        result.push_back(spec.scope_[i]);
+    return result;
+  }
+
+  // Names of the inputs declared in the scope of 'spec' that prune_scope drops,
+  // i.e. inputs that neither the QP nor a monitored output reads.
+  inline std::vector<std::string> find_unused_inputs(const giskard_core::QPControllerSpec& spec)
+  {
+    std::vector<std::string> all_inputs = get_input_names(spec.scope_);
+    std::vector<std::string> used_inputs = get_input_names(prune_scope(spec));
+
+    std::vector<std::string> result;
+    for(size_t i=0; i<all_inputs.size(); ++i)
+      if(std::find(used_inputs.begin(), used_inputs.end(), all_inputs[i]) == used_inputs.end())
+        result.push_back(all_inputs[i]);
+    return result;
+  }
+
+  // All expressions of a controller, before they are handed to the QP.
+  struct QPControllerExpressions
+  {
+    giskard_core::Scope scope_;
+    std::vector<std::string> controllable_names_, soft_names_;
+    std::vector< KDL::Expression<double>::Ptr > controllable_lower_, controllable_upper_,
+        controllable_weights_, soft_expressions_, soft_lower_, soft_upper_, soft_weights_,
+        hard_expressions_, hard_lower_, hard_upper_;
+    size_t num_folded_hard_constraints_;
+  };
+
+  inline QPControllerExpressions generate_expressions(const giskard_core::QPControllerSpec& spec,
+      const giskard_core::SpecCachePtr& spec_cache = giskard_core::SpecCachePtr())
+  {
+    QPControllerExpressions result;
+    std::vector<std::string>& controllable_name = result.controllable_names_;
     for(size_t i=0; i<spec.controllable_constraints_.size(); ++i) {
       controllable_name.push_back(spec.controllable_constraints_[i].input_->get_value());
     }
 
-    giskard_core::Scope scope = generate(spec.scope_, controllable_name);
+    giskard_core::Scope& scope = result.scope_;
+    scope = generate(spec.scope_, controllable_name, spec_cache);
 
     // generate controllable constraints
-    std::vector< KDL::Expression<double>::Ptr > controllable_lower, controllable_upper, controllable_weight;
+    std::vector< KDL::Expression<double>::Ptr >& controllable_lower = result.controllable_lower_;
+    std::vector< KDL::Expression<double>::Ptr >& controllable_upper = result.controllable_upper_;
+    std::vector< KDL::Expression<double>::Ptr >& controllable_weight = result.controllable_weights_;
     for(size_t i=0; i<spec.controllable_constraints_.size(); ++i)
     {
       controllable_lower.push_back(spec.controllable_constraints_[i].lower_->get_expression(scope));
@@ -137,38 +378,96 @@ namespace giskard_core
     }
 
     // generate soft constraints
-    std::vector< KDL::Expression<double>::Ptr > soft_lower, soft_upper,
-        soft_weight, soft_exp;
-    std::vector< std::string> soft_name;
     for(size_t i=0; i<spec.soft_constraints_.size(); ++i)
     {
-      soft_lower.push_back(spec.soft_constraints_[i].lower_->get_expression(scope));
-      soft_upper.push_back(spec.soft_constraints_[i].upper_->get_expression(scope));
-      soft_weight.push_back(spec.soft_constraints_[i].weight_->get_expression(scope));
-      soft_exp.push_back(spec.soft_constraints_[i].expression_->get_expression(scope));
-      soft_name.push_back(spec.soft_constraints_[i].name_->get_value());
+      result.soft_lower_.push_back(spec.soft_constraints_[i].lower_->get_expression(scope));
+      result.soft_upper_.push_back(spec.soft_constraints_[i].upper_->get_expression(scope));
+      result.soft_weights_.push_back(spec.soft_constraints_[i].weight_->get_expression(scope));
+      result.soft_expressions_.push_back(spec.soft_constraints_[i].expression_->get_expression(scope));
+      result.soft_names_.push_back(spec.soft_constraints_[i].name_->get_value());
     }
 
     // generate hard constraints
-    std::vector< KDL::Expression<double>::Ptr > hard_lower, hard_upper, hard_exp;
+    // NOTE: Hard constraints on a single controllable joint, e.g. joint limits
+    //       of the form [lower - q, upper - q, q], are plain box constraints
+    //       on one variable. We fold them into the bounds of the corresponding
+    //       controllable instead of spending a dense row of A on each of them.
+    result.num_folded_hard_constraints_ = 0;
     for(size_t i=0; i<spec.hard_constraints_.size(); ++i)
     {
-      hard_lower.push_back(spec.hard_constraints_[i].lower_->get_expression(scope));
-      hard_upper.push_back(spec.hard_constraints_[i].upper_->get_expression(scope));
-      hard_exp.push_back(spec.hard_constraints_[i].expression_->get_expression(scope));
+      size_t index = find_folding_controllable(spec.hard_constraints_[i], spec.scope_, controllable_name);
+      if (index < controllable_name.size())
+      {
+        controllable_lower[index] = KDL::maximum(controllable_lower[index],
+            spec.hard_constraints_[i].lower_->get_expression(scope));
+        controllable_upper[index] = KDL::minimum(controllable_upper[index],
+            spec.hard_constraints_[i].upper_->get_expression(scope));
+        ++result.num_folded_hard_constraints_;
+        continue;
+      }
+
+      result.hard_lower_.push_back(spec.hard_constraints_[i].lower_->get_expression(scope));
+      result.hard_upper_.push_back(spec.hard_constraints_[i].upper_->get_expression(scope));
+      result.hard_expressions_.push_back(spec.hard_constraints_[i].expression_->get_expression(scope));
+    }
+
+    return result;
+  }
+
+  // defined in tape_generation.hpp, which is included at the end of this file
+  inline QPTape generate_tape(const giskard_core::QPControllerSpec& spec);
+
+  inline giskard_core::QPController generate(const giskard_core::QPControllerSpec& spec,
+      const giskard_core::QPProblemOptions& options = giskard_core::QPProblemOptions())
+  {
+    if(options.prune_scope_)
+    {
+      giskard_core::QPControllerSpec pruned_spec = spec;
+      pruned_spec.scope_ = prune_scope(spec);
+      giskard_core::QPProblemOptions pruned_options = options;
+      pruned_options.prune_scope_ = false;
+      return generate(pruned_spec, pruned_options);
+    }
+
+    // NOTE: Specifications that occur more than once, e.g. the same inline
+    //       expression in several constraints, only need to be evaluated once
+    //       per cycle. A first pass counts them, the second one caches them.
+    giskard_core::SpecCachePtr spec_cache;
+    if(options.common_subexpression_elimination_)
+    {
+      spec_cache = giskard_core::SpecCachePtr(new giskard_core::SpecCache());
+      generate_expressions(spec, spec_cache);
+      spec_cache->start_sharing();
     }
 
+    QPControllerExpressions e = generate_expressions(spec, spec_cache);
+    e.scope_.set_spec_cache(giskard_core::SpecCachePtr());
+
+    // NOTE: Cached expressions only get their values from the optimizer of the
+    //       QPProblemBuilder. Scope entries that are evaluated on their own,
+    //       e.g. for monitoring, would read stale values through them. Hence,
+    //       the scope of the controller is generated once more without cache.
+    if(spec_cache)
+      e.scope_ = generate(spec.scope_, e.controllable_names_);
+
     giskard_core::QPController controller;
    
-    if(!(controller.init(controllable_lower, controllable_upper, controllable_weight,
-                           controllable_name, soft_exp, soft_lower, soft_upper, 
-                           soft_weight, soft_name, hard_exp, hard_lower, hard_upper)))
+    if(!(controller.init(e.controllable_lower_, e.controllable_upper_, e.controllable_weights_,
+                           e.controllable_names_, e.soft_expressions_, e.soft_lower_, e.soft_upper_,
+                           e.soft_weights_, e.soft_names_, e.hard_expressions_, e.hard_lower_, e.hard_upper_, options)))
       throw std::runtime_error("QPController generation: Init of controller failed.");
 
-    controller.set_scope(scope);
+    controller.set_scope(e.scope_);
+    controller.set_num_folded_hard_constraints(e.num_folded_hard_constraints_);
+    if(options.tape_)
+      controller.set_tape(generate_tape(spec));
 
     return controller;
   }
 }
 
+// NOTE: The tape generation builds on the functions above, and the generation
+//       of controllers needs the tape generation. Hence, it comes last.
+#include <giskard_core/tape_generation.hpp>
+
 #endif // GISKARD_CORE_EXPRESSION_GENERATION_HPP
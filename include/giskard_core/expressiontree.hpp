@@ -23,6 +23,7 @@
 
 #include <kdl/expressiontree.hpp>
 #include <giskard_core/expression_arrays.hpp>
+#include <giskard_core/rotation_constructors.hpp>
 #include <giskard_core/slerp.hpp>
 
 #endif // GISKARD_CORE_EXPRESSIONTREE_HPP
@@ -21,13 +21,24 @@
 #ifndef GISKARD_CORE_GISKARD_CORE_HPP
 #define GISKARD_CORE_GISKARD_CORE_HPP
 
+#include <giskard_core/active_set_qp_solver.hpp>
+#include <giskard_core/batch_expression_array.hpp>
+#include <giskard_core/code_generation.hpp>
+#include <giskard_core/controller_synthesis.hpp>
+#include <giskard_core/diagonal_qp_solver.hpp>
 #include <giskard_core/expression_generation.hpp>
 #include <giskard_core/expression_extraction.hpp>
 #include <giskard_core/expressiontree.hpp>
 #include <giskard_core/qp_controller.hpp>
 #include <giskard_core/qp_problem_builder.hpp>
+#include <giskard_core/qp_solver.hpp>
 #include <giskard_core/scope.hpp>
 #include <giskard_core/specifications.hpp>
+#include <giskard_core/tape.hpp>
+#include <giskard_core/tape_generation.hpp>
+#include <giskard_core/tape_interpreter.hpp>
+#include <giskard_core/update_statistics.hpp>
+#include <giskard_core/working_set.hpp>
 #include <giskard_core/yaml_parser.hpp>
 
 #endif // GISKARD_CORE_GISKARD_CORE_HPP
@@ -22,17 +22,64 @@
 #define GISKARD_CORE_QP_CONTROLLER_HPP
 
 #include <giskard_core/qp_problem_builder.hpp>
+#include <giskard_core/qp_solver.hpp>
 #include <giskard_core/scope.hpp>
+#include <giskard_core/update_statistics.hpp>
+#include <giskard_core/working_set.hpp>
 #include <boost/lexical_cast.hpp>
-#include <qpOASES.hpp>
 
 namespace giskard_core
 {
+  // What QPController::update does when the hotstart fails. The stages run in
+  // this order until one of them succeeds: a hotstart with a larger budget of
+  // working set recalculations, an init from the working set of the last
+  // solution, and a cold init.
+  struct QPRecoveryOptions
+  {
+    QPRecoveryOptions() : enabled_( false ), nWSR_( 1000 ), cputime_( 0.0 ) {}
+
+    bool enabled_;
+    // budget of working set recalculations for each stage
+    int nWSR_;
+    // budget of CPU time in seconds for each stage, 0 for no limit
+    double cputime_;
+  };
+
+  enum QPRecoveryStage
+  {
+    rsNone = 0,
+    rsRetry = 1,
+    rsWorkingSet = 2,
+    rsColdStart = 3
+  };
+
+  // Outcome of the last QPController::update.
+  enum QPUpdateStatus
+  {
+    // the solver succeeded, and the command is its solution
+    usSolved = 0,
+    // the solver failed, e.g. on an infeasible QP or without a deadline, and
+    // the command did not change
+    usFailed = 1,
+    // the solver ran out of time or iterations with a deadline, and the
+    // command is the last solution clipped to the current bounds of the
+    // controllables
+    usLastSolution = 2,
+    // the solver ran out of time or iterations with a deadline before the
+    // first solution, and the command is zero
+    usZero = 3
+  };
+
   class QPController
   {
     public:
       typedef typename std::vector< KDL::Expression<double>::Ptr > DoubleExpressionVector;
       typedef typename std::vector< std::string> StringVector;
+
+      QPController() :
+        solver_( new QPOasesSolver() ), num_folded_hard_constraints_( 0 ),
+        has_last_working_set_( false ), deadline_( 0.0 ), has_solution_( false ),
+        status_( usFailed ) {}
       
       bool init(const DoubleExpressionVector& controllable_lower_bounds,
           const DoubleExpressionVector& controllable_upper_bounds, const DoubleExpressionVector& controllable_weights,
@@ -40,28 +87,16 @@ namespace giskard_core
           const DoubleExpressionVector& soft_lower_bounds, const DoubleExpressionVector& soft_upper_bounds,
           const DoubleExpressionVector& soft_weights, const StringVector& soft_names,
           const DoubleExpressionVector& hard_expressions, const DoubleExpressionVector& hard_lower_bounds,
-          const DoubleExpressionVector& hard_upper_bounds)
+          const DoubleExpressionVector& hard_upper_bounds,
+          const QPProblemOptions& problem_options = QPProblemOptions())
       {
         qp_builder_.init(controllable_lower_bounds, controllable_upper_bounds,
             controllable_weights, soft_expressions, soft_lower_bounds,
             soft_upper_bounds, soft_weights, hard_expressions,
-            hard_lower_bounds, hard_upper_bounds);
-
-        qp_problem_ = qpOASES::SQProblem(qp_builder_.num_weights(), qp_builder_.num_constraints());
-        qpOASES::Options options;
-        // NOTE: In the past, I was using setting "reliable", and found a curious
-        //       bug: One trying to solve an already solved problem, the solver
-        //       would never finish and run out of working set iterations. The
-        //       corresponding test-case is broken flying cup. Switching to
-        //       "default" solved this on qpOASES 3.1.
-        // NOTE: Even earlier, I was using setting "MPC" that left to weird behavior
-        //       for orientation control. It seemed as if the solver returned 
-        //       inaccurate solutions. We (Alexis and Georg) decided to swith
-        //       away from "MPC" to improve this behavior. That was also for
-        //       qpOASES 3.1. However, now I cannot reproduce that problem.
-        options.setToDefault();
-        options.printLevel = qpOASES::PL_NONE;
-        qp_problem_.setOptions(options);
+            hard_lower_bounds, hard_upper_bounds, problem_options);
+        num_folded_hard_constraints_ = 0;
+
+        solver_->init(qp_builder_);
 
         xdot_full_.resize(qp_builder_.num_weights());
 
@@ -69,6 +104,12 @@ namespace giskard_core
 
         xdot_slack_.resize(qp_builder_.num_soft_constraints());
 
+        last_working_set_.bounds_.resize(qp_builder_.num_weights());
+        last_working_set_.constraints_.resize(qp_builder_.num_constraints());
+        has_last_working_set_ = false;
+        has_solution_ = false;
+        status_ = usFailed;
+
         if( controllable_names.size() != qp_builder_.num_controllables() )
           throw std::runtime_error("Received " + boost::lexical_cast<std::string>(controllable_names_.size()) + 
               " controllable names, but " + boost::lexical_cast<std::string>(qp_builder_.num_controllables()) + 
@@ -86,41 +127,139 @@ namespace giskard_core
 
       bool start(const Eigen::VectorXd& observables, int nWSR)
       {
-        qp_builder_.update(observables);
+        return init_solver(observables, nWSR, 0);
+      }
 
-        qpOASES::returnValue return_value = qp_problem_.init(qp_builder_.get_H().data(), qp_builder_.get_g().data(), 
-            qp_builder_.get_A().data(), qp_builder_.get_lb().data(), qp_builder_.get_ub().data(),
-            qp_builder_.get_lbA().data(), qp_builder_.get_ubA().data(), nWSR);
+      // Starts hot from a working set exported with get_working_set, e.g. from
+      // an earlier run of this or another controller with the same structure.
+      bool start(const Eigen::VectorXd& observables, int nWSR, const QPWorkingSet& working_set)
+      {
+        if(working_set.bounds_.size() != qp_builder_.num_weights() ||
+            working_set.constraints_.size() != qp_builder_.num_constraints())
+          throw std::invalid_argument("Received a working set with " +
+              std::to_string(working_set.bounds_.size()) + " bounds and " +
+              std::to_string(working_set.constraints_.size()) + " constraints, but the QP has " +
+              std::to_string(qp_builder_.num_weights()) + " bounds and " +
+              std::to_string(qp_builder_.num_constraints()) + " constraints.");
 
-        if(return_value != qpOASES::SUCCESSFUL_RETURN)
-        {
-          std::cout << "Init of QP-Problem returned without success! ERROR MESSAGE: " << 
-            qpOASES::MessageHandling::getErrorCodeMessage(return_value) << std::endl;
-          std::cout << "Printing internals." << std::endl;
-          qp_builder_.print_internals();
-          std::cout << "nWSR: " << nWSR << std::endl;
-          qp_builder_.are_internals_valid();
-        }
-        
-        return return_value == qpOASES::SUCCESSFUL_RETURN;
+        return init_solver(observables, nWSR, &working_set);
       }
-      
- 
+
+      // Starts again, e.g. after the goals changed, from the working set of
+      // the last solution. Without one, this is the same as a cold start.
+      bool restart(const Eigen::VectorXd& observables, int nWSR)
+      {
+        if(!solver_->is_solved())
+          return start(observables, nWSR);
+
+        return start(observables, nWSR, get_working_set());
+      }
+
+      // Active set of the last solution. Empty before the first start.
+      QPWorkingSet get_working_set() const
+      {
+        QPWorkingSet result;
+        if(!solver_->is_initialised())
+          return result;
+
+        result.bounds_.resize(qp_builder_.num_weights());
+        result.constraints_.resize(qp_builder_.num_constraints());
+        solver_->get_working_set(result);
+        return result;
+      }
+
+      // NOTE: Giskard itself does not allocate in here after start, but
+      //       qpOASES allocates temporaries in every hotstart, and none of
+      //       its interfaces takes preallocated workspaces. With the
+      //       default solver, this is not free of allocations. With the
+      //       ActiveSetQPSolver, see set_solver, it is.
       bool update(const Eigen::VectorXd& observables, int nWSR)
       {
-       qp_builder_.update(observables);
+        if(has_statistics())
+          return update_with_statistics(observables, nWSR);
 
-       if( qp_problem_.hotstart(qp_builder_.get_H().data(), qp_builder_.get_g().data(), 
-           qp_builder_.get_A().data(), qp_builder_.get_lb().data(), qp_builder_.get_ub().data(),
-           qp_builder_.get_lbA().data(), qp_builder_.get_ubA().data(), nWSR)
-           != qpOASES::SUCCESSFUL_RETURN )
-          return false;
+        UpdateStatistics::Clock::time_point start;
+        if(deadline_ > 0.0)
+          start = UpdateStatistics::Clock::now();
 
-        qp_problem_.getPrimalSolution(xdot_full_.data());
-        xdot_control_ = xdot_full_.segment(0, qp_builder_.num_controllables());
-        xdot_slack_ = xdot_full_.segment(qp_builder_.num_controllables(), qp_builder_.num_soft_constraints());
+        qp_builder_.update(observables);
 
-        return true;
+        int recovery_stage;
+        return solve(nWSR, recovery_stage, start) == qpOASES::SUCCESSFUL_RETURN;
+      }
+
+      // Bounds every following update to 'microseconds' of wall-clock time,
+      // or removes the bound for 0. The expressions are evaluated in any case,
+      // the solver and the recovery only get what is left of the budget after
+      // that. If they run out of time or iterations, update returns false and
+      // commands a fallback, see QPUpdateStatus. Other failures, e.g. of
+      // infeasible QPs, do not fall back.
+      // NOTE: The fallback only respects the bounds of the controllables, not
+      //       the hard constraints.
+      void set_deadline(double microseconds)
+      {
+        deadline_ = microseconds;
+      }
+
+      double get_deadline() const
+      {
+        return deadline_;
+      }
+
+      QPUpdateStatus get_update_status() const
+      {
+        return status_;
+      }
+
+      void set_recovery_options(const QPRecoveryOptions& options)
+      {
+        recovery_options_ = options;
+      }
+
+      const QPRecoveryOptions& get_recovery_options() const
+      {
+        return recovery_options_;
+      }
+
+      // Solves the QPs with a copy of 'solver' from now on, e.g. with a
+      // DiagonalQPSolver. Call this after init and before start.
+      void set_solver(const QPSolver& solver)
+      {
+        solver_.reset(solver.clone());
+        if(qp_builder_.num_weights() > 0)
+          solver_->init(qp_builder_);
+        has_last_working_set_ = false;
+        has_solution_ = false;
+      }
+
+      const QPSolver& get_solver() const
+      {
+        return *solver_;
+      }
+
+      // Records the timings and the solver outcome of every following update,
+      // keeping the last 'capacity' ones. Call this before the control loop
+      // starts, because it allocates the records.
+      void enable_statistics(size_t capacity)
+      {
+        if(capacity == 0)
+          throw std::invalid_argument("QPController: Statistics need a capacity of at least one record.");
+        statistics_ = UpdateStatistics(capacity);
+      }
+
+      void disable_statistics()
+      {
+        statistics_ = UpdateStatistics();
+      }
+
+      bool has_statistics() const
+      {
+        return statistics_.capacity() > 0;
+      }
+
+      const UpdateStatistics& get_statistics() const
+      {
+        return statistics_;
       }
 
       const Eigen::VectorXd& get_command() const
@@ -158,6 +297,42 @@ namespace giskard_core
         scope_ = scope;
       }
 
+      // Number of hard constraints that generation folded into the bounds
+      // of controllables instead of adding them as rows of A.
+      size_t num_folded_hard_constraints() const
+      {
+        return num_folded_hard_constraints_;
+      }
+
+      void set_num_folded_hard_constraints(size_t num_folded_hard_constraints)
+      {
+        num_folded_hard_constraints_ = num_folded_hard_constraints;
+      }
+
+      // Lets the QP be filled by code emitted by giskard_codegen for the same
+      // controller specification. Call this after init and set_scope. Throws
+      // if the code reads another number of observables than the scope has,
+      // e.g. if it was generated from a differently pruned specification.
+      void set_evaluator(const QPEvaluator& evaluator)
+      {
+        if(evaluator.dimensions_)
+        {
+          unsigned int num_observables, num_weights, num_constraints;
+          evaluator.dimensions_(&num_observables, &num_weights, &num_constraints);
+          check_num_observables(num_observables);
+        }
+        qp_builder_.set_evaluator(evaluator);
+      }
+
+      // Lets the QP be filled by interpreting a tape generated for the same
+      // controller specification. Call this after init and set_scope. Same
+      // restrictions as set_evaluator.
+      void set_tape(const QPTape& qp)
+      {
+        check_num_observables(qp.num_observables_);
+        qp_builder_.set_tape(qp);
+      }
+
       size_t num_controllables() const
       {
         return get_controllable_names().size();
@@ -260,6 +435,8 @@ namespace giskard_core
 
       // Set frame input using a KDL::Frame
       void set_input(Eigen::VectorXd& inputVector, const std::string& name, KDL::Frame value) const {  
+        if (set_encoded_frame_input(inputVector, name, value))
+          return;
         KDL::Vector translation = value.p;
         KDL::Rotation rotation  = value.M;
         KDL::Vector axis;
@@ -269,6 +446,8 @@ namespace giskard_core
 
       // Set frame input using a KDL::Rotation and KDL::Vector
       void set_input(Eigen::VectorXd& inputVector, const std::string& name, KDL::Rotation rotation, KDL::Vector translation) const {
+        if (set_encoded_frame_input(inputVector, name, KDL::Frame(rotation, translation)))
+          return;
         KDL::Vector axis;
         double angle = rotation.GetRotAngle(axis, KDL::epsilon);
         set_input(inputVector, name, axis[0], axis[1], axis[2], angle, translation[0], translation[1], translation[2]);
@@ -276,6 +455,8 @@ namespace giskard_core
 
       // Set frame input using an Eigen::Affine3d
       void set_input(Eigen::VectorXd& inputVector, const std::string& name, Eigen::Affine3d value) const {  
+        if (set_encoded_frame_input(inputVector, name, value))
+          return;
         Eigen::AngleAxisd aa(value.rotation());
         Eigen::Vector3d axis = aa.axis();
         Eigen::Vector3d translation = value.translation();
@@ -284,6 +465,8 @@ namespace giskard_core
 
       // Set frame input using an Eigen::Quaterniond and Eigen::Vector3d
       void set_input(Eigen::VectorXd& inputVector, const std::string& name, Eigen::Quaterniond rotation, Eigen::Vector3d translation) const {
+        if (set_encoded_frame_input(inputVector, name, rotation, translation))
+          return;
         Eigen::AngleAxisd aa(rotation);
         Eigen::Vector3d axis = aa.axis();
         set_input(inputVector, name, axis[0], axis[1], axis[2], aa.angle(), translation[0], translation[1], translation[2]);
@@ -313,6 +496,161 @@ namespace giskard_core
                 std::to_string(ptr->idx_ + 7) + " Actual size: " + std::to_string(inputVector.size()));
       }
 
+      // Handles resolve the position and type of an input once. Setting an input
+      // through a handle writes straight into the input vector. Only debug builds
+      // check the bounds, via Eigen's assertions.
+      JointInputHandle get_joint_input_handle(const std::string& name) const {
+        return scope_.get_input_handle<giskard_core::Scope::JointInput>(name);
+      }
+
+      ScalarInputHandle get_scalar_input_handle(const std::string& name) const {
+        return scope_.get_input_handle<giskard_core::Scope::ScalarInput>(name);
+      }
+
+      Vec3InputHandle get_vector_input_handle(const std::string& name) const {
+        return scope_.get_input_handle<giskard_core::Scope::Vec3Input>(name);
+      }
+
+      RotationInputHandle get_rotation_input_handle(const std::string& name) const {
+        return scope_.get_input_handle<giskard_core::Scope::RotationInput>(name);
+      }
+
+      FrameInputHandle get_frame_input_handle(const std::string& name) const {
+        return scope_.get_input_handle<giskard_core::Scope::FrameInput>(name);
+      }
+
+      QuaternionFrameInputHandle get_quaternion_frame_input_handle(const std::string& name) const {
+        return scope_.get_input_handle<giskard_core::Scope::QuaternionFrameInput>(name);
+      }
+
+      MatrixFrameInputHandle get_matrix_frame_input_handle(const std::string& name) const {
+        return scope_.get_input_handle<giskard_core::Scope::MatrixFrameInput>(name);
+      }
+
+      // Set joint input through a handle
+      void set_input(Eigen::VectorXd& inputVector, const JointInputHandle& handle, double value) const {
+        inputVector[handle.idx_] = value;
+      }
+
+      // Set scalar input through a handle
+      void set_input(Eigen::VectorXd& inputVector, const ScalarInputHandle& handle, double value) const {
+        inputVector[handle.idx_] = value;
+      }
+
+      // Set vector input through a handle
+      void set_input(Eigen::VectorXd& inputVector, const Vec3InputHandle& handle, double x, double y, double z) const {
+        inputVector[handle.idx_] = x;
+        inputVector[handle.idx_ + 1] = y;
+        inputVector[handle.idx_ + 2] = z;
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const Vec3InputHandle& handle, const Eigen::Vector3d& value) const {
+        set_input(inputVector, handle, value[0], value[1], value[2]);
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const Vec3InputHandle& handle, const KDL::Vector& value) const {
+        set_input(inputVector, handle, value[0], value[1], value[2]);
+      }
+
+      // Set rotation input through a handle, using axis and angle
+      void set_input(Eigen::VectorXd& inputVector, const RotationInputHandle& handle, double x, double y, double z, double angle) const {
+        inputVector[handle.idx_] = x;
+        inputVector[handle.idx_ + 1] = y;
+        inputVector[handle.idx_ + 2] = z;
+        inputVector[handle.idx_ + 3] = angle;
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const RotationInputHandle& handle, const KDL::Rotation& value) const {
+        KDL::Vector axis;
+        double angle = value.GetRotAngle(axis, KDL::epsilon);
+        set_input(inputVector, handle, axis[0], axis[1], axis[2], angle);
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const RotationInputHandle& handle, const Eigen::Quaterniond& value) const {
+        Eigen::AngleAxisd aa(value);
+        set_input(inputVector, handle, aa.axis()[0], aa.axis()[1], aa.axis()[2], aa.angle());
+      }
+
+      // Set frame input through a handle, using axis, angle and translation
+      void set_input(Eigen::VectorXd& inputVector, const FrameInputHandle& handle, double rx, double ry, double rz, double angle, double x, double y, double z) const {
+        inputVector[handle.idx_] = rx;
+        inputVector[handle.idx_ + 1] = ry;
+        inputVector[handle.idx_ + 2] = rz;
+        inputVector[handle.idx_ + 3] = angle;
+        inputVector[handle.idx_ + 4] = x;
+        inputVector[handle.idx_ + 5] = y;
+        inputVector[handle.idx_ + 6] = z;
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const FrameInputHandle& handle, const KDL::Frame& value) const {
+        KDL::Vector axis;
+        double angle = value.M.GetRotAngle(axis, KDL::epsilon);
+        set_input(inputVector, handle, axis[0], axis[1], axis[2], angle, value.p[0], value.p[1], value.p[2]);
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const FrameInputHandle& handle, const Eigen::Affine3d& value) const {
+        Eigen::AngleAxisd aa(value.rotation());
+        set_input(inputVector, handle, aa.axis()[0], aa.axis()[1], aa.axis()[2], aa.angle(),
+            value.translation()[0], value.translation()[1], value.translation()[2]);
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const FrameInputHandle& handle, const Eigen::Quaterniond& rotation, const Eigen::Vector3d& translation) const {
+        Eigen::AngleAxisd aa(rotation);
+        set_input(inputVector, handle, aa.axis()[0], aa.axis()[1], aa.axis()[2], aa.angle(),
+            translation[0], translation[1], translation[2]);
+      }
+
+      // Set quaternion frame input through a handle, using quaternion and translation.
+      // None of the quaternion frame and matrix frame setters need any trigonometry.
+      void set_input(Eigen::VectorXd& inputVector, const QuaternionFrameInputHandle& handle, double qx, double qy, double qz, double qw, double x, double y, double z) const {
+        inputVector[handle.idx_] = qx;
+        inputVector[handle.idx_ + 1] = qy;
+        inputVector[handle.idx_ + 2] = qz;
+        inputVector[handle.idx_ + 3] = qw;
+        inputVector[handle.idx_ + 4] = x;
+        inputVector[handle.idx_ + 5] = y;
+        inputVector[handle.idx_ + 6] = z;
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const QuaternionFrameInputHandle& handle, const KDL::Frame& value) const {
+        double qx, qy, qz, qw;
+        value.M.GetQuaternion(qx, qy, qz, qw);
+        set_input(inputVector, handle, qx, qy, qz, qw, value.p[0], value.p[1], value.p[2]);
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const QuaternionFrameInputHandle& handle, const Eigen::Affine3d& value) const {
+        set_input(inputVector, handle, Eigen::Quaterniond(value.linear()), value.translation());
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const QuaternionFrameInputHandle& handle, const Eigen::Quaterniond& rotation, const Eigen::Vector3d& translation) const {
+        set_input(inputVector, handle, rotation.x(), rotation.y(), rotation.z(), rotation.w(),
+            translation[0], translation[1], translation[2]);
+      }
+
+      // Set matrix frame input through a handle, using rotation matrix and translation
+      void set_input(Eigen::VectorXd& inputVector, const MatrixFrameInputHandle& handle, const Eigen::Matrix3d& rotation, const Eigen::Vector3d& translation) const {
+        for (size_t i = 0; i < 3; ++i)
+          for (size_t j = 0; j < 3; ++j)
+            inputVector[handle.idx_ + 3*i + j] = rotation(i, j);
+        inputVector.segment<3>(handle.idx_ + 9) = translation;
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const MatrixFrameInputHandle& handle, const KDL::Frame& value) const {
+        for (size_t i = 0; i < 9; ++i)
+          inputVector[handle.idx_ + i] = value.M.data[i];
+        inputVector[handle.idx_ + 9] = value.p[0];
+        inputVector[handle.idx_ + 10] = value.p[1];
+        inputVector[handle.idx_ + 11] = value.p[2];
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const MatrixFrameInputHandle& handle, const Eigen::Affine3d& value) const {
+        set_input(inputVector, handle, value.linear(), value.translation());
+      }
+
+      void set_input(Eigen::VectorXd& inputVector, const MatrixFrameInputHandle& handle, const Eigen::Quaterniond& rotation, const Eigen::Vector3d& translation) const {
+        set_input(inputVector, handle, rotation.toRotationMatrix(), translation);
+      }
+
       // Shorthand for getting input size of scope
       size_t get_input_size() const {
         return scope_.get_input_size();
@@ -367,11 +705,231 @@ namespace giskard_core
       }
 
     private:
+      // Inits the solver on the QP for the given observables, cold or from a
+      // guess of the working set.
+      bool init_solver(const Eigen::VectorXd& observables, int nWSR, const QPWorkingSet* guess)
+      {
+        qp_builder_.update(observables);
+
+        has_solution_ = false;
+        qpOASES::returnValue return_value = solver_->solve(qp_builder_, nWSR, 0, guess);
+        if(return_value == qpOASES::SUCCESSFUL_RETURN)
+          remember_working_set();
+
+        if(return_value != qpOASES::SUCCESSFUL_RETURN)
+        {
+          std::cout << "Init of QP-Problem returned without success! ERROR MESSAGE: " << 
+            qpOASES::MessageHandling::getErrorCodeMessage(return_value) << std::endl;
+          std::cout << "Printing internals." << std::endl;
+          qp_builder_.print_internals();
+          std::cout << "nWSR: " << nWSR << std::endl;
+          qp_builder_.are_internals_valid();
+        }
+        
+        return return_value == qpOASES::SUCCESSFUL_RETURN;
+      }
+
+      // Hotstarts the solver on the current QP of the builder, recovers if that
+      // fails and recovery is enabled, and takes over the solution on success.
+      // 'nWSR' returns the iterations the solver used in all stages together,
+      // and 'recovery_stage' the last recovery stage that ran. With a deadline,
+      // 'start' is the time at which the update started.
+      qpOASES::returnValue solve(int& nWSR, int& recovery_stage,
+          const UpdateStatistics::Clock::time_point& start)
+      {
+        recovery_stage = rsNone;
+
+        // seconds that are left for the solver, only with a deadline
+        double budget = 0.0;
+        double* budget_ptr = 0;
+        if(deadline_ > 0.0)
+        {
+          budget = 1e-6 * deadline_ - UpdateStatistics::seconds(start, UpdateStatistics::Clock::now());
+          budget_ptr = &budget;
+        }
+
+        // NOTE: qpOASES always runs one iteration, no matter its budget.
+        qpOASES::returnValue return_value = qpOASES::RET_MAX_NWSR_REACHED;
+        if(out_of_time(budget_ptr))
+          nWSR = 0;
+        else
+        {
+          double cputime = budget;
+          return_value = solver_->hotstart(qp_builder_, nWSR, budget_ptr ? &cputime : 0);
+          budget -= cputime;
+        }
+
+        if(return_value != qpOASES::SUCCESSFUL_RETURN && recovery_options_.enabled_ &&
+            !out_of_time(budget_ptr))
+          return_value = recover(nWSR, recovery_stage, budget_ptr);
+
+        if( return_value != qpOASES::SUCCESSFUL_RETURN )
+        {
+          if(budget_ptr && (return_value == qpOASES::RET_MAX_NWSR_REACHED || out_of_time(budget_ptr)))
+            fall_back();
+          else
+            status_ = usFailed;
+          return return_value;
+        }
+
+        solver_->get_primal_solution(xdot_full_);
+        xdot_control_ = xdot_full_.segment(0, qp_builder_.num_controllables());
+        qp_builder_.calculate_slack(xdot_full_, xdot_slack_);
+        remember_working_set();
+        has_solution_ = true;
+        status_ = usSolved;
+
+        return return_value;
+      }
+
+      // Commands the last solution clipped to the current bounds of the
+      // controllables, or zero before the first solution.
+      void fall_back()
+      {
+        if(!has_solution_)
+        {
+          xdot_control_.setZero();
+          status_ = usZero;
+          return;
+        }
+
+        size_t n = qp_builder_.num_controllables();
+        xdot_control_ = xdot_full_.head(n).cwiseMax(qp_builder_.get_lb().head(n)).cwiseMin(
+            qp_builder_.get_ub().head(n));
+        status_ = usLastSolution;
+      }
+
+      void check_num_observables(size_t num_observables) const
+      {
+        if(num_observables != get_input_size())
+          throw std::invalid_argument("QPController: Evaluator reads " +
+              std::to_string(num_observables) + " observables, but the scope has " +
+              std::to_string(get_input_size()) + ".");
+      }
+
+      static bool out_of_time(const double* budget)
+      {
+        return budget && *budget <= 0.0;
+      }
+
+      // 'budget' is the time that is left for all stages, if there is a deadline.
+      qpOASES::returnValue recover(int& nWSR, int& recovery_stage, double* budget)
+      {
+        recovery_stage = rsRetry;
+        qpOASES::returnValue return_value = recovery_attempt(nWSR, budget, 0, true);
+        if(return_value == qpOASES::SUCCESSFUL_RETURN || out_of_time(budget))
+          return return_value;
+
+        if(has_last_working_set_)
+        {
+          recovery_stage = rsWorkingSet;
+          return_value = recovery_attempt(nWSR, budget, &last_working_set_, false);
+          if(return_value == qpOASES::SUCCESSFUL_RETURN || out_of_time(budget))
+            return return_value;
+        }
+
+        recovery_stage = rsColdStart;
+        return recovery_attempt(nWSR, budget, 0, false);
+      }
+
+      // Runs one stage of the recovery within its budget and what is left of
+      // the deadline, adds the iterations it used to 'nWSR', and takes the
+      // time it used from 'budget'.
+      qpOASES::returnValue recovery_attempt(int& nWSR, double* budget,
+          const QPWorkingSet* guess, bool hotstart)
+      {
+        int attempt_nWSR = recovery_options_.nWSR_;
+        double cputime = recovery_options_.cputime_;
+        if(budget && (cputime <= 0.0 || *budget < cputime))
+          cputime = *budget;
+        double* cputime_ptr = cputime > 0.0 ? &cputime : 0;
+        qpOASES::returnValue return_value = hotstart ?
+            solver_->hotstart(qp_builder_, attempt_nWSR, cputime_ptr) :
+            solver_->solve(qp_builder_, attempt_nWSR, cputime_ptr, guess);
+        nWSR += attempt_nWSR;
+        if(budget)
+          *budget -= cputime;
+        return return_value;
+      }
+
+      // Keeps the working set of the last solution for the recovery, without
+      // allocating.
+      void remember_working_set()
+      {
+        if(!recovery_options_.enabled_)
+          return;
+
+        solver_->get_working_set(last_working_set_);
+        has_last_working_set_ = true;
+      }
+
+      bool update_with_statistics(const Eigen::VectorXd& observables, int nWSR)
+      {
+        UpdateRecord record;
+        UpdateStatistics::Clock::time_point start = UpdateStatistics::Clock::now();
+        qp_builder_.evaluate_expressions(observables);
+        UpdateStatistics::Clock::time_point evaluated = UpdateStatistics::Clock::now();
+        qp_builder_.copy_values();
+        UpdateStatistics::Clock::time_point copied = UpdateStatistics::Clock::now();
+        int recovery_stage;
+        qpOASES::returnValue return_value = solve(nWSR, recovery_stage, start);
+        UpdateStatistics::Clock::time_point solved = UpdateStatistics::Clock::now();
+
+        record.evaluation_time_ = UpdateStatistics::seconds(start, evaluated);
+        record.copy_time_ = UpdateStatistics::seconds(evaluated, copied);
+        record.solve_time_ = UpdateStatistics::seconds(copied, solved);
+        record.nWSR_ = nWSR;
+        record.return_value_ = static_cast<int>(return_value);
+        record.recovery_stage_ = recovery_stage;
+        record.status_ = static_cast<int>(status_);
+        record.active_set_size_ = solver_->get_active_set_size();
+        statistics_.record(record);
+
+        return return_value == qpOASES::SUCCESSFUL_RETURN;
+      }
+
+      // Sets frame inputs with a quaternion or matrix encoding through their
+      // handles. Returns false for all other inputs.
+      template<typename... Args>
+      bool set_encoded_frame_input(Eigen::VectorXd& inputVector, const std::string& name, const Args&... args) const
+      {
+        if (scope_.has_input<giskard_core::Scope::QuaternionFrameInput>(name)) {
+          QuaternionFrameInputHandle handle = get_quaternion_frame_input_handle(name);
+          check_input_size(inputVector, name, handle.idx_ + 7);
+          set_input(inputVector, handle, args...);
+          return true;
+        }
+        if (scope_.has_input<giskard_core::Scope::MatrixFrameInput>(name)) {
+          MatrixFrameInputHandle handle = get_matrix_frame_input_handle(name);
+          check_input_size(inputVector, name, handle.idx_ + 12);
+          set_input(inputVector, handle, args...);
+          return true;
+        }
+        return false;
+      }
+
+      void check_input_size(const Eigen::VectorXd& inputVector, const std::string& name, size_t size) const
+      {
+        if (static_cast<size_t>(inputVector.size()) < size)
+          throw std::invalid_argument("Can't set frame input with name '" + name +
+                "' because the input vector is too small. Needed size: " +
+                std::to_string(size) + " Actual size: " + std::to_string(inputVector.size()));
+      }
+
       giskard_core::QPProblemBuilder qp_builder_;
-      qpOASES::SQProblem qp_problem_;
+      QPSolverPtr solver_;
       Eigen::VectorXd xdot_full_, xdot_control_, xdot_slack_;
       std::vector<std::string> controllable_names_, soft_constraint_names_;
       giskard_core::Scope scope_;
+      size_t num_folded_hard_constraints_;
+      UpdateStatistics statistics_;
+      QPRecoveryOptions recovery_options_;
+      QPWorkingSet last_working_set_;
+      bool has_last_working_set_;
+      // in microseconds, 0 for none
+      double deadline_;
+      bool has_solution_;
+      QPUpdateStatus status_;
   };
 
 }
@@ -22,37 +22,196 @@
 #define GISKARD_CORE_QP_PROBLEM_BUILDER_HPP
 
 #include <giskard_core/expressiontree.hpp>
+#include <giskard_core/tape_interpreter.hpp>
+#include <Eigen/Sparse>
 
 namespace giskard_core
 {
+  // How soft constraints enter the QP. With sfSlack every soft constraint gets
+  // a slack variable and a row in A. With sfLeastSquares, soft constraints whose
+  // lower and upper bounds coincide are moved into the objective as weighted
+  // least-squares terms, i.e. H = J^T W J and g = -J^T W b, and need neither a
+  // slack variable nor a row in A. The remaining ones keep their slacks.
+  enum SoftConstraintFormulation {sfSlack, sfLeastSquares};
+
+  struct QPProblemOptions
+  {
+    QPProblemOptions() : soft_constraint_formulation_( sfSlack ), sparse_( false ), tape_( false ),
+        common_subexpression_elimination_( true ), prune_scope_( false ),
+        detect_constant_matrices_( false ) {}
+
+    SoftConstraintFormulation soft_constraint_formulation_;
+
+    // If set, H and A are kept in compressed column storage. Their structure
+    // is derived from the dependencies of the expressions at init and fixed
+    // from then on, every update only overwrites the non-zero values.
+    bool sparse_;
+
+    // If set, generate(const QPControllerSpec&, ...) additionally lowers the
+    // specification onto a tape, and updates run the TapeInterpreter instead
+    // of the expression graph. Same restrictions as QPProblemBuilder::set_tape.
+    bool tape_;
+
+    // If set, generate(const QPControllerSpec&, ...) evaluates structurally
+    // equal specifications only once per update, see SpecCache.
+    bool common_subexpression_elimination_;
+
+    // If set, generate(const QPControllerSpec&, ...) drops all scope entries
+    // that neither a constraint nor a monitored output needs, see prune_scope.
+    // Inputs that only those entries read are no observables then.
+    bool prune_scope_;
+
+    // If set, init checks whether H and A are constant, see
+    // QPProblemBuilder::has_constant_matrices. This only pays off for
+    // controllers whose constraint Jacobians are constant, e.g. joint space
+    // control, and never for kinematic ones like the PR2 controllers. The
+    // check differentiates the constraints symbolically, so all of them have
+    // to implement derivativeExpression, which e.g. slerp does not.
+    bool detect_constant_matrices_;
+  };
+
+  // Signatures of the functions emitted by giskard_codegen. The evaluation
+  // function reads the observables and writes H and A in row-major order.
+  typedef void (*QPEvaluationFunction)(const double* observables, double* H, double* g,
+      double* A, double* lb, double* ub, double* lbA, double* ubA);
+  typedef void (*QPDimensionsFunction)(unsigned int* num_observables,
+      unsigned int* num_weights, unsigned int* num_constraints);
+
+  struct QPEvaluator
+  {
+    QPEvaluator() : evaluate_( 0 ), dimensions_( 0 ) {}
+    QPEvaluator(QPEvaluationFunction evaluate, QPDimensionsFunction dimensions) :
+      evaluate_( evaluate ), dimensions_( dimensions ) {}
+
+    QPEvaluationFunction evaluate_;
+    QPDimensionsFunction dimensions_;
+  };
+
   class QPProblemBuilder
   {
     public:
+      QPProblemBuilder() : evaluator_num_observables_( 0 ), has_tape_( false ),
+        constant_matrices_( false ) {}
+
       typedef typename std::vector< KDL::Expression<double>::Ptr > DoubleExpressionVector;
       typedef typename Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Matrix;
       typedef typename Eigen::VectorXd Vector;
+      typedef typename Eigen::SparseMatrix<double, Eigen::ColMajor, int> SparseMatrix;
      
       void init(const DoubleExpressionVector& controllable_lower_bounds,
           const DoubleExpressionVector& controllable_upper_bounds, const DoubleExpressionVector& controllable_weights,
           const DoubleExpressionVector& soft_expressions, const DoubleExpressionVector& soft_lower_bounds,
           const DoubleExpressionVector& soft_upper_bounds, const DoubleExpressionVector& soft_weights,
           const DoubleExpressionVector& hard_expressions, const DoubleExpressionVector& hard_lower_bounds,
-          const DoubleExpressionVector& hard_upper_bounds)
+          const DoubleExpressionVector& hard_upper_bounds,
+          const QPProblemOptions& options = QPProblemOptions())
       {
+        options_ = options;
+        evaluator_ = QPEvaluator();
+        has_tape_ = false;
         set_expressions(controllable_lower_bounds, controllable_upper_bounds,
             controllable_weights, soft_expressions, soft_lower_bounds,
             soft_upper_bounds, soft_weights, hard_expressions,
             hard_lower_bounds, hard_upper_bounds);
+        partition_soft_constraints();
+        constant_matrices_ = options_.detect_constant_matrices_ && are_matrices_constant();
  
         create_output_matrices();
       }
 
+      // Never allocates, so it is safe to call from a real-time thread.
       void update(const Vector& observables)
       {
-        update_expressions(observables);
+        evaluate_expressions(observables);
         copy_values();
       }
 
+      // First step of update. An evaluator or a tape fills the QP right away.
+      void evaluate_expressions(const Vector& observables)
+      {
+        if(has_evaluator() || has_tape())
+          evaluate(observables);
+        else
+          update_expressions(observables);
+      }
+
+      // Second step of update, copies the values of the expressions into the QP.
+      void copy_values()
+      {
+        if(has_evaluator() || has_tape())
+          return;
+
+        const Vector& values = expressions_.get_values();
+        const Eigen::MatrixXd& derivatives = expressions_.get_derivatives();
+
+        if(num_least_squares_soft_constraints() > 0)
+          copy_least_squares_values(values, derivatives);
+
+        if(is_sparse())
+          copy_sparse_values(values, derivatives);
+        else
+          copy_dense_values(values, derivatives);
+
+        lb_.segment(0, num_controllables()) =
+            values.segment(controllable_lower_bounds_offset(), num_controllables());
+        ub_.segment(0, num_controllables()) =
+            values.segment(controllable_upper_bounds_offset(), num_controllables());
+
+        lbA_.segment(0, num_hard_constraints()) =
+            values.segment(hard_lower_bounds_offset(), num_hard_constraints());
+        ubA_.segment(0, num_hard_constraints()) =
+            values.segment(hard_upper_bounds_offset(), num_hard_constraints());
+        for(size_t i=0; i<num_slack_variables(); ++i)
+        {
+          lbA_(num_hard_constraints() + i) = values(soft_lower_bounds_offset() + slack_soft_constraints_[i]);
+          ubA_(num_hard_constraints() + i) = values(soft_upper_bounds_offset() + slack_soft_constraints_[i]);
+        }
+      }
+
+      // Replaces the evaluation of the expressions with generated code. The
+      // generated code has to describe the same QP as the expressions given to
+      // init, which is why only the dense slack formulation is supported.
+      // NOTE: While an evaluator is set, the expressions are not updated.
+      void set_evaluator(const QPEvaluator& evaluator)
+      {
+        if(!evaluator.evaluate_ || !evaluator.dimensions_)
+          throw std::invalid_argument("QPProblemBuilder: Evaluator with null function pointers.");
+        unsigned int num_observables, num_weights, num_constraints;
+        evaluator.dimensions_(&num_observables, &num_weights, &num_constraints);
+        check_evaluator_dimensions(num_observables, num_weights, num_constraints);
+
+        evaluator_ = evaluator;
+        evaluator_num_observables_ = num_observables;
+        has_tape_ = false;
+      }
+
+      bool has_evaluator() const
+      {
+        return evaluator_.evaluate_ != 0;
+      }
+
+      // Replaces the evaluation of the expressions with an interpreter of the
+      // tape generated from the same specification, see generate_tape. Same
+      // restrictions as set_evaluator.
+      void set_tape(const QPTape& qp)
+      {
+        TapeInterpreter interpreter;
+        interpreter.init(qp);
+        size_t num_observables = std::max(qp.num_observables_, interpreter.num_observables());
+        check_evaluator_dimensions(num_observables, qp.num_weights(), qp.num_constraints());
+
+        interpreter_ = interpreter;
+        evaluator_ = QPEvaluator();
+        evaluator_num_observables_ = num_observables;
+        has_tape_ = true;
+      }
+
+      bool has_tape() const
+      {
+        return has_tape_;
+      }
+
+      // NOTE: The dense H and A are only filled if the builder is not sparse.
       const Matrix& get_H() const
       {
         return H_;
@@ -63,6 +222,30 @@ namespace giskard_core
         return A_;
       }
 
+      const SparseMatrix& get_sparse_H() const
+      {
+        return sparse_H_;
+      }
+
+      const SparseMatrix& get_sparse_A() const
+      {
+        return sparse_A_;
+      }
+
+      bool is_sparse() const
+      {
+        return options_.sparse_;
+      }
+
+      // True if H and A are the same for all observables, i.e. if all weights
+      // are constant and all constraints are linear in the controllables with
+      // constant coefficients. Decided once at init, and only with
+      // QPProblemOptions::detect_constant_matrices_, false otherwise.
+      bool has_constant_matrices() const
+      {
+        return constant_matrices_;
+      }
+
       const Vector& get_g() const
       {
         return g_;
@@ -90,74 +273,128 @@ namespace giskard_core
 
       size_t num_controllables() const
       {
-        return controllable_weights_.num_expressions();
+        return controllable_weights_.size();
       }
 
       size_t num_hard_constraints() const
       {
-        return hard_expressions_.num_expressions();
+        return hard_expressions_.size();
       }
 
       size_t num_hard_constraints_observables() const
       {
-        return hard_expressions_.num_inputs();
+        return num_inputs(hard_expressions_);
       }
 
       size_t num_soft_constraints() const
       {
-        return soft_expressions_.num_expressions();
+        return soft_expressions_.size();
       }
 
       size_t num_soft_constraints_observables() const
       {
-        return soft_expressions_.num_inputs();
+        return num_inputs(soft_expressions_);
+      }
+
+      size_t num_slack_variables() const
+      {
+        return slack_soft_constraints_.size();
+      }
+
+      size_t num_least_squares_soft_constraints() const
+      {
+        return least_squares_soft_constraints_.size();
       }
 
       size_t num_constraints() const
       {
-        return num_soft_constraints() + num_hard_constraints();
+        return num_slack_variables() + num_hard_constraints();
       }
 
       size_t num_weights() const
       {
-        return num_controllables() + num_soft_constraints();
+        return num_controllables() + num_slack_variables();
+      }
+
+      const QPProblemOptions& get_options() const
+      {
+        return options_;
+      }
+
+      // Fills 'slack' with the slack of every soft constraint for the given
+      // solution of the QP. For least-squares soft constraints, this is the
+      // residual that a slack variable would have taken.
+      void calculate_slack(const Vector& solution, Vector& slack) const
+      {
+        slack.resize(num_soft_constraints());
+        for(size_t i=0; i<slack_soft_constraints_.size(); ++i)
+          slack(slack_soft_constraints_[i]) = solution(num_controllables() + i);
+        for(size_t i=0; i<least_squares_soft_constraints_.size(); ++i)
+          slack(least_squares_soft_constraints_[i]) = least_squares_targets_(i) -
+              least_squares_jacobian_.row(i).dot(solution.segment(0, num_controllables()));
       }
 
       const DoubleExpressionVector& get_controllable_lower_bounds() const
       {
-        return controllable_lower_bounds_.get_expressions();
+        return controllable_lower_bounds_;
       }
 
       const DoubleExpressionVector& get_controllable_upper_bounds() const
       {
-        return controllable_upper_bounds_.get_expressions();
+        return controllable_upper_bounds_;
+      }
+
+      const DoubleExpressionVector& get_controllable_weights() const
+      {
+        return controllable_weights_;
       }
 
       const DoubleExpressionVector& get_soft_lower_bounds() const
       {
-        return soft_lower_bounds_.get_expressions();
+        return soft_lower_bounds_;
       }
 
       const DoubleExpressionVector& get_soft_upper_bounds() const
       {
-        return soft_upper_bounds_.get_expressions();
+        return soft_upper_bounds_;
       }
 
       const DoubleExpressionVector& get_soft_expressions() const
       {
-        return soft_expressions_.get_expressions();
+        return soft_expressions_;
       }
 
       const DoubleExpressionVector& get_soft_weights() const
       {
-        return soft_weights_.get_expressions();
+        return soft_weights_;
+      }
+
+      const DoubleExpressionVector& get_hard_expressions() const
+      {
+        return hard_expressions_;
+      }
+
+      const DoubleExpressionVector& get_hard_lower_bounds() const
+      {
+        return hard_lower_bounds_;
+      }
+
+      const DoubleExpressionVector& get_hard_upper_bounds() const
+      {
+        return hard_upper_bounds_;
+      }
+
+      // All expressions of the QP, evaluated together in one pass.
+      const KDL::DoubleExpressionArray& get_expression_array() const
+      {
+        return expressions_;
       }
     
       void print_internals() const
       {
-        print_matrix("H", get_H());
+        print_matrix("H", is_sparse() ? Matrix(get_sparse_H()) : get_H());
         print_vector("g", get_g());
-        print_matrix("A", get_A());
+        print_matrix("A", is_sparse() ? Matrix(get_sparse_A()) : get_A());
         print_vector("lb", get_lb());
         print_vector("ub", get_ub());
         print_vector("lbA", get_lbA());
@@ -172,36 +409,42 @@ namespace giskard_core
 
       size_t num_observables() const
       {
-        // FIXME: calculate this based on the contents of the scope!
-        //        For certain cases this is too conservative, i.e.
-        //        some inputs are defined but only used to calculate
-        //        expressions in the scope which are reported as feedback.
-        //        Strictly speaking, that is not an input to the controller.
-        //        Still, I had intermediate use-cases for this.
-        size_t result = 0;
-        result = std::max(controllable_lower_bounds_.num_inputs(), result);
-        result = std::max(controllable_upper_bounds_.num_inputs(), result);
-        result = std::max(controllable_weights_.num_inputs(), result);
-
-        result = std::max(soft_expressions_.num_inputs(), result);
-        result = std::max(soft_lower_bounds_.num_inputs(), result);
-        result = std::max(soft_upper_bounds_.num_inputs(), result);
-        result = std::max(soft_weights_.num_inputs(), result);
-
-        result = std::max(hard_expressions_.num_inputs(), result);
-        result = std::max(hard_lower_bounds_.num_inputs(), result);
-        result = std::max(hard_upper_bounds_.num_inputs(), result);
-
-        return result;
+        // NOTE: For certain cases this is too conservative, i.e.
+        //       some inputs are defined but only used to calculate
+        //       expressions in the scope which are reported as feedback.
+        //       Strictly speaking, that is not an input to the controller.
+        //       Generate with QPProblemOptions::prune_scope_ to drop them, and
+        //       use find_unused_inputs to list them.
+        return expressions_.num_inputs();
       }
 
 
     private:
-      KDL::DoubleExpressionArray controllable_lower_bounds_, controllable_upper_bounds_,
+      DoubleExpressionVector controllable_lower_bounds_, controllable_upper_bounds_,
          controllable_weights_, soft_expressions_, soft_lower_bounds_, soft_upper_bounds_,
          soft_weights_, hard_expressions_, hard_lower_bounds_, hard_upper_bounds_;
 
+      // NOTE: All expressions of the QP live in this one array. Hence, they share
+      //       a single optimizer and every cached sub-expression that is used by
+      //       several of them (e.g. forward kinematics referenced by a soft
+      //       constraint and its bounds) is evaluated only once per update.
+      //       The blocks are stored in the order of the members above.
+      KDL::DoubleExpressionArray expressions_;
+
+      QPProblemOptions options_;
+      QPEvaluator evaluator_;
+      size_t evaluator_num_observables_;
+      TapeInterpreter interpreter_;
+      bool has_tape_;
+      bool constant_matrices_;
+      std::vector<size_t> slack_soft_constraints_, least_squares_soft_constraints_;
+      Matrix least_squares_jacobian_, least_squares_weighted_jacobian_;
+      Vector least_squares_targets_, least_squares_weights_, least_squares_weighted_targets_;
+      // NOTE: Buffers that updates write into, so that they never allocate.
+      Vector expression_inputs_;
+
       Matrix H_, A_;
+      SparseMatrix sparse_H_, sparse_A_;
       Vector g_, lb_, ub_, lbA_, ubA_;
 
       bool are_controllables_valid() const
@@ -270,82 +513,358 @@ namespace giskard_core
           const DoubleExpressionVector& hard_expressions, const DoubleExpressionVector& hard_lower_bounds,
           const DoubleExpressionVector& hard_upper_bounds)
       {
-        controllable_lower_bounds_.set_expressions(controllable_lower_bounds);
-        controllable_upper_bounds_.set_expressions(controllable_upper_bounds);
-        controllable_weights_.set_expressions(controllable_weights);
+        controllable_lower_bounds_ = controllable_lower_bounds;
+        controllable_upper_bounds_ = controllable_upper_bounds;
+        controllable_weights_ = controllable_weights;
+
+        soft_expressions_ = soft_expressions;
+        soft_lower_bounds_ = soft_lower_bounds;
+        soft_upper_bounds_ = soft_upper_bounds;
+        soft_weights_ = soft_weights;
+
+        hard_expressions_ = hard_expressions;
+        hard_lower_bounds_ = hard_lower_bounds;
+        hard_upper_bounds_ = hard_upper_bounds;
+
+        DoubleExpressionVector expressions;
+        append(expressions, controllable_lower_bounds_);
+        append(expressions, controllable_upper_bounds_);
+        append(expressions, controllable_weights_);
+        append(expressions, soft_expressions_);
+        append(expressions, soft_lower_bounds_);
+        append(expressions, soft_upper_bounds_);
+        append(expressions, soft_weights_);
+        append(expressions, hard_expressions_);
+        append(expressions, hard_lower_bounds_);
+        append(expressions, hard_upper_bounds_);
+
+        // NOTE: Only the columns of the controllables end up in A. The joints
+        //       are at the front of the observables, so we spare ourselves the
+        //       derivatives w.r.t. goals and parameters.
+        expressions_.set_max_num_derivatives(num_controllables());
+        expressions_.set_expressions(expressions);
+      }
+
+      void partition_soft_constraints()
+      {
+        slack_soft_constraints_.clear();
+        least_squares_soft_constraints_.clear();
+        for(size_t i=0; i<num_soft_constraints(); ++i)
+          if(options_.soft_constraint_formulation_ == sfLeastSquares &&
+              are_equal(soft_lower_bounds_[i], soft_upper_bounds_[i]))
+            least_squares_soft_constraints_.push_back(i);
+          else
+            slack_soft_constraints_.push_back(i);
+      }
 
-        soft_expressions_.set_expressions(soft_expressions);
-        soft_lower_bounds_.set_expressions(soft_lower_bounds);
-        soft_upper_bounds_.set_expressions(soft_upper_bounds);
-        soft_weights_.set_expressions(soft_weights);
+      // NOTE: This has to hold for all inputs. Hence, we only accept bounds that are
+      //       literally the same expression or constants with the same value.
+      static bool are_equal(const KDL::Expression<double>::Ptr& a, const KDL::Expression<double>::Ptr& b)
+      {
+        if(a == b)
+          return true;
+
+        return a->number_of_derivatives() == 0 && b->number_of_derivatives() == 0 &&
+            a->value() == b->value();
+      }
 
-        hard_expressions_.set_expressions(hard_expressions);
-        hard_lower_bounds_.set_expressions(hard_lower_bounds);
-        hard_upper_bounds_.set_expressions(hard_upper_bounds);
+      bool are_matrices_constant() const
+      {
+        for(size_t i=0; i<num_controllables(); ++i)
+          if(!is_constant(controllable_weights_[i]))
+            return false;
+        for(size_t i=0; i<num_soft_constraints(); ++i)
+          if(!is_constant(soft_weights_[i]) ||
+              !are_derivatives_constant(soft_expressions_offset() + i))
+            return false;
+        for(size_t i=0; i<num_hard_constraints(); ++i)
+          if(!are_derivatives_constant(hard_expressions_offset() + i))
+            return false;
+        return true;
+      }
+
+      // Derivatives w.r.t. the controllables of one expression of the array.
+      // Those that are structurally zero are constant anyway.
+      bool are_derivatives_constant(size_t expression_index) const
+      {
+        const KDL::Expression<double>::Ptr& expression = expressions_.get_expressions()[expression_index];
+        const std::vector<int>& columns = expressions_.get_nonzero_derivatives(expression_index);
+        for(size_t j=0; j<columns.size(); ++j)
+          if(!is_constant(expression->derivativeExpression(columns[j])))
+            return false;
+        return true;
+      }
+
+      static bool is_constant(const KDL::Expression<double>::Ptr& expression)
+      {
+        std::set<int> dependencies;
+        expression->getDependencies(dependencies);
+        return dependencies.empty();
+      }
+
+      static void append(DoubleExpressionVector& target, const DoubleExpressionVector& source)
+      {
+        target.insert(target.end(), source.begin(), source.end());
+      }
+
+      static size_t num_inputs(const DoubleExpressionVector& expressions)
+      {
+        int result = 0;
+        for(size_t i=0; i<expressions.size(); ++i)
+          result = std::max(result, expressions[i]->number_of_derivatives());
+        return result;
+      }
+
+      size_t controllable_lower_bounds_offset() const
+      {
+        return 0;
+      }
+
+      size_t controllable_upper_bounds_offset() const
+      {
+        return controllable_lower_bounds_offset() + controllable_lower_bounds_.size();
+      }
+
+      size_t controllable_weights_offset() const
+      {
+        return controllable_upper_bounds_offset() + controllable_upper_bounds_.size();
+      }
+
+      size_t soft_expressions_offset() const
+      {
+        return controllable_weights_offset() + controllable_weights_.size();
+      }
+
+      size_t soft_lower_bounds_offset() const
+      {
+        return soft_expressions_offset() + soft_expressions_.size();
+      }
+
+      size_t soft_upper_bounds_offset() const
+      {
+        return soft_lower_bounds_offset() + soft_lower_bounds_.size();
+      }
+
+      size_t soft_weights_offset() const
+      {
+        return soft_upper_bounds_offset() + soft_upper_bounds_.size();
+      }
+
+      size_t hard_expressions_offset() const
+      {
+        return soft_weights_offset() + soft_weights_.size();
+      }
+
+      size_t hard_lower_bounds_offset() const
+      {
+        return hard_expressions_offset() + hard_expressions_.size();
+      }
+
+      size_t hard_upper_bounds_offset() const
+      {
+        return hard_lower_bounds_offset() + hard_lower_bounds_.size();
       }
 
       void create_output_matrices()
       {
-        H_ = Eigen::MatrixXd::Zero(num_weights(), num_weights());
+        if(is_sparse())
+          create_sparse_matrices();
+        else
+        {
+          H_ = Eigen::MatrixXd::Zero(num_weights(), num_weights());
 
-        A_ = Eigen::MatrixXd::Zero(num_constraints(), num_weights());
-        A_.block(num_hard_constraints(), num_controllables(), num_soft_constraints(), num_soft_constraints()) =
-            Eigen::MatrixXd::Identity(num_soft_constraints(), num_soft_constraints());
+          A_ = Eigen::MatrixXd::Zero(num_constraints(), num_weights());
+          A_.block(num_hard_constraints(), num_controllables(), num_slack_variables(), num_slack_variables()) =
+              Eigen::MatrixXd::Identity(num_slack_variables(), num_slack_variables());
+        }
+
+        least_squares_jacobian_ = Eigen::MatrixXd::Zero(num_least_squares_soft_constraints(), num_controllables());
+        least_squares_weighted_jacobian_ = least_squares_jacobian_;
+        least_squares_targets_ = Eigen::VectorXd::Zero(num_least_squares_soft_constraints());
+        least_squares_weights_ = Eigen::VectorXd::Zero(num_least_squares_soft_constraints());
+        least_squares_weighted_targets_ = Eigen::VectorXd::Zero(num_least_squares_soft_constraints());
+        expression_inputs_ = Eigen::VectorXd::Zero(expressions_.num_inputs());
  
         g_ = Eigen::VectorXd::Zero(num_weights());
         lb_ = Eigen::VectorXd::Zero(num_weights());
         ub_ = Eigen::VectorXd::Zero(num_weights());
         lbA_ = Eigen::VectorXd::Zero(num_constraints());
         ubA_ = Eigen::VectorXd::Zero(num_constraints());
+
+        // the bounds of the slack variables never change
+        // TODO: try to get rid of these constants
+        lb_.segment(num_controllables(), num_slack_variables()).setConstant(-1e+9);
+        ub_.segment(num_controllables(), num_slack_variables()).setConstant(1e+9);
       }
 
-      void update_expressions(const Vector& observables)
+      // Takes the structure of H and A from the structural sparsity of the
+      // derivatives. Only the slack entries of A are set here, they never change.
+      void create_sparse_matrices()
       {
-        update_expressions(controllable_lower_bounds_, observables);
-        update_expressions(controllable_upper_bounds_, observables);
-        update_expressions(controllable_weights_, observables);
+        std::vector< Eigen::Triplet<double> > H_entries, A_entries;
 
-        update_expressions(soft_expressions_, observables);
-        update_expressions(soft_lower_bounds_, observables);
-        update_expressions(soft_upper_bounds_, observables);
-        update_expressions(soft_weights_, observables);
+        for(size_t i=0; i<num_weights(); ++i)
+          H_entries.push_back(Eigen::Triplet<double>(i, i, 0.0));
+        for(size_t i=0; i<num_least_squares_soft_constraints(); ++i)
+        {
+          const std::vector<int>& columns =
+              expressions_.get_nonzero_derivatives(soft_expressions_offset() + least_squares_soft_constraints_[i]);
+          for(size_t j=0; j<columns.size(); ++j)
+            for(size_t k=0; k<columns.size(); ++k)
+              H_entries.push_back(Eigen::Triplet<double>(columns[j], columns[k], 0.0));
+        }
 
-        update_expressions(hard_expressions_, observables);
-        update_expressions(hard_lower_bounds_, observables);
-        update_expressions(hard_upper_bounds_, observables);
+        for(size_t i=0; i<num_hard_constraints(); ++i)
+        {
+          const std::vector<int>& columns =
+              expressions_.get_nonzero_derivatives(hard_expressions_offset() + i);
+          for(size_t j=0; j<columns.size(); ++j)
+            A_entries.push_back(Eigen::Triplet<double>(i, columns[j], 0.0));
+        }
+        for(size_t i=0; i<num_slack_variables(); ++i)
+        {
+          const std::vector<int>& columns =
+              expressions_.get_nonzero_derivatives(soft_expressions_offset() + slack_soft_constraints_[i]);
+          for(size_t j=0; j<columns.size(); ++j)
+            A_entries.push_back(Eigen::Triplet<double>(num_hard_constraints() + i, columns[j], 0.0));
+          A_entries.push_back(Eigen::Triplet<double>(num_hard_constraints() + i, num_controllables() + i, 1.0));
+        }
+
+        sparse_H_.resize(num_weights(), num_weights());
+        sparse_H_.setFromTriplets(H_entries.begin(), H_entries.end());
+        sparse_H_.makeCompressed();
+
+        sparse_A_.resize(num_constraints(), num_weights());
+        sparse_A_.setFromTriplets(A_entries.begin(), A_entries.end());
+        sparse_A_.makeCompressed();
       }
 
-      void copy_values()
+      void evaluate(const Vector& observables)
       {
-        H_.diagonal().segment(0, num_controllables()) =
-            controllable_weights_.get_values();
-        H_.diagonal().segment(num_controllables(), num_soft_constraints()) =
-            soft_weights_.get_values();
+        if(static_cast<size_t>(observables.size()) < evaluator_num_observables_)
+          throw std::invalid_argument("QPProblemBuilder: Evaluator got too few observables.");
 
-        size_t cols_to_copy = std::min(num_hard_constraints_observables(), num_controllables());
-        A_.block(0, 0, num_hard_constraints(), cols_to_copy) =
-            hard_expressions_.get_derivatives().block(0, 0, num_hard_constraints(), cols_to_copy);
-        cols_to_copy = std::min(num_soft_constraints_observables(), num_controllables());
-        A_.block(num_hard_constraints(), 0, num_soft_constraints(), cols_to_copy) = 
-            soft_expressions_.get_derivatives().block(0, 0, num_soft_constraints(), cols_to_copy);
+        if(has_tape())
+          interpreter_.evaluate(observables.data(), H_.data(), g_.data(), A_.data(),
+              lb_.data(), ub_.data(), lbA_.data(), ubA_.data());
+        else
+          evaluator_.evaluate_(observables.data(), H_.data(), g_.data(), A_.data(),
+              lb_.data(), ub_.data(), lbA_.data(), ubA_.data());
+      }
 
-        lb_.segment(0, num_controllables()) = controllable_lower_bounds_.get_values();
-        // TODO: try to get rid of these constants
-        lb_.segment(num_controllables(), num_soft_constraints()) = 
-            -1e+9 * Eigen::VectorXd::Ones(num_soft_constraints());
-        ub_.segment(0, num_controllables()) = controllable_upper_bounds_.get_values();
-        ub_.segment(num_controllables(), num_soft_constraints()) = 
-            1e+9 * Eigen::VectorXd::Ones(num_soft_constraints());
+      // NOTE: The expressions may read fewer observables than the evaluator,
+      //       e.g. if only feedback reads the last ones, so this cannot insist
+      //       on equality. QPController compares with its scope instead.
+      void check_evaluator_dimensions(size_t num_observables, size_t num_weights,
+          size_t num_constraints) const
+      {
+        if(is_sparse() || num_least_squares_soft_constraints() > 0)
+          throw std::invalid_argument("QPProblemBuilder: Evaluators only support dense slack formulations.");
+        if(num_weights != this->num_weights() || num_constraints != this->num_constraints())
+          throw std::invalid_argument("QPProblemBuilder: Dimensions of evaluator do not match.");
+        if(num_observables < this->num_observables())
+          throw std::invalid_argument("QPProblemBuilder: Evaluator reads " +
+              std::to_string(num_observables) + " observables, but the expressions read " +
+              std::to_string(this->num_observables()) + ".");
+      }
 
-        lbA_.segment(0, num_hard_constraints()) = hard_lower_bounds_.get_values();
-        lbA_.segment(num_hard_constraints(), num_soft_constraints()) = soft_lower_bounds_.get_values();
-        ubA_.segment(0, num_hard_constraints()) = hard_upper_bounds_.get_values();
-        ubA_.segment(num_hard_constraints(), num_soft_constraints()) = soft_upper_bounds_.get_values();
+      void update_expressions(const Vector& observables)
+      {
+        // NOTE: Passing the segment itself would create a temporary vector.
+        expression_inputs_ = observables.segment(0, expression_inputs_.size());
+        expressions_.update(expression_inputs_);
+      }
+
+      void copy_dense_values(const Vector& values, const Eigen::MatrixXd& derivatives)
+      {
+        if(num_least_squares_soft_constraints() > 0)
+        {
+          least_squares_weighted_jacobian_.noalias() =
+              least_squares_weights_.asDiagonal() * least_squares_jacobian_;
+          H_.block(0, 0, num_controllables(), num_controllables()).noalias() =
+              least_squares_jacobian_.transpose() * least_squares_weighted_jacobian_;
+          H_.diagonal().segment(0, num_controllables()) +=
+              values.segment(controllable_weights_offset(), num_controllables());
+        }
+        else
+          H_.diagonal().segment(0, num_controllables()) =
+              values.segment(controllable_weights_offset(), num_controllables());
+        for(size_t i=0; i<num_slack_variables(); ++i)
+          H_(num_controllables() + i, num_controllables() + i) =
+              values(soft_weights_offset() + slack_soft_constraints_[i]);
+
+        for(size_t i=0; i<num_hard_constraints(); ++i)
+          copy_nonzero_derivatives(derivatives, hard_expressions_offset() + i, A_, i);
+        for(size_t i=0; i<num_slack_variables(); ++i)
+          copy_nonzero_derivatives(derivatives, soft_expressions_offset() + slack_soft_constraints_[i],
+              A_, num_hard_constraints() + i);
+      }
+
+      // Copies the structurally non-zero derivatives of an expression into a row
+      // of the target. The other entries of that row are never touched.
+      void copy_nonzero_derivatives(const Eigen::MatrixXd& derivatives, size_t expression,
+          Matrix& target, size_t row) const
+      {
+        const std::vector<int>& columns = expressions_.get_nonzero_derivatives(expression);
+        for(size_t j=0; j<columns.size(); ++j)
+          target(row, columns[j]) = derivatives(expression, columns[j]);
+      }
+
+      // Walks the fixed structure of H and A and overwrites all values that
+      // depend on the expressions.
+      void copy_sparse_values(const Vector& values, const Eigen::MatrixXd& derivatives)
+      {
+        for(int k=0; k<sparse_H_.outerSize(); ++k)
+          for(SparseMatrix::InnerIterator it(sparse_H_, k); it; ++it)
+          {
+            double value = 0.0;
+            if(num_least_squares_soft_constraints() > 0 &&
+                it.row() < num_controllables() && it.col() < num_controllables())
+              value = least_squares_jacobian_.col(it.row()).cwiseProduct(least_squares_weights_).dot(
+                  least_squares_jacobian_.col(it.col()));
+            if(it.row() == it.col())
+              value += weight(values, it.row());
+            it.valueRef() = value;
+          }
+
+        for(int k=0; k<sparse_A_.outerSize(); ++k)
+          for(SparseMatrix::InnerIterator it(sparse_A_, k); it; ++it)
+          {
+            if(it.col() >= num_controllables())
+              continue;
+
+            size_t expression = it.row() < num_hard_constraints() ?
+                hard_expressions_offset() + it.row() :
+                soft_expressions_offset() + slack_soft_constraints_[it.row() - num_hard_constraints()];
+            it.valueRef() = derivatives(expression, it.col());
+          }
+      }
+
+      // Weight of the i-th variable of the QP, i.e. of a controllable or a slack.
+      double weight(const Vector& values, size_t i) const
+      {
+        if(i < num_controllables())
+          return values(controllable_weights_offset() + i);
+        else
+          return values(soft_weights_offset() + slack_soft_constraints_[i - num_controllables()]);
       }
 
-      void update_expressions(KDL::DoubleExpressionArray& expressions, const Vector& values) const
+      // Gathers Jacobian, targets and weights of the least-squares soft constraints
+      // and sets up the part of g that belongs to the controllables.
+      void copy_least_squares_values(const Vector& values, const Eigen::MatrixXd& derivatives)
       {
-        expressions.update(values.segment(0, expressions.num_inputs()));
+        for(size_t i=0; i<num_least_squares_soft_constraints(); ++i)
+        {
+          size_t index = least_squares_soft_constraints_[i];
+          copy_nonzero_derivatives(derivatives, soft_expressions_offset() + index,
+              least_squares_jacobian_, i);
+          least_squares_targets_(i) = values(soft_lower_bounds_offset() + index);
+          least_squares_weights_(i) = values(soft_weights_offset() + index);
+        }
+
+        least_squares_weighted_targets_ = least_squares_weights_.cwiseProduct(least_squares_targets_);
+        g_.segment(0, num_controllables()).noalias() =
+            -least_squares_jacobian_.transpose() * least_squares_weighted_targets_;
       }
   };
 } 
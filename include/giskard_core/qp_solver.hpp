@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_QP_SOLVER_HPP
+#define GISKARD_CORE_QP_SOLVER_HPP
+
+#include <giskard_core/qp_problem_builder.hpp>
+#include <giskard_core/working_set.hpp>
+#include <boost/shared_ptr.hpp>
+#include <qpOASES.hpp>
+
+namespace giskard_core
+{
+  // Common interface of the backends that solve the QP of a QPProblemBuilder
+  // for QPController. Outcomes are reported as qpOASES return values.
+  // 'nWSR' is the budget of working set recalculations and returns the ones
+  // used. 'cputime' is an optional budget in seconds and returns the time
+  // used, just like in qpOASES.
+  class QPSolver
+  {
+    public:
+      virtual ~QPSolver() {}
+
+      virtual QPSolver* clone() const = 0;
+
+      // Prepares the solver for QPs with the dimensions and the structure
+      // of the ones of 'qp'. Allocates, so call it before the control loop.
+      virtual void init(const QPProblemBuilder& qp) = 0;
+
+      // Solves the current QP of 'qp' from scratch, or starting from a
+      // guess of the working set.
+      virtual qpOASES::returnValue solve(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime, const QPWorkingSet* guess) = 0;
+
+      // Solves the current QP of 'qp' starting from the last solution.
+      virtual qpOASES::returnValue hotstart(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime) = 0;
+
+      virtual bool is_initialised() const = 0;
+
+      virtual bool is_solved() const = 0;
+
+      // Writes the solution into 'x', which has one entry per weight.
+      virtual void get_primal_solution(Eigen::VectorXd& x) const = 0;
+
+      // Writes the working set of the last solution into 'working_set', which
+      // already has one entry per bound and constraint.
+      virtual void get_working_set(QPWorkingSet& working_set) = 0;
+
+      // Number of active bounds and constraints of the last solution.
+      virtual size_t get_active_set_size() const = 0;
+  };
+
+  // Owns a solver, and hands out a copy of it to each of its own copies.
+  // Hence, copies of a controller do not share the state of their solver.
+  class QPSolverPtr
+  {
+    public:
+      QPSolverPtr() {}
+      explicit QPSolverPtr(QPSolver* solver) : solver_( solver ) {}
+      QPSolverPtr(const QPSolverPtr& other) :
+        solver_( other.solver_ ? other.solver_->clone() : 0 ) {}
+
+      QPSolverPtr& operator=(const QPSolverPtr& other)
+      {
+        if(this != &other)
+          solver_.reset(other.solver_ ? other.solver_->clone() : 0);
+        return *this;
+      }
+
+      void reset(QPSolver* solver)
+      {
+        solver_.reset(solver);
+      }
+
+      QPSolver* operator->() const
+      {
+        return solver_.get();
+      }
+
+      QPSolver& operator*() const
+      {
+        return *solver_;
+      }
+
+    private:
+      boost::shared_ptr<QPSolver> solver_;
+  };
+
+  // Parts that all backends on top of qpOASES share.
+  class QPOasesSolverBase : public QPSolver
+  {
+    public:
+      virtual bool is_initialised() const
+      {
+        return qp_problem_.getStatus() != qpOASES::QPS_NOTINITIALISED;
+      }
+
+      virtual bool is_solved() const
+      {
+        return qp_problem_.isSolved() == qpOASES::BT_TRUE;
+      }
+
+      virtual void get_working_set(QPWorkingSet& working_set)
+      {
+        qp_problem_.getWorkingSet(working_set_.data());
+        for(size_t i=0; i<working_set.bounds_.size(); ++i)
+          working_set.bounds_[i] = static_cast<int>(working_set_(i));
+        for(size_t i=0; i<working_set.constraints_.size(); ++i)
+          working_set.constraints_[i] = static_cast<int>(working_set_(working_set.bounds_.size() + i));
+      }
+
+      virtual size_t get_active_set_size() const
+      {
+        return qp_problem_.getNAC() + qp_problem_.getNFX();
+      }
+
+    protected:
+      void setup_problem(const QPProblemBuilder& qp, qpOASES::HessianType hessian_type)
+      {
+        qp_problem_ = qpOASES::SQProblem(qp.num_weights(), qp.num_constraints(), hessian_type);
+        qpOASES::Options options;
+        // NOTE: In the past, I was using setting "reliable", and found a curious
+        //       bug: One trying to solve an already solved problem, the solver
+        //       would never finish and run out of working set iterations. The
+        //       corresponding test-case is broken flying cup. Switching to
+        //       "default" solved this on qpOASES 3.1.
+        // NOTE: Even earlier, I was using setting "MPC" that left to weird behavior
+        //       for orientation control. It seemed as if the solver returned 
+        //       inaccurate solutions. We (Alexis and Georg) decided to swith
+        //       away from "MPC" to improve this behavior. That was also for
+        //       qpOASES 3.1. However, now I cannot reproduce that problem.
+        options.setToDefault();
+        options.printLevel = qpOASES::PL_NONE;
+        qp_problem_.setOptions(options);
+
+        working_set_.resize(qp.num_weights() + qp.num_constraints());
+      }
+
+      qpOASES::returnValue init_problem(qpOASES::SymmetricMatrix* H, const double* g,
+          qpOASES::Matrix* A, const double* lb, const double* ub, const double* lbA,
+          const double* ubA, int& nWSR, double* cputime, const QPWorkingSet* guess)
+      {
+        if(!guess)
+          return qp_problem_.init(H, g, A, lb, ub, lbA, ubA, nWSR, cputime);
+
+        qpOASES::Bounds bounds(guess->bounds_.size());
+        for(size_t i=0; i<guess->bounds_.size(); ++i)
+          bounds.setupBound(i, to_status(guess->bounds_[i]));
+        qpOASES::Constraints constraints(guess->constraints_.size());
+        for(size_t i=0; i<guess->constraints_.size(); ++i)
+          constraints.setupConstraint(i, to_status(guess->constraints_[i]));
+
+        return qp_problem_.init(H, g, A, lb, ub, lbA, ubA, nWSR, cputime, 0, 0,
+            &bounds, &constraints);
+      }
+
+      // NOTE: With constant H and A, the hotstart of QProblem keeps the
+      //       factorization of the last solve and only takes the new vectors.
+      //       The one of SQProblem would set up and factorize the matrices anew.
+      qpOASES::returnValue hotstart_problem(qpOASES::SymmetricMatrix* H, const double* g,
+          qpOASES::Matrix* A, const double* lb, const double* ub, const double* lbA,
+          const double* ubA, int& nWSR, double* cputime, bool constant_matrices)
+      {
+        if(constant_matrices)
+          return qp_problem_.qpOASES::QProblem::hotstart(g, lb, ub, lbA, ubA, nWSR, cputime);
+
+        return qp_problem_.hotstart(H, g, A, lb, ub, lbA, ubA, nWSR, cputime);
+      }
+
+      static qpOASES::SubjectToStatus to_status(int status)
+      {
+        return status < 0 ? qpOASES::ST_LOWER : (status > 0 ? qpOASES::ST_UPPER : qpOASES::ST_INACTIVE);
+      }
+
+      qpOASES::SQProblem qp_problem_;
+      // NOTE: Buffer of qpOASES::SQProblem::getWorkingSet, which does not allocate.
+      Eigen::VectorXd working_set_;
+  };
+
+  // Hands the QP of the builder to qpOASES as it is.
+  class QPOasesSolver : public QPOasesSolverBase
+  {
+    public:
+      QPOasesSolver() : H_values_( 0 ), A_values_( 0 ) {}
+
+      virtual QPSolver* clone() const
+      {
+        return new QPOasesSolver(*this);
+      }
+
+      virtual void init(const QPProblemBuilder& qp)
+      {
+        setup_problem(qp, qpOASES::HST_UNKNOWN);
+        H_.reset();
+        A_.reset();
+      }
+
+      virtual qpOASES::returnValue solve(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime, const QPWorkingSet* guess)
+      {
+        create_matrices(qp);
+        return init_problem(H_.get(), qp.get_g().data(), A_.get(), qp.get_lb().data(),
+            qp.get_ub().data(), qp.get_lbA().data(), qp.get_ubA().data(), nWSR, cputime, guess);
+      }
+
+      virtual qpOASES::returnValue hotstart(const QPProblemBuilder& qp, int& nWSR,
+          double* cputime)
+      {
+        // NOTE: After copying a controller, the views still point into the original.
+        bool new_matrices = !H_ || H_values_ != H_values(qp) || A_values_ != A_values(qp);
+        if(new_matrices)
+          create_matrices(qp);
+
+        return hotstart_problem(H_.get(), qp.get_g().data(), A_.get(), qp.get_lb().data(),
+            qp.get_ub().data(), qp.get_lbA().data(), qp.get_ubA().data(), nWSR, cputime,
+            qp.has_constant_matrices() && !new_matrices);
+      }
+
+      virtual void get_primal_solution(Eigen::VectorXd& x) const
+      {
+        qp_problem_.getPrimalSolution(x.data());
+      }
+
+    private:
+      // qpOASES views on the H and A of the builder. The solver keeps pointers
+      // to them between calls, so they live as long as the solver.
+      boost::shared_ptr<qpOASES::SymmetricMatrix> H_;
+      boost::shared_ptr<qpOASES::Matrix> A_;
+      std::vector<qpOASES::sparse_int_t> sparse_H_rows_, sparse_H_cols_, sparse_A_rows_, sparse_A_cols_;
+      const double* H_values_;
+      const double* A_values_;
+
+      static const double* H_values(const QPProblemBuilder& qp)
+      {
+        return qp.is_sparse() ? qp.get_sparse_H().valuePtr() : qp.get_H().data();
+      }
+
+      static const double* A_values(const QPProblemBuilder& qp)
+      {
+        return qp.is_sparse() ? qp.get_sparse_A().valuePtr() : qp.get_A().data();
+      }
+
+      // Creates the qpOASES views on H and A of the builder. With the same views
+      // in every hotstart, qpOASES does not wrap the raw arrays anew each time.
+      // NOTE: qpOASES only reads the values, but does not take them as const.
+      void create_matrices(const QPProblemBuilder& qp)
+      {
+        H_values_ = H_values(qp);
+        A_values_ = A_values(qp);
+
+        if(!qp.is_sparse())
+        {
+          const QPProblemBuilder::Matrix& H = qp.get_H();
+          const QPProblemBuilder::Matrix& A = qp.get_A();
+          // row-major, just like the builder stores them
+          H_ = boost::shared_ptr<qpOASES::SymDenseMat>(new qpOASES::SymDenseMat(
+              H.rows(), H.cols(), H.cols(), const_cast<double*>(H_values_)));
+          A_ = boost::shared_ptr<qpOASES::DenseMatrix>(new qpOASES::DenseMatrix(
+              A.rows(), A.cols(), A.cols(), const_cast<double*>(A_values_)));
+          return;
+        }
+
+        const QPProblemBuilder::SparseMatrix& H = qp.get_sparse_H();
+        const QPProblemBuilder::SparseMatrix& A = qp.get_sparse_A();
+
+        sparse_H_rows_.assign(H.innerIndexPtr(), H.innerIndexPtr() + H.nonZeros());
+        sparse_H_cols_.assign(H.outerIndexPtr(), H.outerIndexPtr() + H.outerSize() + 1);
+        sparse_A_rows_.assign(A.innerIndexPtr(), A.innerIndexPtr() + A.nonZeros());
+        sparse_A_cols_.assign(A.outerIndexPtr(), A.outerIndexPtr() + A.outerSize() + 1);
+
+        boost::shared_ptr<qpOASES::SymSparseMat> sparse_H(new qpOASES::SymSparseMat(
+            H.rows(), H.cols(), sparse_H_rows_.data(), sparse_H_cols_.data(),
+            const_cast<double*>(H_values_)));
+        sparse_H->createDiagInfo();
+        H_ = sparse_H;
+        A_ = boost::shared_ptr<qpOASES::SparseMatrix>(new qpOASES::SparseMatrix(
+            A.rows(), A.cols(), sparse_A_rows_.data(), sparse_A_cols_.data(),
+            const_cast<double*>(A_values_)));
+      }
+  };
+}
+
+#endif // GISKARD_CORE_QP_SOLVER_HPP
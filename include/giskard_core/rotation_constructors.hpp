@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_ROTATION_CONSTRUCTORS_HPP
+#define GISKARD_CORE_ROTATION_CONSTRUCTORS_HPP
+
+#include <kdl/frames.hpp>
+#include <kdl/expressiontree.hpp>
+
+namespace giskard_core
+{
+  // Rotation of the quaternion (v, w). Normalizes the quaternion on the fly,
+  // so it only takes products and one division.
+  inline KDL::Rotation quaternion_to_rotation(const KDL::Vector& v, double w)
+  {
+    double n2 = KDL::dot(v, v) + w*w;
+    if (n2 == 0.0)
+      return KDL::Rotation::Identity();
+
+    double s = 2.0 / n2;
+    double x = v.x(), y = v.y(), z = v.z();
+    return KDL::Rotation(
+        1.0 - s*(y*y + z*z), s*(x*y - z*w), s*(x*z + y*w),
+        s*(x*y + z*w), 1.0 - s*(x*x + z*z), s*(y*z - x*w),
+        s*(x*z - y*w), s*(y*z + x*w), 1.0 - s*(x*x + y*y));
+  }
+}
+
+namespace KDL
+{
+  class Quaternion_Rotation:
+      public BinaryExpression<KDL::Rotation, KDL::Vector, double>
+  {
+    public:
+      typedef BinaryExpression<KDL::Rotation, KDL::Vector, double> BExpr;
+    public:
+      Quaternion_Rotation() {}
+      Quaternion_Rotation( const BExpr::Argument1Expr::Ptr& arg1,
+                           const BExpr::Argument2Expr::Ptr& arg2) : BExpr("quaternion_rotation",arg1,arg2) {}
+      virtual KDL::Rotation value()
+      {
+        v_ = argument1->value();
+        w_ = argument2->value();
+        return giskard_core::quaternion_to_rotation(v_, w_);
+      }
+      virtual KDL::Vector derivative(int i)
+      {
+        // angular velocity of the normalized quaternion
+        double n2 = dot(v_, v_) + w_*w_;
+        if (n2 == 0.0)
+          return KDL::Vector::Zero();
+
+        KDL::Vector dv = argument1->derivative(i);
+        double dw = argument2->derivative(i);
+        return (2.0 / n2) * (w_*dv - dw*v_ + v_*dv);
+      }
+      virtual Expression<Vector>::Ptr derivativeExpression(int i)
+      {
+        Expression<Vector>::Ptr dv = argument1->derivativeExpression(i);
+        Expression<double>::Ptr dw = argument2->derivativeExpression(i);
+        Expression<double>::Ptr n2 = dot(argument1, argument1) + argument2*argument2;
+        // the zero quaternion maps onto the identity
+        return conditional<Vector>(-n2, Constant(KDL::Vector::Zero()),
+            (Constant(2.0) / n2) * (argument2*dv - dw*argument1 + cross(argument1, dv)));
+      }
+      virtual BExpr::Ptr clone()
+      {
+        BExpr::Ptr expr( new Quaternion_Rotation( argument1->clone(), argument2->clone()));
+        return expr;
+      }
+    private:
+      KDL::Vector v_;
+      double w_;
+  };
+
+  class Matrix_Rotation:
+      public TernaryExpression<KDL::Rotation, KDL::Vector, KDL::Vector, KDL::Vector>
+  {
+    public:
+      typedef TernaryExpression<KDL::Rotation, KDL::Vector, KDL::Vector, KDL::Vector> TExpr;
+    public:
+      Matrix_Rotation() {}
+      Matrix_Rotation( const TExpr::Argument1Expr::Ptr& arg1,
+                       const TExpr::Argument2Expr::Ptr& arg2,
+                       const TExpr::Argument3Expr::Ptr& arg3) : TExpr("matrix_rotation",arg1,arg2,arg3) {}
+      virtual KDL::Rotation value()
+      {
+        x_ = argument1->value();
+        y_ = argument2->value();
+        z_ = argument3->value();
+        return KDL::Rotation(x_, y_, z_);
+      }
+      virtual KDL::Vector derivative(int i)
+      {
+        // every column c moves with dc = w x c
+        return 0.5 * (x_*argument1->derivative(i) + y_*argument2->derivative(i) +
+            z_*argument3->derivative(i));
+      }
+      virtual Expression<Vector>::Ptr derivativeExpression(int i)
+      {
+        return Constant(0.5) * (cross(argument1, argument1->derivativeExpression(i)) +
+            cross(argument2, argument2->derivativeExpression(i)) +
+            cross(argument3, argument3->derivativeExpression(i)));
+      }
+      virtual TExpr::Ptr clone()
+      {
+        TExpr::Ptr expr( new Matrix_Rotation( argument1->clone(), argument2->clone(), argument3->clone()));
+        return expr;
+      }
+    private:
+      KDL::Vector x_, y_, z_;
+  };
+
+  // Rotation of the quaternion (v, w), which does not need to be normalized.
+  inline Expression<KDL::Rotation>::Ptr quaternion_rotation( Expression<KDL::Vector>::Ptr v,
+      Expression<double>::Ptr w)
+  {
+    Expression<KDL::Rotation>::Ptr expr(new Quaternion_Rotation(v,w));
+    return expr;
+  }
+
+  // Rotation with the columns x, y and z, which need to be orthonormal.
+  inline Expression<KDL::Rotation>::Ptr matrix_rotation( Expression<KDL::Vector>::Ptr x,
+      Expression<KDL::Vector>::Ptr y, Expression<KDL::Vector>::Ptr z)
+  {
+    Expression<KDL::Rotation>::Ptr expr(new Matrix_Rotation(x,y,z));
+    return expr;
+  }
+}
+
+#endif // GISKARD_CORE_ROTATION_CONSTRUCTORS_HPP
@@ -23,6 +23,7 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <stdexcept>
 #include <giskard_core/expressiontree.hpp>
 
@@ -33,7 +34,24 @@ namespace giskard_core
     tJoint,
     tVector3,
     tRotation,
-    tFrame
+    tFrame,
+    tQuaternionFrame,
+    tMatrixFrame
+  };
+
+  class SpecCache;
+  typedef typename boost::shared_ptr<SpecCache> SpecCachePtr;
+  typedef typename boost::shared_ptr< std::set<std::string> > ReferenceLogPtr;
+
+  // Position of an input of type T in the observable vector. Resolve it once,
+  // e.g. with Scope::get_input_handle, to set the input without any lookup.
+  template<typename T>
+  struct InputHandle
+  {
+    InputHandle() : idx_( 0 ) {}
+    explicit InputHandle(size_t idx) : idx_( idx ) {}
+
+    size_t idx_;
   };
 
   class Scope
@@ -90,6 +108,26 @@ namespace giskard_core
         InputType get_type() const { return tFrame; };
         const KDL::Expression<KDL::Frame>::Ptr expr_;
       };
+
+      // Frame with the rotation encoded as quaternion: qx, qy, qz, qw, x, y, z
+      struct QuaternionFrameInput : public AInput {
+        QuaternionFrameInput(std::string name, size_t idx, KDL::Expression<KDL::Frame>::Ptr expr)
+          : AInput(name, idx), expr_(expr) {}
+
+        static std::string type_string() { return "quaternion-frame"; }
+        InputType get_type() const { return tQuaternionFrame; };
+        const KDL::Expression<KDL::Frame>::Ptr expr_;
+      };
+
+      // Frame with the rotation encoded as row-major 3x3 matrix, followed by x, y, z
+      struct MatrixFrameInput : public AInput {
+        MatrixFrameInput(std::string name, size_t idx, KDL::Expression<KDL::Frame>::Ptr expr)
+          : AInput(name, idx), expr_(expr) {}
+
+        static std::string type_string() { return "matrix-frame"; }
+        InputType get_type() const { return tMatrixFrame; };
+        const KDL::Expression<KDL::Frame>::Ptr expr_;
+      };
       
       typedef typename boost::shared_ptr<AInput> InputPtr;
       typedef typename boost::shared_ptr<const AInput> ConstInputPtr;
@@ -98,10 +136,13 @@ namespace giskard_core
       typedef typename boost::shared_ptr<Vec3Input> Vec3InputPtr;
       typedef typename boost::shared_ptr<RotationInput> RotationInputPtr;
       typedef typename boost::shared_ptr<FrameInput> FrameInputPtr;
+      typedef typename boost::shared_ptr<QuaternionFrameInput> QuaternionFrameInputPtr;
+      typedef typename boost::shared_ptr<MatrixFrameInput> MatrixFrameInputPtr;
 
       Scope() 
       : bJointvectorCompleted(false)
-      , nextInputIndex(0) {}
+      , nextInputIndex(0)
+      , fold_constants_(false) {}
 
       const KDL::Expression<double>::Ptr& find_double_expression(const std::string& reference_name) const
       {
@@ -148,6 +189,11 @@ namespace giskard_core
         return boost::dynamic_pointer_cast<T>(inputs_.find(input_name)->second);
       }
 
+      template<typename T>
+      InputHandle<T> get_input_handle(const std::string& input_name) const {
+        return InputHandle<T>(find_input<T>(input_name)->idx_);
+      }
+
       bool has_double_expression(const std::string& expression_name) const
       {
         return (double_references_.find(expression_name) != double_references_.end());
@@ -297,6 +343,47 @@ namespace giskard_core
         }
       }
 
+      void add_quaternion_frame_input(const std::string& name) {
+        auto it = inputs_.find(name);
+        if (it != inputs_.end()) {
+          if (it->second->get_type() != tQuaternionFrame)
+            throw std::invalid_argument("Can't add quaternion frame input with name '" + name + "'. The name is already taken.");
+        } else {
+          bJointvectorCompleted = true;
+          KDL::Expression<KDL::Frame>::Ptr expr = KDL::frame(KDL::quaternion_rotation(KDL::vector(KDL::input(nextInputIndex),
+                                                                                                 KDL::input(nextInputIndex + 1),
+                                                                                                 KDL::input(nextInputIndex + 2)),
+                                                                                     KDL::input(nextInputIndex + 3)),
+                                                            KDL::vector(KDL::input(nextInputIndex + 4),
+                                                                        KDL::input(nextInputIndex + 5),
+                                                                        KDL::input(nextInputIndex + 6)));
+          inputs_[name] = QuaternionFrameInputPtr(new QuaternionFrameInput(name, nextInputIndex, expr));
+          nextInputIndex += 7;
+        }
+      }
+
+      void add_matrix_frame_input(const std::string& name) {
+        auto it = inputs_.find(name);
+        if (it != inputs_.end()) {
+          if (it->second->get_type() != tMatrixFrame)
+            throw std::invalid_argument("Can't add matrix frame input with name '" + name + "'. The name is already taken.");
+        } else {
+          bJointvectorCompleted = true;
+          // the columns of the row-major matrix
+          KDL::Expression<KDL::Vector>::Ptr columns[3];
+          for (size_t i = 0; i < 3; ++i)
+            columns[i] = KDL::vector(KDL::input(nextInputIndex + i),
+                                     KDL::input(nextInputIndex + i + 3),
+                                     KDL::input(nextInputIndex + i + 6));
+          KDL::Expression<KDL::Frame>::Ptr expr = KDL::frame(KDL::matrix_rotation(columns[0], columns[1], columns[2]),
+                                                            KDL::vector(KDL::input(nextInputIndex + 9),
+                                                                        KDL::input(nextInputIndex + 10),
+                                                                        KDL::input(nextInputIndex + 11)));
+          inputs_[name] = MatrixFrameInputPtr(new MatrixFrameInput(name, nextInputIndex, expr));
+          nextInputIndex += 12;
+        }
+      }
+
       // Get the size of the observable vector
       size_t get_input_size() const {
         return nextInputIndex;
@@ -439,6 +526,41 @@ namespace giskard_core
         return frame_references_; 
       }
 
+      // While set, specifications look up their expressions in this cache
+      // before generating them, see SpecCache.
+      const SpecCachePtr& get_spec_cache() const {
+        return spec_cache_;
+      }
+
+      void set_spec_cache(const SpecCachePtr& spec_cache) {
+        spec_cache_ = spec_cache;
+      }
+
+      // While set, specifications whose expressions do not depend on any
+      // input are replaced by a single constant.
+      bool get_fold_constants() const {
+        return fold_constants_;
+      }
+
+      void set_fold_constants(bool fold_constants) {
+        fold_constants_ = fold_constants;
+      }
+
+      // While set, collects the names of all references that specifications
+      // resolve during generation.
+      const ReferenceLogPtr& get_reference_log() const {
+        return reference_log_;
+      }
+
+      void set_reference_log(const ReferenceLogPtr& reference_log) {
+        reference_log_ = reference_log;
+      }
+
+      void log_reference(const std::string& reference_name) const {
+        if(reference_log_)
+          reference_log_->insert(reference_name);
+      }
+
 private:
       bool bJointvectorCompleted;
       size_t nextInputIndex;
@@ -448,7 +570,19 @@ private:
       std::map< std::string, KDL::Expression<KDL::Vector>::Ptr > vector_references_;
       std::map< std::string, KDL::Expression<KDL::Rotation>::Ptr > rotation_references_;
       std::map< std::string, KDL::Expression<KDL::Frame>::Ptr > frame_references_;
+
+      SpecCachePtr spec_cache_;
+      bool fold_constants_;
+      ReferenceLogPtr reference_log_;
   };
+
+  typedef InputHandle<Scope::JointInput> JointInputHandle;
+  typedef InputHandle<Scope::ScalarInput> ScalarInputHandle;
+  typedef InputHandle<Scope::Vec3Input> Vec3InputHandle;
+  typedef InputHandle<Scope::RotationInput> RotationInputHandle;
+  typedef InputHandle<Scope::FrameInput> FrameInputHandle;
+  typedef InputHandle<Scope::QuaternionFrameInput> QuaternionFrameInputHandle;
+  typedef InputHandle<Scope::MatrixFrameInput> MatrixFrameInputHandle;
 }
 
 #endif // GISKARD_CORE_SCOPE_HPP
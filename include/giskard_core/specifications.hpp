@@ -24,6 +24,9 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <set>
+#include <typeinfo>
+#include <vector>
 #include <boost/lexical_cast.hpp>
 #include <giskard_core/expressiontree.hpp>
 #include <giskard_core/scope.hpp>
@@ -60,6 +63,144 @@ namespace giskard_core
 
   typedef typename boost::shared_ptr<Spec> SpecPtr;
 
+  inline bool is_cacheable(const Spec& spec);
+
+  template<typename T>
+  bool is_constant(const typename KDL::Expression<T>::Ptr& expression)
+  {
+    std::set<int> dependencies;
+    expression->getDependencies(dependencies);
+    return dependencies.empty();
+  }
+
+  // Hash-conses specifications during generation, so that structurally equal
+  // specifications share one expression. Generation runs twice: the first pass
+  // counts how often every specification occurs. In the second pass, the
+  // expressions of specifications that occur more than once are cached.
+  // NOTE: Equality is the one of Spec::equals, i.e. constants are compared
+  //       with a tolerance of KDL::epsilon.
+  class SpecCache
+  {
+    public:
+      SpecCache() : sharing_( false ) {}
+
+      // Ends the counting pass. Forgets the expressions, and keeps the counts.
+      void start_sharing()
+      {
+        sharing_ = true;
+        for(std::map<std::string, std::vector<Entry> >::iterator it=entries_.begin(); it!=entries_.end(); ++it)
+          for(size_t i=0; i<it->second.size(); ++i)
+            it->second[i].expression_.reset();
+      }
+
+      template<typename T>
+      typename KDL::Expression<T>::Ptr find(const Spec& spec)
+      {
+        Entry* entry = find_entry(spec);
+        if(!entry || !entry->expression_)
+          return typename KDL::Expression<T>::Ptr();
+
+        if(!sharing_)
+          ++entry->count_;
+        return boost::static_pointer_cast< KDL::Expression<T> >(entry->expression_);
+      }
+
+      template<typename T>
+      typename KDL::Expression<T>::Ptr insert(const Spec& spec, const typename KDL::Expression<T>::Ptr& expression)
+      {
+        Entry* entry = find_entry(spec);
+        if(!entry)
+        {
+          Entry new_entry;
+          new_entry.spec_ = &spec;
+          new_entry.count_ = 1;
+          std::vector<Entry>& bucket = entries_[key(spec)];
+          bucket.push_back(new_entry);
+          entry = &bucket.back();
+        }
+
+        typename KDL::Expression<T>::Ptr result = (sharing_ && entry->count_ > 1 &&
+            !is_constant<T>(expression)) ? KDL::cached<T>(expression) : expression;
+        entry->expression_ = result;
+        return result;
+      }
+
+      // Number of specifications that occur more than once.
+      size_t num_shared() const
+      {
+        size_t result = 0;
+        for(std::map<std::string, std::vector<Entry> >::const_iterator it=entries_.begin(); it!=entries_.end(); ++it)
+          for(size_t i=0; i<it->second.size(); ++i)
+            if(it->second[i].count_ > 1)
+              ++result;
+        return result;
+      }
+
+    private:
+      struct Entry
+      {
+        const Spec* spec_;
+        size_t count_;
+        boost::shared_ptr<void> expression_;
+      };
+
+      std::map<std::string, std::vector<Entry> > entries_;
+      bool sharing_;
+
+      // Equal specifications have equal keys, so only entries in the same
+      // bucket need a full comparison.
+      std::string key(const Spec& spec) const
+      {
+        std::vector<const InputSpec*> inputs;
+        spec.get_input_specs(inputs);
+        std::string result = typeid(spec).name();
+        for(size_t i=0; i<inputs.size(); ++i)
+          result += " " + input_name(inputs[i]);
+        return result;
+      }
+
+      // defined below InputSpec
+      static std::string input_name(const InputSpec* input);
+
+      Entry* find_entry(const Spec& spec)
+      {
+        std::map<std::string, std::vector<Entry> >::iterator it = entries_.find(key(spec));
+        if(it == entries_.end())
+          return 0;
+
+        for(size_t i=0; i<it->second.size(); ++i)
+          if(it->second[i].spec_ == &spec || it->second[i].spec_->equals(spec))
+            return &(it->second[i]);
+        return 0;
+      }
+  };
+
+  // Children are generated through get_expression as well, so constant
+  // subtrees are folded bottom-up and are never evaluated more than once.
+  template<typename T, typename S>
+  typename KDL::Expression<T>::Ptr get_folded_expression(S& spec, const giskard_core::Scope& scope)
+  {
+    typename KDL::Expression<T>::Ptr result = spec.generate_expression(scope);
+    if(scope.get_fold_constants() && is_cacheable(spec) && is_constant<T>(result))
+      return KDL::Constant(result->value());
+
+    return result;
+  }
+
+  template<typename T, typename S>
+  typename KDL::Expression<T>::Ptr get_cached_expression(S& spec, const giskard_core::Scope& scope)
+  {
+    const SpecCachePtr& cache = scope.get_spec_cache();
+    if(!cache || !is_cacheable(spec))
+      return get_folded_expression<T>(spec, scope);
+
+    typename KDL::Expression<T>::Ptr result = cache->find<T>(spec);
+    if(result)
+      return result;
+
+    return cache->insert<T>(spec, get_folded_expression<T>(spec, scope));
+  }
+
   ///
   /// next level of expression specifications
   ///
@@ -69,7 +210,12 @@ namespace giskard_core
     public:
       virtual bool equals(const Spec& other) const = 0;
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope) = 0;
+      KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      {
+        return get_cached_expression<double>(*this, scope);
+      }
+
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope) = 0;
   };
 
   typedef typename boost::shared_ptr<DoubleSpec> DoubleSpecPtr;
@@ -78,7 +224,12 @@ namespace giskard_core
   {
     public:
       virtual bool equals(const Spec& other) const = 0;
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope) = 0;
+      KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      {
+        return get_cached_expression<KDL::Vector>(*this, scope);
+      }
+
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope) = 0;
   };
 
   typedef typename boost::shared_ptr<VectorSpec> VectorSpecPtr;
@@ -87,7 +238,12 @@ namespace giskard_core
   {
     public:
       virtual bool equals(const Spec& other) const = 0;
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope) = 0;
+      KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      {
+        return get_cached_expression<KDL::Rotation>(*this, scope);
+      }
+
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope) = 0;
   };
 
   typedef typename boost::shared_ptr<RotationSpec> RotationSpecPtr;
@@ -97,7 +253,12 @@ namespace giskard_core
     public:
       virtual bool equals(const Spec& other) const = 0;
 
-      virtual KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope) = 0;
+      KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope)
+      {
+        return get_cached_expression<KDL::Frame>(*this, scope);
+      }
+
+      virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope) = 0;
   };
 
   typedef typename boost::shared_ptr<FrameSpec> FrameSpecPtr;
@@ -136,6 +297,11 @@ namespace giskard_core
     InputType type_;
   };
 
+  inline std::string SpecCache::input_name(const InputSpec* input)
+  {
+    return input->get_name()->get_value();
+  }
+
   typedef typename boost::shared_ptr<InputSpec> InputSpecPtr;
 
   ///
@@ -190,7 +356,7 @@ namespace giskard_core
       return dynamic_cast<const DoubleInputSpec*>(&other) && dynamic_cast<const DoubleInputSpec*>(&other)->input_equals(this);
     }
 
-    virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope) {
+    virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope) {
         return scope.find_input<Scope::ScalarInput>(get_name()->get_value())->expr_;
     }
   };
@@ -211,7 +377,7 @@ namespace giskard_core
       return dynamic_cast<const JointInputSpec*>(&other) && dynamic_cast<const JointInputSpec*>(&other)->input_equals(this);
     }
 
-    virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope) {
+    virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope) {
         return scope.find_input<Scope::JointInput>(get_name()->get_value())->expr_;
     }
   };
@@ -248,7 +414,7 @@ namespace giskard_core
             std::abs(dynamic_cast<const DoubleConstSpec*>(&other)->get_value() - this->get_value());
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::Constant(get_value());
       }
@@ -287,8 +453,9 @@ namespace giskard_core
         return (dynamic_cast<const DoubleReferenceSpec*>(&other)->get_reference_name().compare(this->get_reference_name()) == 0);
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
+        scope.log_reference(get_reference_name());
         return scope.find_double_expression(get_reference_name());
       }
 
@@ -345,7 +512,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         KDL::Expression<double>::Ptr result = KDL::Constant(0.0);
         using KDL::operator+;
@@ -408,7 +575,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         if(get_inputs().size() == 0)
           throw std::length_error("Found DoubleSubtractionSpec with zero inputs.");
@@ -462,7 +629,7 @@ namespace giskard_core
         return dynamic_cast<const DoubleNormOfSpec*>(&other)->get_vector()->equals(*(this->get_vector()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::norm(get_vector()->get_expression(scope));
       }
@@ -520,7 +687,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         KDL::Expression<double>::Ptr result = KDL::Constant(1.0);
 
@@ -584,7 +751,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         if(get_inputs().size() == 0)
           throw std::length_error("Found DoubleDivisionSpec with zero inputs.");
@@ -638,7 +805,7 @@ namespace giskard_core
         return dynamic_cast<const DoubleXCoordOfSpec*>(&other)->get_vector()->equals(*(this->get_vector()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::coord_x(get_vector()->get_expression(scope));
       }
@@ -674,7 +841,7 @@ namespace giskard_core
         return dynamic_cast<const DoubleYCoordOfSpec*>(&other)->get_vector()->equals(*(this->get_vector()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::coord_y(get_vector()->get_expression(scope));
       }
@@ -710,7 +877,7 @@ namespace giskard_core
         return dynamic_cast<const DoubleZCoordOfSpec*>(&other)->get_vector()->equals(*(this->get_vector()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::coord_z(get_vector()->get_expression(scope));
       }
@@ -762,7 +929,7 @@ namespace giskard_core
             get_rhs()->equals(*(other_p->get_rhs()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::dot(get_lhs()->get_expression(scope), get_rhs()->get_expression(scope));
       }
@@ -814,7 +981,7 @@ namespace giskard_core
             get_rhs()->equals(*(other_p->get_rhs()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::minimum(get_lhs()->get_expression(scope), get_rhs()->get_expression(scope));
       }
@@ -866,7 +1033,7 @@ namespace giskard_core
             get_rhs()->equals(*(other_p->get_rhs()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::maximum(get_lhs()->get_expression(scope), get_rhs()->get_expression(scope));
       }
@@ -905,7 +1072,7 @@ namespace giskard_core
             get_value()->equals(*(other_p->get_value()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::abs(get_value()->get_expression(scope));
       }
@@ -969,7 +1136,7 @@ namespace giskard_core
             get_else()->equals(*(other_p->get_else()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::conditional<double>(get_condition()->get_expression(scope), get_if()->get_expression(scope), get_else()->get_expression(scope));
       }
@@ -1027,7 +1194,7 @@ namespace giskard_core
                (get_denominator()->equals(*( other_p->get_denominator())));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         // note: This expression only expects a TRUE expressions for the nominator.
         //       While this makes sense, it does break code symmetry.
@@ -1072,7 +1239,7 @@ namespace giskard_core
             get_value()->equals(*(other_p->get_value()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::sin(get_value()->get_expression(scope));
       }
@@ -1111,7 +1278,7 @@ namespace giskard_core
             get_value()->equals(*(other_p->get_value()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::cos(get_value()->get_expression(scope));
       }
@@ -1150,7 +1317,7 @@ namespace giskard_core
             get_value()->equals(*(other_p->get_value()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::tan(get_value()->get_expression(scope));
       }
@@ -1190,7 +1357,7 @@ namespace giskard_core
             get_value()->equals(*(other_p->get_value()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::asin(get_value()->get_expression(scope));
       }
@@ -1229,7 +1396,7 @@ namespace giskard_core
             get_value()->equals(*(other_p->get_value()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::acos(get_value()->get_expression(scope));
       }
@@ -1268,7 +1435,7 @@ namespace giskard_core
             get_value()->equals(*(other_p->get_value()));
       }
 
-      virtual KDL::Expression<double>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<double>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::atan(get_value()->get_expression(scope));
       }
@@ -1296,7 +1463,7 @@ namespace giskard_core
       return dynamic_cast<const VectorInputSpec*>(&other) && dynamic_cast<const VectorInputSpec*>(&other)->input_equals(this);
     }
 
-    virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope) {
+    virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope) {
         return scope.find_input<Scope::Vec3Input>(get_name()->get_value())->expr_;
     }
   };
@@ -1331,9 +1498,15 @@ namespace giskard_core
             get_vector()->equals(*(other_p->get_vector()));
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
-        return KDL::cached<KDL::Vector>(get_vector()->get_expression(scope));
+        // NOTE: Caching a constant gains nothing, and cached expressions
+        //       only hold a value once an optimizer has updated them.
+        KDL::Expression<KDL::Vector>::Ptr vector = get_vector()->get_expression(scope);
+        if(scope.get_fold_constants() && is_constant<KDL::Vector>(vector))
+          return vector;
+
+        return KDL::cached<KDL::Vector>(vector);
       }
 
     private:
@@ -1416,7 +1589,7 @@ namespace giskard_core
         return get_x().get() && get_y().get() && get_z().get();
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::vector(get_x()->get_expression(scope), 
             get_y()->get_expression(scope), get_z()->get_expression(scope));
@@ -1481,7 +1654,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         using KDL::operator+;
 
@@ -1546,7 +1719,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         if(get_inputs().size() == 0)
           throw std::length_error("Found VectorSubtractionSpec with zero inputs.");
@@ -1598,8 +1771,9 @@ namespace giskard_core
         return (dynamic_cast<const VectorReferenceSpec*>(&other)->get_reference_name().compare(this->get_reference_name()) == 0);
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
+        scope.log_reference(get_reference_name());
         return scope.find_vector_expression(get_reference_name());
       }
 
@@ -1634,7 +1808,7 @@ namespace giskard_core
         return dynamic_cast<const VectorOriginOfSpec*>(&other)->get_frame()->equals(*(this->get_frame()));
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::origin(get_frame()->get_expression(scope));
       }
@@ -1685,7 +1859,7 @@ namespace giskard_core
             get_vector()->equals(*(other_p->get_vector()));
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         using KDL::operator*;
 
@@ -1739,7 +1913,7 @@ namespace giskard_core
             get_vector()->equals(*(other_p->get_vector()));
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         using KDL::operator*;
 
@@ -1795,7 +1969,7 @@ namespace giskard_core
             get_vector()->equals(*(other_p->get_vector()));
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         using KDL::operator*;
 
@@ -1834,7 +2008,7 @@ namespace giskard_core
         return dynamic_cast<const VectorRotationVectorSpec*>(&other)->get_rotation()->equals(*(this->get_rotation()));
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::getRotVec(get_rotation()->get_expression(scope));
       }
@@ -1887,7 +2061,7 @@ namespace giskard_core
             get_rhs()->equals(*(other_p->get_rhs()));
       }
 
-      virtual KDL::Expression<KDL::Vector>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Vector>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::cross(get_lhs()->get_expression(scope), get_rhs()->get_expression(scope));
       }
@@ -1915,7 +2089,7 @@ namespace giskard_core
       return dynamic_cast<const RotationInputSpec*>(&other) && dynamic_cast<const RotationInputSpec*>(&other)->input_equals(this);
     }
 
-    virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope) {
+    virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope) {
         return scope.find_input<Scope::RotationInput>(get_name()->get_value())->expr_;
     }
   };
@@ -1984,7 +2158,7 @@ namespace giskard_core
             (KDL::epsilon > std::abs(dynamic_cast<const RotationQuaternionConstructorSpec*>(&other)->get_y() - this->get_y())) && (KDL::epsilon > std::abs(dynamic_cast<const RotationQuaternionConstructorSpec*>(&other)->get_z() - this->get_z())) && (KDL::epsilon > std::abs(dynamic_cast<const RotationQuaternionConstructorSpec*>(&other)->get_w() - this->get_w()));
       }
 
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::Constant(KDL::Rotation::Quaternion(get_x(), get_y(), get_z(), get_w()));
       }
@@ -2047,7 +2221,7 @@ namespace giskard_core
                (get_axis()->equals(*( other_p->get_axis())));
       }
 
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         // FIXME: add normalization of rotation axis
         return KDL::rotVec(get_axis()->get_expression(scope),
@@ -2120,7 +2294,7 @@ namespace giskard_core
                (get_param()->equals(*( other_p->get_param())));
       }
 
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         // NOTE: This type of expression not part of the original KDL::expressiongraph
         //       library. It is actually part of giskard_core.
@@ -2159,8 +2333,9 @@ namespace giskard_core
         return (dynamic_cast<const RotationReferenceSpec*>(&other)->get_reference_name().compare(this->get_reference_name()) == 0);
       }
 
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
+        scope.log_reference(get_reference_name());
         return scope.find_rotation_expression(get_reference_name());
       }
 
@@ -2203,7 +2378,7 @@ namespace giskard_core
         return dynamic_cast<const InverseRotationSpec*>(&other)->get_rotation()->equals(*(this->get_rotation()));
       }
 
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::inv(get_rotation()->get_expression(scope));
       }
@@ -2275,7 +2450,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         KDL::Expression<KDL::Rotation>::Ptr result = KDL::Constant(KDL::Rotation::Identity());
 
@@ -2314,13 +2489,53 @@ namespace giskard_core
       return dynamic_cast<const FrameInputSpec*>(&other) && dynamic_cast<const FrameInputSpec*>(&other)->input_equals(this);
     }
 
-    virtual KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope) {
+    virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope) {
         return scope.find_input<Scope::FrameInput>(get_name()->get_value())->expr_;
     }
   };
 
   typedef typename boost::shared_ptr<FrameInputSpec> FrameInputSpecPtr;
 
+  class QuaternionFrameInputSpec : public FrameSpec, public InputSpec {
+  public:
+    QuaternionFrameInputSpec(const std::string& name) : InputSpec(const_string_spec(name), tQuaternionFrame) {}
+    QuaternionFrameInputSpec(const StringSpecPtr& name) : InputSpec(name, tQuaternionFrame) {}
+
+    void get_input_specs(std::vector<const InputSpec*>& inputs) const {
+      inputs.push_back(this);
+    }
+
+    virtual bool equals(const Spec& other) const {
+      return dynamic_cast<const QuaternionFrameInputSpec*>(&other) && dynamic_cast<const QuaternionFrameInputSpec*>(&other)->input_equals(this);
+    }
+
+    virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope) {
+        return scope.find_input<Scope::QuaternionFrameInput>(get_name()->get_value())->expr_;
+    }
+  };
+
+  typedef typename boost::shared_ptr<QuaternionFrameInputSpec> QuaternionFrameInputSpecPtr;
+
+  class MatrixFrameInputSpec : public FrameSpec, public InputSpec {
+  public:
+    MatrixFrameInputSpec(const std::string& name) : InputSpec(const_string_spec(name), tMatrixFrame) {}
+    MatrixFrameInputSpec(const StringSpecPtr& name) : InputSpec(name, tMatrixFrame) {}
+
+    void get_input_specs(std::vector<const InputSpec*>& inputs) const {
+      inputs.push_back(this);
+    }
+
+    virtual bool equals(const Spec& other) const {
+      return dynamic_cast<const MatrixFrameInputSpec*>(&other) && dynamic_cast<const MatrixFrameInputSpec*>(&other)->input_equals(this);
+    }
+
+    virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope) {
+        return scope.find_input<Scope::MatrixFrameInput>(get_name()->get_value())->expr_;
+    }
+  };
+
+  typedef typename boost::shared_ptr<MatrixFrameInputSpec> MatrixFrameInputSpecPtr;
+
   class FrameCachedSpec: public FrameSpec
   {
     public:
@@ -2349,9 +2564,14 @@ namespace giskard_core
             get_frame()->equals(*(other_p->get_frame()));
       }
 
-      virtual KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
-        return KDL::cached<KDL::Frame>(get_frame()->get_expression(scope));
+        // NOTE: See VectorCachedSpec.
+        KDL::Expression<KDL::Frame>::Ptr frame = get_frame()->get_expression(scope);
+        if(scope.get_fold_constants() && is_constant<KDL::Frame>(frame))
+          return frame;
+
+        return KDL::cached<KDL::Frame>(frame);
       }
 
     private:
@@ -2415,7 +2635,7 @@ namespace giskard_core
         return get_translation().get() && get_rotation().get();
       }
 
-      virtual KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         KDL::Expression<KDL::Rotation>::Ptr rot = get_rotation()->get_expression(scope);
 
@@ -2469,7 +2689,7 @@ namespace giskard_core
         return dynamic_cast<const OrientationOfSpec*>(&other)->get_frame()->equals(*(this->get_frame()));
       }
 
-      virtual KDL::Expression<KDL::Rotation>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Rotation>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::rotation(get_frame()->get_expression(scope));
       }
@@ -2532,7 +2752,7 @@ namespace giskard_core
         return true;
       }
 
-      virtual KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         KDL::Expression<KDL::Frame>::Ptr result = KDL::Constant(KDL::Frame::Identity());
 
@@ -2572,8 +2792,9 @@ namespace giskard_core
         return (dynamic_cast<const FrameReferenceSpec*>(&other)->get_reference_name().compare(this->get_reference_name()) == 0);
       }
 
-      virtual KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
+        scope.log_reference(get_reference_name());
         return scope.find_frame_expression(get_reference_name());
       }
 
@@ -2616,7 +2837,7 @@ namespace giskard_core
         return dynamic_cast<const InverseFrameSpec*>(&other)->get_frame()->equals(*(this->get_frame()));
       }
 
-      virtual KDL::Expression<KDL::Frame>::Ptr get_expression(const giskard_core::Scope& scope)
+      virtual KDL::Expression<KDL::Frame>::Ptr generate_expression(const giskard_core::Scope& scope)
       {
         return KDL::inv(get_frame()->get_expression(scope));
       }
@@ -2737,7 +2958,25 @@ namespace giskard_core
       std::vector< giskard_core::ControllableConstraintSpec > controllable_constraints_;
       std::vector< giskard_core::SoftConstraintSpec > soft_constraints_;
       std::vector< giskard_core::HardConstraintSpec > hard_constraints_;
+
+      // Names of scope entries that are read back as feedback. When the scope
+      // is pruned, they are kept even if no constraint needs them.
+      std::vector< std::string > monitored_outputs_;
   };
+
+  // Sharing or folding constants, inputs and references saves nothing, and
+  // cached specifications take care of themselves.
+  inline bool is_cacheable(const Spec& spec)
+  {
+    return !dynamic_cast<const InputSpec*>(&spec) &&
+        !dynamic_cast<const DoubleConstSpec*>(&spec) &&
+        !dynamic_cast<const DoubleReferenceSpec*>(&spec) &&
+        !dynamic_cast<const VectorReferenceSpec*>(&spec) &&
+        !dynamic_cast<const RotationReferenceSpec*>(&spec) &&
+        !dynamic_cast<const FrameReferenceSpec*>(&spec) &&
+        !dynamic_cast<const VectorCachedSpec*>(&spec) &&
+        !dynamic_cast<const FrameCachedSpec*>(&spec);
+  }
 }
 
 #endif // GISKARD_CORE_SPECIFICATIONS_HPP
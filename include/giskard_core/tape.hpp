@@ -0,0 +1,603 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_TAPE_HPP
+#define GISKARD_CORE_TAPE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace giskard_core
+{
+  enum TapeOperation {toInput, toConstant, toAdd, toSub, toMul, toDiv, toNeg, toSin, toCos,
+      toTan, toAsin, toAcos, toAtan, toAtan2, toSqrt, toAbs, toFmod, toMin, toMax, toSelect};
+
+  inline std::string to_string(TapeOperation operation)
+  {
+    switch(operation)
+    {
+      case toInput: return "input";
+      case toConstant: return "constant";
+      case toAdd: return "add";
+      case toSub: return "sub";
+      case toMul: return "mul";
+      case toDiv: return "div";
+      case toNeg: return "neg";
+      case toSin: return "sin";
+      case toCos: return "cos";
+      case toTan: return "tan";
+      case toAsin: return "asin";
+      case toAcos: return "acos";
+      case toAtan: return "atan";
+      case toAtan2: return "atan2";
+      case toSqrt: return "sqrt";
+      case toAbs: return "abs";
+      case toFmod: return "fmod";
+      case toMin: return "min";
+      case toMax: return "max";
+      case toSelect: return "select";
+      default: throw std::domain_error("Tape: Unknown operation.");
+    }
+  }
+
+  inline size_t num_arguments(TapeOperation operation)
+  {
+    switch(operation)
+    {
+      case toInput:
+      case toConstant:
+        return 0;
+      case toNeg:
+      case toSin:
+      case toCos:
+      case toTan:
+      case toAsin:
+      case toAcos:
+      case toAtan:
+      case toSqrt:
+      case toAbs:
+        return 1;
+      case toSelect:
+        return 3;
+      default:
+        return 2;
+    }
+  }
+
+  // Applies an operation to already evaluated arguments. Select picks its
+  // second argument if the first is non-negative, like KDL::conditional.
+  inline double evaluate(TapeOperation operation, double a, double b, double c)
+  {
+    switch(operation)
+    {
+      case toAdd: return a + b;
+      case toSub: return a - b;
+      case toMul: return a * b;
+      case toDiv: return a / b;
+      case toNeg: return -a;
+      case toSin: return std::sin(a);
+      case toCos: return std::cos(a);
+      case toTan: return std::tan(a);
+      case toAsin: return std::asin(a);
+      case toAcos: return std::acos(a);
+      case toAtan: return std::atan(a);
+      case toAtan2: return std::atan2(a, b);
+      case toSqrt: return std::sqrt(a);
+      case toAbs: return std::abs(a);
+      case toFmod: return std::fmod(a, b);
+      case toMin: return std::min(a, b);
+      case toMax: return std::max(a, b);
+      case toSelect: return a >= 0.0 ? b : c;
+      default: throw std::domain_error("Tape: Cannot evaluate operation '" + to_string(operation) + "'.");
+    }
+  }
+
+  struct TapeInstruction
+  {
+    TapeInstruction() : operation_( toConstant ), value_( 0.0 )
+    {
+      arguments_[0] = arguments_[1] = arguments_[2] = 0;
+    }
+
+    TapeOperation operation_;
+    size_t arguments_[3];
+    // Value of a constant, or index of the observable read by an input.
+    double value_;
+
+    bool operator<(const TapeInstruction& other) const
+    {
+      if(operation_ != other.operation_)
+        return operation_ < other.operation_;
+      for(size_t i=0; i<3; ++i)
+        if(arguments_[i] != other.arguments_[i])
+          return arguments_[i] < other.arguments_[i];
+      // NOTE: Comparing the bits keeps this a strict ordering, even for NaN.
+      uint64_t lhs, rhs;
+      std::memcpy(&lhs, &value_, sizeof(double));
+      std::memcpy(&rhs, &other.value_, sizeof(double));
+      return lhs < rhs;
+    }
+  };
+
+  // A flat, topologically sorted list of scalar instructions. Every instruction
+  // only refers to instructions before it. Building an instruction that already
+  // exists returns the existing one, and operations on constants are folded
+  // right away. Hence, the tape never contains common sub-expressions.
+  class Tape
+  {
+    public:
+      Tape() : num_derivatives_( 0 ), num_inputs_( 0 ) {}
+
+      size_t size() const
+      {
+        return instructions_.size();
+      }
+
+      const std::vector<TapeInstruction>& get_instructions() const
+      {
+        return instructions_;
+      }
+
+      const TapeInstruction& get_instruction(size_t index) const
+      {
+        return instructions_[index];
+      }
+
+      // Number of observables read by the tape.
+      size_t num_inputs() const
+      {
+        return num_inputs_;
+      }
+
+      bool is_constant(size_t index) const
+      {
+        return instructions_[index].operation_ == toConstant;
+      }
+
+      bool is_constant(size_t index, double value) const
+      {
+        return is_constant(index) && instructions_[index].value_ == value;
+      }
+
+      size_t input(size_t index)
+      {
+        TapeInstruction instruction;
+        instruction.operation_ = toInput;
+        instruction.value_ = index;
+        num_inputs_ = std::max(num_inputs_, index + 1);
+        return push(instruction);
+      }
+
+      size_t constant(double value)
+      {
+        TapeInstruction instruction;
+        instruction.operation_ = toConstant;
+        instruction.value_ = value;
+        return push(instruction);
+      }
+
+      size_t add(size_t a, size_t b)
+      {
+        if(is_constant(a, 0.0))
+          return b;
+        if(is_constant(b, 0.0))
+          return a;
+        return push(toAdd, std::min(a, b), std::max(a, b));
+      }
+
+      size_t sub(size_t a, size_t b)
+      {
+        if(a == b)
+          return constant(0.0);
+        if(is_constant(b, 0.0))
+          return a;
+        if(is_constant(a, 0.0))
+          return neg(b);
+        return push(toSub, a, b);
+      }
+
+      size_t mul(size_t a, size_t b)
+      {
+        if(is_constant(a, 0.0) || is_constant(b, 0.0))
+          return constant(0.0);
+        if(is_constant(a, 1.0))
+          return b;
+        if(is_constant(b, 1.0))
+          return a;
+        if(is_constant(a, -1.0))
+          return neg(b);
+        if(is_constant(b, -1.0))
+          return neg(a);
+        return push(toMul, std::min(a, b), std::max(a, b));
+      }
+
+      size_t div(size_t a, size_t b)
+      {
+        if(is_constant(a, 0.0))
+          return constant(0.0);
+        if(is_constant(b, 1.0))
+          return a;
+        return push(toDiv, a, b);
+      }
+
+      size_t neg(size_t a)
+      {
+        if(instructions_[a].operation_ == toNeg)
+          return instructions_[a].arguments_[0];
+        return push(toNeg, a);
+      }
+
+      size_t sin(size_t a) { return push(toSin, a); }
+      size_t cos(size_t a) { return push(toCos, a); }
+      size_t tan(size_t a) { return push(toTan, a); }
+      size_t asin(size_t a) { return push(toAsin, a); }
+      size_t acos(size_t a) { return push(toAcos, a); }
+      size_t atan(size_t a) { return push(toAtan, a); }
+      size_t atan2(size_t y, size_t x) { return push(toAtan2, y, x); }
+      size_t sqrt(size_t a) { return push(toSqrt, a); }
+      size_t abs(size_t a) { return push(toAbs, a); }
+      size_t fmod(size_t a, size_t b) { return push(toFmod, a, b); }
+
+      size_t minimum(size_t a, size_t b)
+      {
+        if(a == b)
+          return a;
+        return push(toMin, std::min(a, b), std::max(a, b));
+      }
+
+      size_t maximum(size_t a, size_t b)
+      {
+        if(a == b)
+          return a;
+        return push(toMax, std::min(a, b), std::max(a, b));
+      }
+
+      size_t select(size_t condition, size_t a, size_t b)
+      {
+        if(a == b)
+          return a;
+        if(is_constant(condition))
+          return instructions_[condition].value_ >= 0.0 ? a : b;
+        return push(toSelect, condition, a, b);
+      }
+
+      // Marks every instruction that the already marked instructions depend on.
+      void mark_arguments(std::vector<bool>& used) const
+      {
+        // arguments always precede their instruction on the tape
+        for(size_t i=std::min(used.size(), size()); i>0; --i)
+          if(used[i-1])
+            for(size_t j=0; j<num_arguments(instructions_[i-1].operation_); ++j)
+              used[instructions_[i-1].arguments_[j]] = true;
+      }
+
+      // Derivatives are calculated w.r.t. the first observables, only.
+      void set_num_derivatives(size_t num_derivatives)
+      {
+        num_derivatives_ = num_derivatives;
+        derivatives_.clear();
+      }
+
+      size_t num_derivatives() const
+      {
+        return num_derivatives_;
+      }
+
+      // Returns the instructions that calculate the derivatives of an instruction,
+      // indexed by observable. Derivatives that are structurally zero are missing.
+      // NOTE: The instructions are appended to the tape. The returned reference
+      //       is only valid until the next call.
+      const std::map<size_t, size_t>& get_derivatives(size_t index)
+      {
+        while(derivatives_.size() <= index)
+          derivatives_.push_back(differentiate(derivatives_.size()));
+
+        return derivatives_[index];
+      }
+
+    private:
+      std::vector<TapeInstruction> instructions_;
+      std::map<TapeInstruction, size_t> index_;
+      std::vector< std::map<size_t, size_t> > derivatives_;
+      size_t num_derivatives_, num_inputs_;
+
+      size_t push(TapeOperation operation, size_t a, size_t b=0, size_t c=0)
+      {
+        TapeInstruction instruction;
+        instruction.operation_ = operation;
+        instruction.arguments_[0] = a;
+        instruction.arguments_[1] = b;
+        instruction.arguments_[2] = c;
+
+        bool all_constant = true;
+        for(size_t i=0; i<num_arguments(operation); ++i)
+          all_constant = all_constant && is_constant(instruction.arguments_[i]);
+        if(all_constant)
+          return constant(giskard_core::evaluate(operation, instructions_[a].value_,
+              instructions_[b].value_, instructions_[c].value_));
+
+        return push(instruction);
+      }
+
+      size_t push(const TapeInstruction& instruction)
+      {
+        std::map<TapeInstruction, size_t>::const_iterator it = index_.find(instruction);
+        if(it != index_.end())
+          return it->second;
+
+        instructions_.push_back(instruction);
+        index_[instruction] = instructions_.size() - 1;
+        return instructions_.size() - 1;
+      }
+
+      // Adds factor * derivatives to the derivatives in result.
+      void accumulate(std::map<size_t, size_t>& result, const std::map<size_t, size_t>& derivatives,
+          size_t factor)
+      {
+        for(std::map<size_t, size_t>::const_iterator it=derivatives.begin(); it!=derivatives.end(); ++it)
+        {
+          size_t term = mul(factor, it->second);
+          std::map<size_t, size_t>::iterator existing = result.find(it->first);
+          if(existing == result.end())
+            result[it->first] = term;
+          else
+            existing->second = add(existing->second, term);
+        }
+      }
+
+      // Picks the derivatives of a or b, depending on the sign of condition.
+      void select(std::map<size_t, size_t>& result, size_t condition,
+          const std::map<size_t, size_t>& a, const std::map<size_t, size_t>& b)
+      {
+        std::map<size_t, size_t> keys = a;
+        keys.insert(b.begin(), b.end());
+        for(std::map<size_t, size_t>::const_iterator it=keys.begin(); it!=keys.end(); ++it)
+        {
+          std::map<size_t, size_t>::const_iterator da = a.find(it->first);
+          std::map<size_t, size_t>::const_iterator db = b.find(it->first);
+          size_t derivative = select(condition,
+              da == a.end() ? constant(0.0) : da->second,
+              db == b.end() ? constant(0.0) : db->second);
+          if(!is_constant(derivative, 0.0))
+            result[it->first] = derivative;
+        }
+      }
+
+      // Forward-mode differentiation of one instruction, given the derivatives
+      // of all instructions before it.
+      std::map<size_t, size_t> differentiate(size_t index)
+      {
+        std::map<size_t, size_t> result;
+
+        // NOTE: copy, differentiation appends to the tape
+        TapeInstruction instruction = instructions_[index];
+        size_t a = instruction.arguments_[0];
+        size_t b = instruction.arguments_[1];
+        size_t c = instruction.arguments_[2];
+
+        switch(instruction.operation_)
+        {
+          case toInput:
+            if(instruction.value_ < num_derivatives_)
+              result[(size_t) instruction.value_] = constant(1.0);
+            break;
+          case toConstant:
+            break;
+          case toAdd:
+            accumulate(result, derivatives_[a], constant(1.0));
+            accumulate(result, derivatives_[b], constant(1.0));
+            break;
+          case toSub:
+            accumulate(result, derivatives_[a], constant(1.0));
+            accumulate(result, derivatives_[b], constant(-1.0));
+            break;
+          case toMul:
+            accumulate(result, derivatives_[a], b);
+            accumulate(result, derivatives_[b], a);
+            break;
+          case toDiv:
+            accumulate(result, derivatives_[a], div(constant(1.0), b));
+            accumulate(result, derivatives_[b], neg(div(index, b)));
+            break;
+          case toNeg:
+            accumulate(result, derivatives_[a], constant(-1.0));
+            break;
+          case toSin:
+            accumulate(result, derivatives_[a], cos(a));
+            break;
+          case toCos:
+            accumulate(result, derivatives_[a], neg(sin(a)));
+            break;
+          case toTan:
+            accumulate(result, derivatives_[a], add(constant(1.0), mul(index, index)));
+            break;
+          case toAsin:
+            accumulate(result, derivatives_[a],
+                div(constant(1.0), sqrt(sub(constant(1.0), mul(a, a)))));
+            break;
+          case toAcos:
+            accumulate(result, derivatives_[a],
+                neg(div(constant(1.0), sqrt(sub(constant(1.0), mul(a, a))))));
+            break;
+          case toAtan:
+            accumulate(result, derivatives_[a], div(constant(1.0), add(constant(1.0), mul(a, a))));
+            break;
+          case toAtan2:
+          {
+            size_t denominator = add(mul(a, a), mul(b, b));
+            accumulate(result, derivatives_[a], div(b, denominator));
+            accumulate(result, derivatives_[b], neg(div(a, denominator)));
+            break;
+          }
+          case toSqrt:
+            accumulate(result, derivatives_[a], div(constant(0.5), index));
+            break;
+          case toAbs:
+          {
+            std::map<size_t, size_t> negated;
+            accumulate(negated, derivatives_[a], constant(-1.0));
+            select(result, a, derivatives_[a], negated);
+            break;
+          }
+          case toFmod:
+            // NOTE: like KDL::fmod, the denominator is treated as constant
+            accumulate(result, derivatives_[a], constant(1.0));
+            break;
+          case toMin:
+            select(result, sub(b, a), derivatives_[a], derivatives_[b]);
+            break;
+          case toMax:
+            select(result, sub(a, b), derivatives_[a], derivatives_[b]);
+            break;
+          case toSelect:
+            select(result, a, derivatives_[b], derivatives_[c]);
+            break;
+          default:
+            throw std::domain_error("Tape: Cannot differentiate operation '" +
+                to_string(instruction.operation_) + "'.");
+        }
+
+        return result;
+      }
+  };
+  // Entries of the QP that an instruction of a QPTape is written to.
+  enum QPOutputType {qoH, qoG, qoA, qoLB, qoUB, qoLBA, qoUBA};
+
+  struct QPOutput
+  {
+    QPOutputType type_;
+    size_t index_, instruction_;
+  };
+
+  // The QP of a controller as instructions on a tape. The layout mirrors
+  // QPProblemBuilder: soft constraints with slack variables, and hard constraints
+  // on single controllables already folded into the controllable bounds.
+  struct QPTape
+  {
+    QPTape() : num_observables_( 0 ) {}
+
+    Tape tape_;
+    // observables of the specification, see Scope::get_input_size, or 0 for
+    // tapes that were not generated from one
+    size_t num_observables_;
+    std::vector<std::string> controllable_names_, soft_constraint_names_;
+    std::vector<size_t> controllable_lower_bounds_, controllable_upper_bounds_,
+        controllable_weights_, soft_expressions_, soft_lower_bounds_, soft_upper_bounds_,
+        soft_weights_, hard_expressions_, hard_lower_bounds_, hard_upper_bounds_;
+    // derivatives of the constraint expressions w.r.t. the controllables
+    std::vector< std::map<size_t, size_t> > soft_derivatives_, hard_derivatives_;
+    // every entry of the QP that is not structurally zero, H and A in row-major order
+    std::vector<QPOutput> outputs_;
+
+    size_t num_controllables() const
+    {
+      return controllable_names_.size();
+    }
+
+    size_t num_soft_constraints() const
+    {
+      return soft_expressions_.size();
+    }
+
+    size_t num_hard_constraints() const
+    {
+      return hard_expressions_.size();
+    }
+
+    size_t num_weights() const
+    {
+      return num_controllables() + num_soft_constraints();
+    }
+
+    size_t num_constraints() const
+    {
+      return num_hard_constraints() + num_soft_constraints();
+    }
+
+    void create_outputs()
+    {
+      size_t nc = num_controllables();
+      size_t ns = num_soft_constraints();
+      size_t nh = num_hard_constraints();
+      size_t nw = num_weights();
+
+      outputs_.clear();
+      for(size_t i=0; i<nc; ++i)
+        add_output(qoH, i*nw + i, controllable_weights_[i]);
+      for(size_t i=0; i<ns; ++i)
+        add_output(qoH, (nc + i)*nw + nc + i, soft_weights_[i]);
+
+      for(size_t i=0; i<nh; ++i)
+        add_outputs(i, hard_derivatives_[i]);
+      for(size_t i=0; i<ns; ++i)
+      {
+        add_outputs(nh + i, soft_derivatives_[i]);
+        add_output(qoA, (nh + i)*nw + nc + i, tape_.constant(1.0));
+      }
+
+      for(size_t i=0; i<nc; ++i)
+      {
+        add_output(qoLB, i, controllable_lower_bounds_[i]);
+        add_output(qoUB, i, controllable_upper_bounds_[i]);
+      }
+      // TODO: try to get rid of these constants
+      for(size_t i=0; i<ns; ++i)
+      {
+        add_output(qoLB, nc + i, tape_.constant(-1e+9));
+        add_output(qoUB, nc + i, tape_.constant(1e+9));
+      }
+
+      for(size_t i=0; i<nh; ++i)
+      {
+        add_output(qoLBA, i, hard_lower_bounds_[i]);
+        add_output(qoUBA, i, hard_upper_bounds_[i]);
+      }
+      for(size_t i=0; i<ns; ++i)
+      {
+        add_output(qoLBA, nh + i, soft_lower_bounds_[i]);
+        add_output(qoUBA, nh + i, soft_upper_bounds_[i]);
+      }
+    }
+
+    void add_output(QPOutputType type, size_t index, size_t instruction)
+    {
+      QPOutput output;
+      output.type_ = type;
+      output.index_ = index;
+      output.instruction_ = instruction;
+      outputs_.push_back(output);
+    }
+
+    void add_outputs(size_t row, const std::map<size_t, size_t>& derivatives)
+    {
+      for(std::map<size_t, size_t>::const_iterator it=derivatives.begin(); it!=derivatives.end(); ++it)
+        if(!tape_.is_constant(it->second, 0.0))
+          add_output(qoA, row * num_weights() + it->first, it->second);
+    }
+  };
+}
+
+#endif // GISKARD_CORE_TAPE_HPP
@@ -0,0 +1,681 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_TAPE_GENERATION_HPP
+#define GISKARD_CORE_TAPE_GENERATION_HPP
+
+#include <array>
+#include <giskard_core/expression_generation.hpp>
+#include <giskard_core/specifications.hpp>
+#include <giskard_core/tape.hpp>
+
+namespace giskard_core
+{
+  // Scalar instructions of the coordinates of a vector, and of the row-major
+  // entries of a rotation matrix.
+  typedef std::array<size_t, 3> TapeVector;
+  typedef std::array<size_t, 9> TapeRotation;
+
+  struct TapeFrame
+  {
+    TapeRotation rotation_;
+    TapeVector translation_;
+  };
+
+  // Lowers specifications into scalar instructions on a tape. The scope provides
+  // the indices of the inputs, so the tape reads the same observables as the
+  // expressions generated from the same specifications.
+  class TapeGenerator
+  {
+    public:
+      TapeGenerator(Tape& tape, const giskard_core::Scope& scope) :
+        tape_( tape ), scope_( scope ) {}
+
+      void add_scope(const giskard_core::ScopeSpec& scope_spec)
+      {
+        for(size_t i=0; i<scope_spec.size(); ++i)
+        {
+          const std::string& name = scope_spec[i].name;
+          const giskard_core::SpecPtr& spec = scope_spec[i].spec;
+
+          if(boost::dynamic_pointer_cast<giskard_core::DoubleReferenceSpec>(spec).get())
+          {
+            // Reassign aliases which yaml parsed with the wrong type
+            const std::string& reference =
+                boost::dynamic_pointer_cast<giskard_core::DoubleReferenceSpec>(spec)->get_reference_name();
+            if(vectors_.count(reference))
+              vectors_[name] = vectors_[reference];
+            else if(rotations_.count(reference))
+              rotations_[name] = rotations_[reference];
+            else if(frames_.count(reference))
+              frames_[name] = frames_[reference];
+            else
+              doubles_[name] = generate_double(boost::dynamic_pointer_cast<giskard_core::DoubleSpec>(spec));
+          }
+          else if(boost::dynamic_pointer_cast<giskard_core::DoubleSpec>(spec).get())
+            doubles_[name] = generate_double(boost::dynamic_pointer_cast<giskard_core::DoubleSpec>(spec));
+          else if(boost::dynamic_pointer_cast<giskard_core::VectorSpec>(spec).get())
+            vectors_[name] = generate_vector(boost::dynamic_pointer_cast<giskard_core::VectorSpec>(spec));
+          else if(boost::dynamic_pointer_cast<giskard_core::RotationSpec>(spec).get())
+            rotations_[name] = generate_rotation(boost::dynamic_pointer_cast<giskard_core::RotationSpec>(spec));
+          else if(boost::dynamic_pointer_cast<giskard_core::FrameSpec>(spec).get())
+            frames_[name] = generate_frame(boost::dynamic_pointer_cast<giskard_core::FrameSpec>(spec));
+          else
+            throw std::domain_error("Tape generation: found entry of non-supported type.");
+        }
+      }
+
+      size_t generate_double(const giskard_core::DoubleSpecPtr& spec)
+      {
+        using namespace giskard_core;
+
+        if(boost::dynamic_pointer_cast<DoubleConstSpec>(spec))
+          return tape_.constant(boost::dynamic_pointer_cast<DoubleConstSpec>(spec)->get_value());
+
+        if(boost::dynamic_pointer_cast<DoubleInputSpec>(spec))
+          return tape_.input(input_index(*boost::dynamic_pointer_cast<DoubleInputSpec>(spec)));
+
+        if(boost::dynamic_pointer_cast<JointInputSpec>(spec))
+          return tape_.input(input_index(*boost::dynamic_pointer_cast<JointInputSpec>(spec)));
+
+        if(boost::dynamic_pointer_cast<DoubleReferenceSpec>(spec))
+          return find(doubles_, boost::dynamic_pointer_cast<DoubleReferenceSpec>(spec)->get_reference_name());
+
+        if(boost::dynamic_pointer_cast<DoubleAdditionSpec>(spec))
+        {
+          const std::vector<DoubleSpecPtr>& inputs = boost::dynamic_pointer_cast<DoubleAdditionSpec>(spec)->get_inputs();
+          size_t result = tape_.constant(0.0);
+          for(size_t i=0; i<inputs.size(); ++i)
+            result = tape_.add(result, generate_double(inputs[i]));
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<DoubleSubtractionSpec>(spec))
+        {
+          const std::vector<DoubleSpecPtr>& inputs = boost::dynamic_pointer_cast<DoubleSubtractionSpec>(spec)->get_inputs();
+          if(inputs.size() == 0)
+            throw std::length_error("Found DoubleSubtractionSpec with zero inputs.");
+          if(inputs.size() == 1)
+            return tape_.neg(generate_double(inputs[0]));
+          size_t subtrahend = generate_double(inputs[1]);
+          for(size_t i=2; i<inputs.size(); ++i)
+            subtrahend = tape_.add(subtrahend, generate_double(inputs[i]));
+          return tape_.sub(generate_double(inputs[0]), subtrahend);
+        }
+
+        if(boost::dynamic_pointer_cast<DoubleMultiplicationSpec>(spec))
+        {
+          const std::vector<DoubleSpecPtr>& inputs = boost::dynamic_pointer_cast<DoubleMultiplicationSpec>(spec)->get_inputs();
+          size_t result = tape_.constant(1.0);
+          for(size_t i=0; i<inputs.size(); ++i)
+            result = tape_.mul(result, generate_double(inputs[i]));
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<DoubleDivisionSpec>(spec))
+        {
+          const std::vector<DoubleSpecPtr>& inputs = boost::dynamic_pointer_cast<DoubleDivisionSpec>(spec)->get_inputs();
+          if(inputs.size() == 0)
+            throw std::length_error("Found DoubleDivisionSpec with zero inputs.");
+          if(inputs.size() == 1)
+            return tape_.div(tape_.constant(1.0), generate_double(inputs[0]));
+          size_t divisor = generate_double(inputs[1]);
+          for(size_t i=2; i<inputs.size(); ++i)
+            divisor = tape_.mul(divisor, generate_double(inputs[i]));
+          return tape_.div(generate_double(inputs[0]), divisor);
+        }
+
+        if(boost::dynamic_pointer_cast<DoubleNormOfSpec>(spec))
+        {
+          TapeVector v = generate_vector(boost::dynamic_pointer_cast<DoubleNormOfSpec>(spec)->get_vector());
+          return tape_.sqrt(dot(v, v));
+        }
+
+        if(boost::dynamic_pointer_cast<DoubleXCoordOfSpec>(spec))
+          return generate_vector(boost::dynamic_pointer_cast<DoubleXCoordOfSpec>(spec)->get_vector())[0];
+
+        if(boost::dynamic_pointer_cast<DoubleYCoordOfSpec>(spec))
+          return generate_vector(boost::dynamic_pointer_cast<DoubleYCoordOfSpec>(spec)->get_vector())[1];
+
+        if(boost::dynamic_pointer_cast<DoubleZCoordOfSpec>(spec))
+          return generate_vector(boost::dynamic_pointer_cast<DoubleZCoordOfSpec>(spec)->get_vector())[2];
+
+        if(boost::dynamic_pointer_cast<VectorDotSpec>(spec))
+        {
+          VectorDotSpecPtr dot_spec = boost::dynamic_pointer_cast<VectorDotSpec>(spec);
+          return dot(generate_vector(dot_spec->get_lhs()), generate_vector(dot_spec->get_rhs()));
+        }
+
+        if(boost::dynamic_pointer_cast<MinSpec>(spec))
+        {
+          MinSpecPtr min_spec = boost::dynamic_pointer_cast<MinSpec>(spec);
+          return tape_.minimum(generate_double(min_spec->get_lhs()), generate_double(min_spec->get_rhs()));
+        }
+
+        if(boost::dynamic_pointer_cast<MaxSpec>(spec))
+        {
+          MaxSpecPtr max_spec = boost::dynamic_pointer_cast<MaxSpec>(spec);
+          return tape_.maximum(generate_double(max_spec->get_lhs()), generate_double(max_spec->get_rhs()));
+        }
+
+        if(boost::dynamic_pointer_cast<AbsSpec>(spec))
+          return tape_.abs(generate_double(boost::dynamic_pointer_cast<AbsSpec>(spec)->get_value()));
+
+        if(boost::dynamic_pointer_cast<DoubleIfSpec>(spec))
+        {
+          DoubleIfSpecPtr if_spec = boost::dynamic_pointer_cast<DoubleIfSpec>(spec);
+          return tape_.select(generate_double(if_spec->get_condition()),
+              generate_double(if_spec->get_if()), generate_double(if_spec->get_else()));
+        }
+
+        if(boost::dynamic_pointer_cast<FmodSpec>(spec))
+        {
+          FmodSpecPtr fmod_spec = boost::dynamic_pointer_cast<FmodSpec>(spec);
+          size_t denominator = generate_double(fmod_spec->get_denominator());
+          // NOTE: KDL::fmod only supports constant denominators.
+          if(!tape_.is_constant(denominator))
+            throw std::domain_error("Tape generation: Denominator of fmod is not constant.");
+          return tape_.fmod(generate_double(fmod_spec->get_nominator()), denominator);
+        }
+
+        if(boost::dynamic_pointer_cast<SinSpec>(spec))
+          return tape_.sin(generate_double(boost::dynamic_pointer_cast<SinSpec>(spec)->get_value()));
+
+        if(boost::dynamic_pointer_cast<CosSpec>(spec))
+          return tape_.cos(generate_double(boost::dynamic_pointer_cast<CosSpec>(spec)->get_value()));
+
+        if(boost::dynamic_pointer_cast<TanSpec>(spec))
+          return tape_.tan(generate_double(boost::dynamic_pointer_cast<TanSpec>(spec)->get_value()));
+
+        if(boost::dynamic_pointer_cast<ASinSpec>(spec))
+          return tape_.asin(generate_double(boost::dynamic_pointer_cast<ASinSpec>(spec)->get_value()));
+
+        if(boost::dynamic_pointer_cast<ACosSpec>(spec))
+          return tape_.acos(generate_double(boost::dynamic_pointer_cast<ACosSpec>(spec)->get_value()));
+
+        if(boost::dynamic_pointer_cast<ATanSpec>(spec))
+          return tape_.atan(generate_double(boost::dynamic_pointer_cast<ATanSpec>(spec)->get_value()));
+
+        throw std::domain_error("Tape generation: found double specification of non-supported type.");
+      }
+
+      TapeVector generate_vector(const giskard_core::VectorSpecPtr& spec)
+      {
+        using namespace giskard_core;
+
+        if(boost::dynamic_pointer_cast<VectorInputSpec>(spec))
+        {
+          size_t index = input_index(*boost::dynamic_pointer_cast<VectorInputSpec>(spec));
+          return vector(tape_.input(index), tape_.input(index + 1), tape_.input(index + 2));
+        }
+
+        if(boost::dynamic_pointer_cast<VectorCachedSpec>(spec))
+          return generate_vector(boost::dynamic_pointer_cast<VectorCachedSpec>(spec)->get_vector());
+
+        if(boost::dynamic_pointer_cast<VectorConstructorSpec>(spec))
+        {
+          VectorConstructorSpecPtr constructor = boost::dynamic_pointer_cast<VectorConstructorSpec>(spec);
+          return vector(generate_double(constructor->get_x()), generate_double(constructor->get_y()),
+              generate_double(constructor->get_z()));
+        }
+
+        if(boost::dynamic_pointer_cast<VectorAdditionSpec>(spec))
+        {
+          const std::vector<VectorSpecPtr>& inputs = boost::dynamic_pointer_cast<VectorAdditionSpec>(spec)->get_inputs();
+          TapeVector result = constant(KDL::Vector::Zero());
+          for(size_t i=0; i<inputs.size(); ++i)
+            result = add(result, generate_vector(inputs[i]));
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<VectorSubtractionSpec>(spec))
+        {
+          const std::vector<VectorSpecPtr>& inputs = boost::dynamic_pointer_cast<VectorSubtractionSpec>(spec)->get_inputs();
+          if(inputs.size() == 0)
+            throw std::length_error("Found VectorSubtractionSpec with zero inputs.");
+          if(inputs.size() == 1)
+            return scale(tape_.constant(-1.0), generate_vector(inputs[0]));
+          TapeVector subtrahend = generate_vector(inputs[1]);
+          for(size_t i=2; i<inputs.size(); ++i)
+            subtrahend = add(subtrahend, generate_vector(inputs[i]));
+          return sub(generate_vector(inputs[0]), subtrahend);
+        }
+
+        if(boost::dynamic_pointer_cast<VectorReferenceSpec>(spec))
+          return find(vectors_, boost::dynamic_pointer_cast<VectorReferenceSpec>(spec)->get_reference_name());
+
+        if(boost::dynamic_pointer_cast<VectorOriginOfSpec>(spec))
+          return generate_frame(boost::dynamic_pointer_cast<VectorOriginOfSpec>(spec)->get_frame()).translation_;
+
+        if(boost::dynamic_pointer_cast<VectorFrameMultiplicationSpec>(spec))
+        {
+          VectorFrameMultiplicationSpecPtr mul = boost::dynamic_pointer_cast<VectorFrameMultiplicationSpec>(spec);
+          TapeFrame f = generate_frame(mul->get_frame());
+          return add(rotate(f.rotation_, generate_vector(mul->get_vector())), f.translation_);
+        }
+
+        if(boost::dynamic_pointer_cast<VectorRotationMultiplicationSpec>(spec))
+        {
+          VectorRotationMultiplicationSpecPtr mul = boost::dynamic_pointer_cast<VectorRotationMultiplicationSpec>(spec);
+          return rotate(generate_rotation(mul->get_rotation()), generate_vector(mul->get_vector()));
+        }
+
+        if(boost::dynamic_pointer_cast<VectorDoubleMultiplicationSpec>(spec))
+        {
+          VectorDoubleMultiplicationSpecPtr mul = boost::dynamic_pointer_cast<VectorDoubleMultiplicationSpec>(spec);
+          return scale(generate_double(mul->get_double()), generate_vector(mul->get_vector()));
+        }
+
+        if(boost::dynamic_pointer_cast<VectorRotationVectorSpec>(spec))
+          return rotation_vector(generate_rotation(
+              boost::dynamic_pointer_cast<VectorRotationVectorSpec>(spec)->get_rotation()));
+
+        if(boost::dynamic_pointer_cast<VectorCrossSpec>(spec))
+        {
+          VectorCrossSpecPtr cross_spec = boost::dynamic_pointer_cast<VectorCrossSpec>(spec);
+          return cross(generate_vector(cross_spec->get_lhs()), generate_vector(cross_spec->get_rhs()));
+        }
+
+        throw std::domain_error("Tape generation: found vector specification of non-supported type.");
+      }
+
+      TapeRotation generate_rotation(const giskard_core::RotationSpecPtr& spec)
+      {
+        using namespace giskard_core;
+
+        if(boost::dynamic_pointer_cast<RotationInputSpec>(spec))
+        {
+          size_t index = input_index(*boost::dynamic_pointer_cast<RotationInputSpec>(spec));
+          return axis_angle(vector(tape_.input(index), tape_.input(index + 1), tape_.input(index + 2)),
+              tape_.input(index + 3));
+        }
+
+        if(boost::dynamic_pointer_cast<RotationQuaternionConstructorSpec>(spec))
+        {
+          RotationQuaternionConstructorSpecPtr q = boost::dynamic_pointer_cast<RotationQuaternionConstructorSpec>(spec);
+          return constant(KDL::Rotation::Quaternion(q->get_x(), q->get_y(), q->get_z(), q->get_w()));
+        }
+
+        if(boost::dynamic_pointer_cast<AxisAngleSpec>(spec))
+        {
+          AxisAngleSpecPtr axis_angle_spec = boost::dynamic_pointer_cast<AxisAngleSpec>(spec);
+          return axis_angle(generate_vector(axis_angle_spec->get_axis()),
+              generate_double(axis_angle_spec->get_angle()));
+        }
+
+        if(boost::dynamic_pointer_cast<SlerpSpec>(spec))
+          throw std::domain_error("Tape generation: slerp is not supported.");
+
+        if(boost::dynamic_pointer_cast<RotationReferenceSpec>(spec))
+          return find(rotations_, boost::dynamic_pointer_cast<RotationReferenceSpec>(spec)->get_reference_name());
+
+        if(boost::dynamic_pointer_cast<InverseRotationSpec>(spec))
+          return transpose(generate_rotation(boost::dynamic_pointer_cast<InverseRotationSpec>(spec)->get_rotation()));
+
+        if(boost::dynamic_pointer_cast<RotationMultiplicationSpec>(spec))
+        {
+          const std::vector<RotationSpecPtr>& inputs = boost::dynamic_pointer_cast<RotationMultiplicationSpec>(spec)->get_inputs();
+          TapeRotation result = constant(KDL::Rotation::Identity());
+          for(size_t i=0; i<inputs.size(); ++i)
+            result = multiply(result, generate_rotation(inputs[i]));
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<OrientationOfSpec>(spec))
+          return generate_frame(boost::dynamic_pointer_cast<OrientationOfSpec>(spec)->get_frame()).rotation_;
+
+        throw std::domain_error("Tape generation: found rotation specification of non-supported type.");
+      }
+
+      TapeFrame generate_frame(const giskard_core::FrameSpecPtr& spec)
+      {
+        using namespace giskard_core;
+
+        if(boost::dynamic_pointer_cast<FrameInputSpec>(spec))
+        {
+          size_t index = input_index(*boost::dynamic_pointer_cast<FrameInputSpec>(spec));
+          TapeFrame result;
+          result.rotation_ = axis_angle(vector(tape_.input(index), tape_.input(index + 1),
+              tape_.input(index + 2)), tape_.input(index + 3));
+          result.translation_ = vector(tape_.input(index + 4), tape_.input(index + 5), tape_.input(index + 6));
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<QuaternionFrameInputSpec>(spec))
+        {
+          size_t index = input_index(*boost::dynamic_pointer_cast<QuaternionFrameInputSpec>(spec));
+          TapeFrame result;
+          result.rotation_ = quaternion(vector(tape_.input(index), tape_.input(index + 1),
+              tape_.input(index + 2)), tape_.input(index + 3));
+          result.translation_ = vector(tape_.input(index + 4), tape_.input(index + 5), tape_.input(index + 6));
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<MatrixFrameInputSpec>(spec))
+        {
+          size_t index = input_index(*boost::dynamic_pointer_cast<MatrixFrameInputSpec>(spec));
+          TapeFrame result;
+          for(size_t i=0; i<9; ++i)
+            result.rotation_[i] = tape_.input(index + i);
+          result.translation_ = vector(tape_.input(index + 9), tape_.input(index + 10), tape_.input(index + 11));
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<FrameCachedSpec>(spec))
+          return generate_frame(boost::dynamic_pointer_cast<FrameCachedSpec>(spec)->get_frame());
+
+        if(boost::dynamic_pointer_cast<FrameConstructorSpec>(spec))
+        {
+          FrameConstructorSpecPtr constructor = boost::dynamic_pointer_cast<FrameConstructorSpec>(spec);
+          TapeFrame result;
+          result.rotation_ = generate_rotation(constructor->get_rotation());
+          result.translation_ = generate_vector(constructor->get_translation());
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<FrameMultiplicationSpec>(spec))
+        {
+          const std::vector<FrameSpecPtr>& inputs = boost::dynamic_pointer_cast<FrameMultiplicationSpec>(spec)->get_inputs();
+          TapeFrame result;
+          result.rotation_ = constant(KDL::Rotation::Identity());
+          result.translation_ = constant(KDL::Vector::Zero());
+          for(size_t i=0; i<inputs.size(); ++i)
+          {
+            TapeFrame rhs = generate_frame(inputs[i]);
+            result.translation_ = add(rotate(result.rotation_, rhs.translation_), result.translation_);
+            result.rotation_ = multiply(result.rotation_, rhs.rotation_);
+          }
+          return result;
+        }
+
+        if(boost::dynamic_pointer_cast<FrameReferenceSpec>(spec))
+          return find(frames_, boost::dynamic_pointer_cast<FrameReferenceSpec>(spec)->get_reference_name());
+
+        if(boost::dynamic_pointer_cast<InverseFrameSpec>(spec))
+        {
+          TapeFrame f = generate_frame(boost::dynamic_pointer_cast<InverseFrameSpec>(spec)->get_frame());
+          TapeFrame result;
+          result.rotation_ = transpose(f.rotation_);
+          result.translation_ = scale(tape_.constant(-1.0), rotate(result.rotation_, f.translation_));
+          return result;
+        }
+
+        throw std::domain_error("Tape generation: found frame specification of non-supported type.");
+      }
+
+    private:
+      Tape& tape_;
+      const giskard_core::Scope& scope_;
+      std::map<std::string, size_t> doubles_;
+      std::map<std::string, TapeVector> vectors_;
+      std::map<std::string, TapeRotation> rotations_;
+      std::map<std::string, TapeFrame> frames_;
+
+      size_t input_index(const giskard_core::InputSpec& spec) const
+      {
+        return scope_.find_input(spec.get_name()->get_value())->idx_;
+      }
+
+      template<typename T>
+      static const T& find(const std::map<std::string, T>& references, const std::string& name)
+      {
+        typename std::map<std::string, T>::const_iterator it = references.find(name);
+        if(it == references.end())
+          throw std::invalid_argument("Tape generation: Could not find reference '" + name + "'.");
+        return it->second;
+      }
+
+      TapeVector vector(size_t x, size_t y, size_t z) const
+      {
+        TapeVector result = {{x, y, z}};
+        return result;
+      }
+
+      TapeVector constant(const KDL::Vector& v)
+      {
+        return vector(tape_.constant(v.x()), tape_.constant(v.y()), tape_.constant(v.z()));
+      }
+
+      TapeRotation constant(const KDL::Rotation& r)
+      {
+        TapeRotation result;
+        for(size_t i=0; i<3; ++i)
+          for(size_t j=0; j<3; ++j)
+            result[3*i + j] = tape_.constant(r(i, j));
+        return result;
+      }
+
+      TapeVector add(const TapeVector& a, const TapeVector& b)
+      {
+        return vector(tape_.add(a[0], b[0]), tape_.add(a[1], b[1]), tape_.add(a[2], b[2]));
+      }
+
+      TapeVector sub(const TapeVector& a, const TapeVector& b)
+      {
+        return vector(tape_.sub(a[0], b[0]), tape_.sub(a[1], b[1]), tape_.sub(a[2], b[2]));
+      }
+
+      TapeVector scale(size_t s, const TapeVector& v)
+      {
+        return vector(tape_.mul(s, v[0]), tape_.mul(s, v[1]), tape_.mul(s, v[2]));
+      }
+
+      size_t dot(const TapeVector& a, const TapeVector& b)
+      {
+        return tape_.add(tape_.add(tape_.mul(a[0], b[0]), tape_.mul(a[1], b[1])), tape_.mul(a[2], b[2]));
+      }
+
+      TapeVector cross(const TapeVector& a, const TapeVector& b)
+      {
+        return vector(tape_.sub(tape_.mul(a[1], b[2]), tape_.mul(a[2], b[1])),
+            tape_.sub(tape_.mul(a[2], b[0]), tape_.mul(a[0], b[2])),
+            tape_.sub(tape_.mul(a[0], b[1]), tape_.mul(a[1], b[0])));
+      }
+
+      TapeVector rotate(const TapeRotation& r, const TapeVector& v)
+      {
+        return vector(dot(row(r, 0), v), dot(row(r, 1), v), dot(row(r, 2), v));
+      }
+
+      TapeVector row(const TapeRotation& r, size_t i) const
+      {
+        return vector(r[3*i], r[3*i + 1], r[3*i + 2]);
+      }
+
+      TapeVector column(const TapeRotation& r, size_t j) const
+      {
+        return vector(r[j], r[3 + j], r[6 + j]);
+      }
+
+      TapeRotation multiply(const TapeRotation& a, const TapeRotation& b)
+      {
+        TapeRotation result;
+        for(size_t i=0; i<3; ++i)
+          for(size_t j=0; j<3; ++j)
+            result[3*i + j] = dot(row(a, i), column(b, j));
+        return result;
+      }
+
+      TapeRotation transpose(const TapeRotation& r) const
+      {
+        TapeRotation result;
+        for(size_t i=0; i<3; ++i)
+          for(size_t j=0; j<3; ++j)
+            result[3*i + j] = r[3*j + i];
+        return result;
+      }
+
+      // Same as KDL::Rotation::Rot2, i.e. KDL::rotVec. The axis is not normalized.
+      TapeRotation axis_angle(const TapeVector& axis, size_t angle)
+      {
+        size_t ct = tape_.cos(angle);
+        size_t st = tape_.sin(angle);
+        size_t vt = tape_.sub(tape_.constant(1.0), ct);
+        TapeVector vt_axis = scale(vt, axis);
+        TapeVector st_axis = scale(st, axis);
+
+        TapeRotation result;
+        result[0] = tape_.add(ct, tape_.mul(vt_axis[0], axis[0]));
+        result[1] = tape_.sub(tape_.mul(vt_axis[0], axis[1]), st_axis[2]);
+        result[2] = tape_.add(tape_.mul(vt_axis[0], axis[2]), st_axis[1]);
+        result[3] = tape_.add(tape_.mul(vt_axis[0], axis[1]), st_axis[2]);
+        result[4] = tape_.add(ct, tape_.mul(vt_axis[1], axis[1]));
+        result[5] = tape_.sub(tape_.mul(vt_axis[1], axis[2]), st_axis[0]);
+        result[6] = tape_.sub(tape_.mul(vt_axis[0], axis[2]), st_axis[1]);
+        result[7] = tape_.add(tape_.mul(vt_axis[1], axis[2]), st_axis[0]);
+        result[8] = tape_.add(ct, tape_.mul(vt_axis[2], axis[2]));
+        return result;
+      }
+
+      // Same as giskard_core::quaternion_to_rotation, i.e. KDL::quaternion_rotation.
+      TapeRotation quaternion(const TapeVector& v, size_t w)
+      {
+        size_t n2 = tape_.add(dot(v, v), tape_.mul(w, w));
+        // the zero quaternion maps onto the identity
+        size_t s = tape_.select(tape_.neg(n2), tape_.constant(0.0), tape_.div(tape_.constant(2.0), n2));
+        TapeVector sv = scale(s, v);
+        size_t sw = tape_.mul(s, w);
+        size_t one = tape_.constant(1.0);
+
+        TapeRotation result;
+        result[0] = tape_.sub(one, tape_.add(tape_.mul(sv[1], v[1]), tape_.mul(sv[2], v[2])));
+        result[1] = tape_.sub(tape_.mul(sv[0], v[1]), tape_.mul(sw, v[2]));
+        result[2] = tape_.add(tape_.mul(sv[0], v[2]), tape_.mul(sw, v[1]));
+        result[3] = tape_.add(tape_.mul(sv[0], v[1]), tape_.mul(sw, v[2]));
+        result[4] = tape_.sub(one, tape_.add(tape_.mul(sv[0], v[0]), tape_.mul(sv[2], v[2])));
+        result[5] = tape_.sub(tape_.mul(sv[1], v[2]), tape_.mul(sw, v[0]));
+        result[6] = tape_.sub(tape_.mul(sv[0], v[2]), tape_.mul(sw, v[1]));
+        result[7] = tape_.add(tape_.mul(sv[1], v[2]), tape_.mul(sw, v[0]));
+        result[8] = tape_.sub(one, tape_.add(tape_.mul(sv[0], v[0]), tape_.mul(sv[1], v[1])));
+        return result;
+      }
+
+      // Rotation vector of a rotation matrix, i.e. axis times angle.
+      // NOTE: Like KDL::Rotation::GetRot, rotations by pi take their axis from
+      //       the largest diagonal entry, because the antisymmetric part
+      //       vanishes there. Unlike the KDL version, this is smooth through
+      //       the identity, where the KDL version jumps at an angle of roughly 1e-3.
+      TapeVector rotation_vector(const TapeRotation& r)
+      {
+        TapeVector v = vector(tape_.sub(r[7], r[5]), tape_.sub(r[2], r[6]), tape_.sub(r[3], r[1]));
+        size_t sin_angle_2 = tape_.sqrt(dot(v, v));
+        size_t cos_angle_2 = tape_.sub(tape_.add(tape_.add(r[0], r[4]), r[8]), tape_.constant(1.0));
+        size_t angle = tape_.atan2(sin_angle_2, cos_angle_2);
+        // the limit of angle / (2 sin(angle)) at zero
+        size_t factor = tape_.select(tape_.sub(sin_angle_2, tape_.constant(1e-6)),
+            tape_.div(angle, sin_angle_2), tape_.constant(0.5));
+        TapeVector result = scale(factor, v);
+
+        TapeVector half_turn = half_turn_vector(r);
+        size_t is_half_turn = tape_.minimum(tape_.sub(tape_.constant(1e-6), sin_angle_2),
+            tape_.neg(cos_angle_2));
+        for(size_t i=0; i<3; ++i)
+          result[i] = tape_.select(is_half_turn, half_turn[i], result[i]);
+        return result;
+      }
+
+      // Rotation vector of a rotation by pi, i.e. the pi-branch of
+      // KDL::Rotation::GetRotAngle.
+      TapeVector half_turn_vector(const TapeRotation& r)
+      {
+        size_t half = tape_.constant(0.5);
+        size_t quarter = tape_.constant(0.25);
+        size_t one = tape_.constant(1.0);
+        size_t xx = tape_.mul(tape_.add(r[0], one), half);
+        size_t yy = tape_.mul(tape_.add(r[4], one), half);
+        size_t zz = tape_.mul(tape_.add(r[8], one), half);
+        size_t xy = tape_.mul(tape_.add(r[1], r[3]), quarter);
+        size_t xz = tape_.mul(tape_.add(r[2], r[6]), quarter);
+        size_t yz = tape_.mul(tape_.add(r[5], r[7]), quarter);
+
+        size_t x = tape_.sqrt(xx);
+        size_t y = tape_.sqrt(yy);
+        size_t z = tape_.sqrt(zz);
+        TapeVector x_axis = vector(x, tape_.div(xy, x), tape_.div(xz, x));
+        TapeVector y_axis = vector(tape_.div(xy, y), y, tape_.div(yz, y));
+        TapeVector z_axis = vector(tape_.div(xz, z), tape_.div(yz, z), z);
+
+        // same strict comparisons as KDL, so that ties pick the same axis
+        size_t x_is_not_largest = tape_.neg(tape_.minimum(tape_.sub(xx, yy), tape_.sub(xx, zz)));
+        size_t y_is_not_larger = tape_.neg(tape_.sub(yy, zz));
+        TapeVector axis;
+        for(size_t i=0; i<3; ++i)
+          axis[i] = tape_.select(x_is_not_largest,
+              tape_.select(y_is_not_larger, z_axis[i], y_axis[i]), x_axis[i]);
+        return scale(tape_.constant(M_PI), axis);
+      }
+  };
+
+  inline QPTape generate_tape(const giskard_core::QPControllerSpec& spec)
+  {
+    QPTape result;
+    for(size_t i=0; i<spec.controllable_constraints_.size(); ++i)
+      result.controllable_names_.push_back(spec.controllable_constraints_[i].input_->get_value());
+
+    giskard_core::Scope scope = generate(spec.scope_, result.controllable_names_);
+    result.num_observables_ = scope.get_input_size();
+    TapeGenerator generator(result.tape_, scope);
+    generator.add_scope(spec.scope_);
+
+    for(size_t i=0; i<spec.controllable_constraints_.size(); ++i)
+    {
+      result.controllable_lower_bounds_.push_back(generator.generate_double(spec.controllable_constraints_[i].lower_));
+      result.controllable_upper_bounds_.push_back(generator.generate_double(spec.controllable_constraints_[i].upper_));
+      result.controllable_weights_.push_back(generator.generate_double(spec.controllable_constraints_[i].weight_));
+    }
+
+    for(size_t i=0; i<spec.soft_constraints_.size(); ++i)
+    {
+      result.soft_lower_bounds_.push_back(generator.generate_double(spec.soft_constraints_[i].lower_));
+      result.soft_upper_bounds_.push_back(generator.generate_double(spec.soft_constraints_[i].upper_));
+      result.soft_weights_.push_back(generator.generate_double(spec.soft_constraints_[i].weight_));
+      result.soft_expressions_.push_back(generator.generate_double(spec.soft_constraints_[i].expression_));
+      result.soft_constraint_names_.push_back(spec.soft_constraints_[i].name_->get_value());
+    }
+
+    for(size_t i=0; i<spec.hard_constraints_.size(); ++i)
+    {
+      size_t index = find_folding_controllable(spec.hard_constraints_[i], spec.scope_, result.controllable_names_);
+      if(index < result.num_controllables())
+      {
+        result.controllable_lower_bounds_[index] = result.tape_.maximum(result.controllable_lower_bounds_[index],
+            generator.generate_double(spec.hard_constraints_[i].lower_));
+        result.controllable_upper_bounds_[index] = result.tape_.minimum(result.controllable_upper_bounds_[index],
+            generator.generate_double(spec.hard_constraints_[i].upper_));
+        continue;
+      }
+
+      result.hard_lower_bounds_.push_back(generator.generate_double(spec.hard_constraints_[i].lower_));
+      result.hard_upper_bounds_.push_back(generator.generate_double(spec.hard_constraints_[i].upper_));
+      result.hard_expressions_.push_back(generator.generate_double(spec.hard_constraints_[i].expression_));
+    }
+
+    result.tape_.set_num_derivatives(result.num_controllables());
+    for(size_t i=0; i<result.num_soft_constraints(); ++i)
+      result.soft_derivatives_.push_back(result.tape_.get_derivatives(result.soft_expressions_[i]));
+    for(size_t i=0; i<result.num_hard_constraints(); ++i)
+      result.hard_derivatives_.push_back(result.tape_.get_derivatives(result.hard_expressions_[i]));
+    result.create_outputs();
+
+    return result;
+  }
+}
+
+#endif // GISKARD_CORE_TAPE_GENERATION_HPP
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_TAPE_INTERPRETER_HPP
+#define GISKARD_CORE_TAPE_INTERPRETER_HPP
+
+#include <giskard_core/tape.hpp>
+
+namespace giskard_core
+{
+  // Evaluates a QPTape without a compile step. At init, the instructions that
+  // reach the QP are copied into a flat program over one contiguous array of
+  // registers. Derivatives are instructions of the tape as well, so the
+  // registers hold values and tangents side by side. Constants are loaded once
+  // at init; every evaluation is a single pass of a switch loop.
+  // An evaluation marks the registers of the observables that changed since
+  // the last one, and only runs the instructions with a marked argument. So
+  // it skips e.g. everything that only depends on goals while the joints move.
+  class TapeInterpreter
+  {
+    public:
+      TapeInterpreter() : num_observables_( 0 ), num_weights_( 0 ), num_constraints_( 0 ),
+        num_executed_instructions_( 0 ), evaluate_all_( true ) {}
+
+      void init(const QPTape& qp)
+      {
+        const Tape& tape = qp.tape_;
+
+        std::vector<bool> used(tape.size(), false);
+        for(size_t i=0; i<qp.outputs_.size(); ++i)
+          used[qp.outputs_[i].instruction_] = true;
+        tape.mark_arguments(used);
+
+        std::vector<size_t> register_index(tape.size(), 0);
+        registers_.clear();
+        inputs_.clear();
+        program_.clear();
+        num_observables_ = 0;
+        // unused arguments point at this register, which never changes
+        registers_.push_back(0.0);
+        for(size_t i=0; i<tape.size(); ++i)
+        {
+          if(!used[i])
+            continue;
+
+          const TapeInstruction& instruction = tape.get_instruction(i);
+          register_index[i] = registers_.size();
+          registers_.push_back(instruction.value_);
+          if(instruction.operation_ == toConstant)
+            continue;
+
+          if(instruction.operation_ == toInput)
+          {
+            Input input;
+            input.register_ = register_index[i];
+            input.observable_ = static_cast<size_t>(instruction.value_);
+            inputs_.push_back(input);
+            num_observables_ = std::max(num_observables_, input.observable_ + 1);
+            continue;
+          }
+
+          Instruction compiled;
+          compiled.operation_ = instruction.operation_;
+          compiled.result_ = register_index[i];
+          for(size_t j=0; j<3; ++j)
+            compiled.arguments_[j] = (j < num_arguments(instruction.operation_)) ?
+                register_index[instruction.arguments_[j]] : 0;
+          program_.push_back(compiled);
+        }
+
+        outputs_.clear();
+        for(size_t i=0; i<qp.outputs_.size(); ++i)
+        {
+          Output output;
+          output.type_ = qp.outputs_[i].type_;
+          output.index_ = qp.outputs_[i].index_;
+          output.register_ = register_index[qp.outputs_[i].instruction_];
+          outputs_.push_back(output);
+        }
+
+        changed_.assign(registers_.size(), 0);
+        num_weights_ = qp.num_weights();
+        num_constraints_ = qp.num_constraints();
+        evaluate_all_ = true;
+      }
+
+      // Same signature as QPEvaluationFunction. Only writes the entries of H
+      // and A that are not structurally zero, the others are left untouched.
+      void evaluate(const double* observables, double* H, double* g, double* A,
+          double* lb, double* ub, double* lbA, double* ubA)
+      {
+        double* r = registers_.data();
+        unsigned char* changed = changed_.data();
+        for(size_t i=0; i<inputs_.size(); ++i)
+        {
+          // NOTE: NaNs never compare equal, so they always count as changed.
+          changed[inputs_[i].register_] = !(r[inputs_[i].register_] == observables[inputs_[i].observable_]);
+          r[inputs_[i].register_] = observables[inputs_[i].observable_];
+        }
+
+        num_executed_instructions_ = 0;
+        for(size_t i=0; i<program_.size(); ++i)
+        {
+          // NOTE: The program is in topological order, so the marks of the
+          //       arguments are up to date.
+          const Instruction& in = program_[i];
+          changed[in.result_] = evaluate_all_ || changed[in.arguments_[0]] ||
+              changed[in.arguments_[1]] || changed[in.arguments_[2]];
+          if(!changed[in.result_])
+            continue;
+
+          ++num_executed_instructions_;
+          const double a = r[in.arguments_[0]];
+          const double b = r[in.arguments_[1]];
+          switch(in.operation_)
+          {
+            case toAdd: r[in.result_] = a + b; break;
+            case toSub: r[in.result_] = a - b; break;
+            case toMul: r[in.result_] = a * b; break;
+            case toDiv: r[in.result_] = a / b; break;
+            case toNeg: r[in.result_] = -a; break;
+            case toSin: r[in.result_] = std::sin(a); break;
+            case toCos: r[in.result_] = std::cos(a); break;
+            case toSelect: r[in.result_] = a >= 0.0 ? b : r[in.arguments_[2]]; break;
+            default:
+              r[in.result_] = giskard_core::evaluate(in.operation_, a, b, r[in.arguments_[2]]);
+          }
+        }
+
+        evaluate_all_ = false;
+
+        double* targets[] = {H, g, A, lb, ub, lbA, ubA};
+        for(size_t i=0; i<outputs_.size(); ++i)
+          targets[outputs_[i].type_][outputs_[i].index_] = r[outputs_[i].register_];
+      }
+
+      size_t num_observables() const
+      {
+        return num_observables_;
+      }
+
+      size_t num_weights() const
+      {
+        return num_weights_;
+      }
+
+      size_t num_constraints() const
+      {
+        return num_constraints_;
+      }
+
+      size_t num_registers() const
+      {
+        return registers_.size();
+      }
+
+      size_t num_instructions() const
+      {
+        return inputs_.size() + program_.size();
+      }
+
+      // Number of instructions, without inputs, that the last evaluation ran.
+      size_t num_executed_instructions() const
+      {
+        return num_executed_instructions_;
+      }
+
+    private:
+      struct Instruction
+      {
+        TapeOperation operation_;
+        size_t result_;
+        size_t arguments_[3];
+      };
+
+      struct Input
+      {
+        size_t register_, observable_;
+      };
+
+      struct Output
+      {
+        QPOutputType type_;
+        size_t index_, register_;
+      };
+
+      std::vector<Input> inputs_;
+      std::vector<Instruction> program_;
+      std::vector<Output> outputs_;
+      std::vector<double> registers_;
+      // whether a register changed during the current evaluation
+      std::vector<unsigned char> changed_;
+      size_t num_observables_, num_weights_, num_constraints_, num_executed_instructions_;
+      bool evaluate_all_;
+  };
+}
+
+#endif // GISKARD_CORE_TAPE_INTERPRETER_HPP
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2016-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_UPDATE_STATISTICS_HPP
+#define GISKARD_CORE_UPDATE_STATISTICS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+namespace giskard_core
+{
+  // What happened during one QPController::update. Times are in seconds.
+  struct UpdateRecord
+  {
+    UpdateRecord() : evaluation_time_( 0.0 ), copy_time_( 0.0 ), solve_time_( 0.0 ),
+      nWSR_( 0 ), return_value_( 0 ), active_set_size_( 0 ), recovery_stage_( 0 ),
+      status_( 0 ) {}
+
+    double total_time() const
+    {
+      return evaluation_time_ + copy_time_ + solve_time_;
+    }
+
+    // evaluation of the expressions, copying their values into the QP, and the solver
+    double evaluation_time_, copy_time_, solve_time_;
+    // working set recalculations that the solver actually used, over all
+    // recovery stages
+    int nWSR_;
+    // return value of the solver, i.e. a qpOASES::returnValue
+    int return_value_;
+    // number of active bounds and constraints after the solve
+    int active_set_size_;
+    // last recovery stage that ran, i.e. a QPRecoveryStage, or 0 if the
+    // hotstart succeeded right away
+    int recovery_stage_;
+    // outcome of the update, i.e. a QPUpdateStatus
+    int status_;
+  };
+
+  struct UpdateSummary
+  {
+    UpdateSummary() : min_( 0.0 ), mean_( 0.0 ), p99_( 0.0 ), max_( 0.0 ) {}
+
+    double min_, mean_, p99_, max_;
+  };
+
+  // Keeps the records of the last updates in a ring buffer. All memory is
+  // allocated up front, so neither recording nor summarizing allocates.
+  class UpdateStatistics
+  {
+    public:
+      typedef std::chrono::steady_clock Clock;
+
+      explicit UpdateStatistics(size_t capacity = 0) :
+        records_( capacity ), scratch_( capacity ), next_( 0 ), size_( 0 ) {}
+
+      void record(const UpdateRecord& record)
+      {
+        if(capacity() == 0)
+          return;
+
+        records_[next_] = record;
+        next_ = (next_ + 1) % capacity();
+        size_ = std::min(size_ + 1, capacity());
+      }
+
+      void clear()
+      {
+        next_ = 0;
+        size_ = 0;
+      }
+
+      size_t size() const
+      {
+        return size_;
+      }
+
+      size_t capacity() const
+      {
+        return records_.size();
+      }
+
+      // Records from the oldest, at index 0, to the latest.
+      const UpdateRecord& get_record(size_t index) const
+      {
+        if(index >= size_)
+          throw std::out_of_range("UpdateStatistics: Record index out of range.");
+        return records_[(next_ + capacity() - size_ + index) % capacity()];
+      }
+
+      const UpdateRecord& get_latest_record() const
+      {
+        if(size_ == 0)
+          throw std::out_of_range("UpdateStatistics: No records.");
+        return get_record(size_ - 1);
+      }
+
+      // Summary of one field of the records, e.g. of &UpdateRecord::solve_time_.
+      // The p99 is the nearest-rank percentile.
+      template<typename T>
+      UpdateSummary summarize(T UpdateRecord::* field) const
+      {
+        for(size_t i=0; i<size(); ++i)
+          scratch_[i] = static_cast<double>(get_record(i).*field);
+        return summarize_scratch();
+      }
+
+      UpdateSummary summarize_total_time() const
+      {
+        for(size_t i=0; i<size(); ++i)
+          scratch_[i] = get_record(i).total_time();
+        return summarize_scratch();
+      }
+
+      // Number of recorded updates in which the solver did not succeed.
+      size_t num_failures() const
+      {
+        size_t result = 0;
+        for(size_t i=0; i<size(); ++i)
+          if(get_record(i).return_value_ != 0)
+            ++result;
+        return result;
+      }
+
+      // Number of recorded updates that only succeeded after a recovery.
+      size_t num_recoveries() const
+      {
+        size_t result = 0;
+        for(size_t i=0; i<size(); ++i)
+          if(get_record(i).recovery_stage_ != 0 && get_record(i).return_value_ == 0)
+            ++result;
+        return result;
+      }
+
+      static double seconds(const Clock::time_point& start, const Clock::time_point& end)
+      {
+        return std::chrono::duration<double>(end - start).count();
+      }
+
+    private:
+      std::vector<UpdateRecord> records_;
+      mutable std::vector<double> scratch_;
+      size_t next_, size_;
+
+      UpdateSummary summarize_scratch() const
+      {
+        UpdateSummary result;
+        if(size() == 0)
+          return result;
+
+        std::vector<double>::iterator begin = scratch_.begin();
+        std::vector<double>::iterator end = begin + size();
+        result.min_ = *std::min_element(begin, end);
+        result.max_ = *std::max_element(begin, end);
+        double sum = 0.0;
+        for(std::vector<double>::iterator it=begin; it!=end; ++it)
+          sum += *it;
+        result.mean_ = sum / size();
+
+        // i.e. ceil(0.99 * size()) without rounding errors
+        size_t rank = (99 * size() + 99) / 100;
+        std::nth_element(begin, begin + rank - 1, end);
+        result.p99_ = *(begin + rank - 1);
+        return result;
+      }
+  };
+}
+
+#endif // GISKARD_CORE_UPDATE_STATISTICS_HPP
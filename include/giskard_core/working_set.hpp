@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ *
+ * This file is part of giskard.
+ *
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_WORKING_SET_HPP
+#define GISKARD_CORE_WORKING_SET_HPP
+
+#include <vector>
+
+namespace giskard_core
+{
+  // Which bounds and constraints of the QP are active, in the convention of
+  // qpOASES' getWorkingSet: -1 at the lower limit, +1 at the upper limit, and
+  // 0 if inactive. Bounds come in the order of the weights of the QP, and
+  // constraints in the order of the rows of A.
+  struct QPWorkingSet
+  {
+    std::vector<int> bounds_, constraints_;
+
+    bool empty() const
+    {
+      return bounds_.empty() && constraints_.empty();
+    }
+  };
+
+  inline bool operator==(const QPWorkingSet& lhs, const QPWorkingSet& rhs)
+  {
+    return lhs.bounds_ == rhs.bounds_ && lhs.constraints_ == rhs.constraints_;
+  }
+
+  inline bool operator!=(const QPWorkingSet& lhs, const QPWorkingSet& rhs)
+  {
+    return !(lhs == rhs);
+  }
+}
+
+#endif // GISKARD_CORE_WORKING_SET_HPP
@@ -24,6 +24,7 @@
 #include <yaml-cpp/yaml.h>
 #include <vector>
 #include <giskard_core/specifications.hpp>
+#include <giskard_core/working_set.hpp>
 
 namespace YAML {
   //
@@ -1905,6 +1906,78 @@ namespace YAML {
     }
   };
 
+  inline bool is_input_quaternion_frame(const Node& node)
+  {
+    if (node.IsMap() && (node.size() == 1) && node["input-quaternion-frame"]) {
+      try
+      {
+        node["input-quaternion-frame"].as<std::string>();
+        return true;
+      }
+      catch (const YAML::Exception& e)
+      { }
+    }
+    return false;
+  }
+
+  template<>
+  struct convert<giskard_core::QuaternionFrameInputSpecPtr> 
+  {
+    
+    static Node encode(const giskard_core::QuaternionFrameInputSpecPtr& rhs) 
+    {
+      Node node;
+      node["input-quaternion-frame"] = rhs->get_name();
+      return node;
+    }
+  
+    static bool decode(const Node& node, giskard_core::QuaternionFrameInputSpecPtr& rhs) 
+    {
+      if(!is_input_quaternion_frame(node))
+        return false;
+  
+      rhs = giskard_core::QuaternionFrameInputSpecPtr(new giskard_core::QuaternionFrameInputSpec(node["input-quaternion-frame"].as<std::string>()));
+
+      return true;
+    }
+  };
+
+  inline bool is_input_matrix_frame(const Node& node)
+  {
+    if (node.IsMap() && (node.size() == 1) && node["input-matrix-frame"]) {
+      try
+      {
+        node["input-matrix-frame"].as<std::string>();
+        return true;
+      }
+      catch (const YAML::Exception& e)
+      { }
+    }
+    return false;
+  }
+
+  template<>
+  struct convert<giskard_core::MatrixFrameInputSpecPtr> 
+  {
+    
+    static Node encode(const giskard_core::MatrixFrameInputSpecPtr& rhs) 
+    {
+      Node node;
+      node["input-matrix-frame"] = rhs->get_name();
+      return node;
+    }
+  
+    static bool decode(const Node& node, giskard_core::MatrixFrameInputSpecPtr& rhs) 
+    {
+      if(!is_input_matrix_frame(node))
+        return false;
+  
+      rhs = giskard_core::MatrixFrameInputSpecPtr(new giskard_core::MatrixFrameInputSpec(node["input-matrix-frame"].as<std::string>()));
+
+      return true;
+    }
+  };
+
   inline bool is_cached_frame(const Node& node)
   {
     return node.IsMap() && (node.size() == 1) && node["cached-frame"];
@@ -2066,6 +2139,10 @@ namespace YAML {
 
       if(boost::dynamic_pointer_cast<giskard_core::FrameInputSpec>(rhs).get())
         node = boost::dynamic_pointer_cast<giskard_core::FrameInputSpec>(rhs);
+      else if(boost::dynamic_pointer_cast<giskard_core::QuaternionFrameInputSpec>(rhs).get())
+        node = boost::dynamic_pointer_cast<giskard_core::QuaternionFrameInputSpec>(rhs);
+      else if(boost::dynamic_pointer_cast<giskard_core::MatrixFrameInputSpec>(rhs).get())
+        node = boost::dynamic_pointer_cast<giskard_core::MatrixFrameInputSpec>(rhs);
       else if(boost::dynamic_pointer_cast<giskard_core::FrameCachedSpec>(rhs).get())
         node = boost::dynamic_pointer_cast<giskard_core::FrameCachedSpec>(rhs);
       else if(boost::dynamic_pointer_cast<giskard_core::FrameConstructorSpec>(rhs).get())
@@ -2087,6 +2164,16 @@ namespace YAML {
         rhs = node.as<giskard_core::FrameInputSpecPtr>();
         return true;
       }
+      else if(is_input_quaternion_frame(node))
+      {
+        rhs = node.as<giskard_core::QuaternionFrameInputSpecPtr>();
+        return true;
+      }
+      else if(is_input_matrix_frame(node))
+      {
+        rhs = node.as<giskard_core::MatrixFrameInputSpecPtr>();
+        return true;
+      }
       else if(is_cached_frame(node))
       {
         rhs = node.as<giskard_core::FrameCachedSpecPtr>();
@@ -2153,6 +2240,7 @@ namespace YAML {
   inline bool is_frame_spec(const Node& node)
   {
     return is_cached_frame(node) || is_input_frame(node) || is_constructor_frame(node) || 
+        is_input_quaternion_frame(node) || is_input_matrix_frame(node) ||
         is_frame_multiplication(node) || is_frame_reference(node) ||
         is_inverse_frame(node);
   }
@@ -2343,7 +2431,8 @@ namespace YAML {
 
   inline bool is_qp_controller_spec(const Node& node)
   {
-    return node.IsMap() && (node.size() == 4) && node["scope"] &&
+    return node.IsMap() && (node.size() == 4 || (node.size() == 5 &&
+        node["monitored-outputs"] && node["monitored-outputs"].IsSequence())) && node["scope"] &&
         node["scope"].IsSequence() && node["soft-constraints"] &&
         node["soft-constraints"].IsSequence() && node["hard-constraints"] &&
         node["hard-constraints"].IsSequence() && node["controllable-constraints"] &&
@@ -2361,6 +2450,8 @@ namespace YAML {
       node["controllable-constraints"] = rhs.controllable_constraints_;
       node["soft-constraints"] = rhs.soft_constraints_;
       node["hard-constraints"] = rhs.hard_constraints_;
+      if(!rhs.monitored_outputs_.empty())
+        node["monitored-outputs"] = rhs.monitored_outputs_;
 
       return node;
     }
@@ -2377,6 +2468,36 @@ namespace YAML {
           node["soft-constraints"].as< std::vector<giskard_core::SoftConstraintSpec> >();
       rhs.hard_constraints_ = 
           node["hard-constraints"].as< std::vector<giskard_core::HardConstraintSpec> >();
+      if(node["monitored-outputs"])
+        rhs.monitored_outputs_ = node["monitored-outputs"].as< std::vector<std::string> >();
+
+      return true;
+    }
+  };
+
+  //
+  // parsing of working sets
+  //
+
+  template<>
+  struct convert<giskard_core::QPWorkingSet>
+  {
+    static Node encode(const giskard_core::QPWorkingSet& rhs)
+    {
+      YAML::Node node;
+      node["bounds"] = rhs.bounds_;
+      node["constraints"] = rhs.constraints_;
+
+      return node;
+    }
+
+    static bool decode(const Node& node, giskard_core::QPWorkingSet& rhs)
+    {
+      if(!node.IsMap() || !node["bounds"] || !node["constraints"])
+        return false;
+
+      rhs.bounds_ = node["bounds"].as< std::vector<int> >();
+      rhs.constraints_ = node["constraints"].as< std::vector<int> >();
 
       return true;
     }
@@ -0,0 +1,52 @@
+/*
+* Copyright (C) 2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+*
+* This file is part of giskard.
+*
+* giskard is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <yaml-cpp/yaml.h>
+#include <giskard_core/giskard_core.hpp>
+
+int main(int argc, char **argv)
+{
+  if (argc < 2 || argc > 4)
+  {
+    std::cout << "Usage: rosrun giskard_core giskard_codegen <controller_yaml> (optional <function_name>) (optional <output_file>)" << std::endl;
+    return 0;
+  }
+  YAML::Node node = YAML::LoadFile(argv[1]);
+  giskard_core::QPControllerSpec spec = node.as<giskard_core::QPControllerSpec>();
+  std::string function_name = (argc > 2) ? argv[2] : "giskard_qp";
+  std::string code = giskard_core::generate_code(giskard_core::generate_tape(spec), function_name);
+  if (argc == 4)
+  {
+    std::ofstream output_file;
+    output_file.open(argv[3]);
+    if (!output_file.is_open())
+      throw std::runtime_error("Failed to write file '" + std::string(argv[3]) + "'.");
+    output_file << code;
+    output_file.close();
+  }
+  else
+  {
+    std::cout << code;
+  }
+
+  return 0;
+}
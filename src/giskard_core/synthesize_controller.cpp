@@ -0,0 +1,58 @@
+/*
+* Copyright (C) 2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+*
+* This file is part of giskard.
+*
+* giskard is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <yaml-cpp/yaml.h>
+#include <boost/lexical_cast.hpp>
+#include <giskard_core/giskard_core.hpp>
+
+int main(int argc, char **argv)
+{
+  if (argc != 6 && argc != 7)
+  {
+    std::cout << "Usage: rosrun giskard_core synthesize_controller <num_joints> <num_branches> <num_soft_constraints> <num_hard_constraints> <num_goal_inputs> (optional <output_file>)" << std::endl;
+    return 0;
+  }
+  giskard_core::SyntheticControllerOptions options;
+  options.num_joints_ = boost::lexical_cast<size_t>(argv[1]);
+  options.num_branches_ = boost::lexical_cast<size_t>(argv[2]);
+  options.num_soft_constraints_ = boost::lexical_cast<size_t>(argv[3]);
+  options.num_hard_constraints_ = boost::lexical_cast<size_t>(argv[4]);
+  options.num_goal_inputs_ = boost::lexical_cast<size_t>(argv[5]);
+  YAML::Node yaml = giskard_core::synthesize_controller(options);
+  YAML::Emitter out;
+  out << yaml;
+  if (argc == 7)
+  {
+    std::ofstream output_file;
+    output_file.open(argv[6]);
+    if (!output_file.is_open())
+      throw std::runtime_error("Failed to write file '" + std::string(argv[6]) + "'.");
+    output_file << out.c_str();
+    output_file.close();
+  }
+  else
+  {
+    std::cout << out.c_str() << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "synthetic_solver_test.hpp"
+
+class ActiveSetQPSolverTest : public SyntheticSolverTest {};
+
+TEST_F(ActiveSetQPSolverTest, SameAsQPOases)
+{
+  giskard_core::QPController qpoases = giskard_core::generate(spec);
+  giskard_core::QPController active_set = qpoases;
+  active_set.set_solver(giskard_core::ActiveSetQPSolver());
+
+  Eigen::VectorXd state = initial_state(qpoases);
+  ASSERT_TRUE(qpoases.start(state, nWSR));
+  ASSERT_TRUE(active_set.start(state, nWSR));
+  for(size_t i=0; i<20; ++i)
+  {
+    ASSERT_TRUE(qpoases.update(state, nWSR));
+    ASSERT_TRUE(active_set.update(state, nWSR));
+    for(size_t j=0; j<qpoases.num_controllables(); ++j)
+      EXPECT_NEAR(qpoases.get_command()(j), active_set.get_command()(j), 1e-6);
+    for(size_t j=0; j<qpoases.num_soft_constraints(); ++j)
+      EXPECT_NEAR(qpoases.get_slack()(j), active_set.get_slack()(j), 1e-6);
+    state.head(qpoases.num_controllables()) += 0.01 * qpoases.get_command();
+  }
+
+  // working sets of either solver warm start the other one
+  giskard_core::QPWorkingSet working_set = qpoases.get_working_set();
+  ASSERT_TRUE(active_set.start(state, nWSR, working_set));
+  ASSERT_TRUE(active_set.update(state, nWSR));
+  ASSERT_TRUE(qpoases.update(state, nWSR));
+  for(size_t j=0; j<qpoases.num_controllables(); ++j)
+    EXPECT_NEAR(qpoases.get_command()(j), active_set.get_command()(j), 1e-6);
+  ASSERT_TRUE(qpoases.start(state, nWSR, active_set.get_working_set()));
+}
+
+TEST_F(ActiveSetQPSolverTest, WarmStart)
+{
+  giskard_core::QPController controller = giskard_core::generate(spec);
+  Eigen::VectorXd state = initial_state(controller);
+  ASSERT_TRUE(controller.start(state, nWSR));
+  const giskard_core::QPProblemBuilder& builder = controller.get_qp_builder();
+
+  giskard_core::ActiveSetQPSolver solver;
+  solver.init(builder);
+  int cold_nWSR = nWSR;
+  ASSERT_EQ(qpOASES::SUCCESSFUL_RETURN, solver.solve(builder, cold_nWSR, 0, 0));
+  size_t active_set_size = solver.get_active_set_size();
+  ASSERT_LT(0u, active_set_size);
+  Eigen::VectorXd cold_solution;
+  solver.get_primal_solution(cold_solution);
+
+  // the same QP is solved on the last active set, without any iterations
+  int hot_nWSR = nWSR;
+  ASSERT_EQ(qpOASES::SUCCESSFUL_RETURN, solver.hotstart(builder, hot_nWSR, 0));
+  EXPECT_EQ(0, hot_nWSR);
+  EXPECT_LT(0, cold_nWSR);
+  EXPECT_EQ(active_set_size, solver.get_active_set_size());
+  Eigen::VectorXd hot_solution;
+  solver.get_primal_solution(hot_solution);
+  EXPECT_TRUE(cold_solution.isApprox(hot_solution, 1e-9));
+
+  // too few iterations to add the active set from scratch
+  int no_nWSR = 0;
+  EXPECT_EQ(qpOASES::RET_MAX_NWSR_REACHED, solver.solve(builder, no_nWSR, 0, 0));
+  EXPECT_FALSE(solver.is_solved());
+  no_nWSR = nWSR;
+  EXPECT_EQ(qpOASES::SUCCESSFUL_RETURN, solver.hotstart(builder, no_nWSR, 0));
+  EXPECT_EQ(active_set_size, solver.get_active_set_size());
+
+  // after a small step, the hotstart needs fewer iterations than a cold start
+  state.head(controller.num_controllables()) += 0.01 * controller.get_command();
+  ASSERT_TRUE(controller.update(state, nWSR));
+  cold_nWSR = nWSR;
+  giskard_core::ActiveSetQPSolver cold_solver;
+  cold_solver.init(builder);
+  ASSERT_EQ(qpOASES::SUCCESSFUL_RETURN, cold_solver.solve(builder, cold_nWSR, 0, 0));
+  hot_nWSR = nWSR;
+  ASSERT_EQ(qpOASES::SUCCESSFUL_RETURN, solver.hotstart(builder, hot_nWSR, 0));
+  EXPECT_LT(hot_nWSR, cold_nWSR);
+  cold_solver.get_primal_solution(cold_solution);
+  solver.get_primal_solution(hot_solution);
+  EXPECT_TRUE(cold_solution.isApprox(hot_solution, 1e-9));
+}
+
+TEST_F(ActiveSetQPSolverTest, ConstantMatrices)
+{
+  // linear soft constraints, like the hard ones
+  for(size_t i=0; i<spec.soft_constraints_.size(); ++i)
+    spec.soft_constraints_[i].expression_ =
+        spec.hard_constraints_[i % spec.hard_constraints_.size()].expression_;
+  giskard_core::QPProblemOptions options;
+  options.detect_constant_matrices_ = true;
+  giskard_core::QPController constant = giskard_core::generate(spec, options);
+  ASSERT_TRUE(constant.get_qp_builder().has_constant_matrices());
+  giskard_core::QPController varying = giskard_core::generate(spec);
+  ASSERT_FALSE(varying.get_qp_builder().has_constant_matrices());
+  constant.set_solver(giskard_core::ActiveSetQPSolver());
+  varying.set_solver(giskard_core::ActiveSetQPSolver());
+
+  // hotstarts on the kept factorization find the same solutions
+  Eigen::VectorXd state = initial_state(constant);
+  ASSERT_TRUE(constant.start(state, nWSR));
+  ASSERT_TRUE(varying.start(state, nWSR));
+  for(size_t i=0; i<20; ++i)
+  {
+    ASSERT_TRUE(constant.update(state, nWSR));
+    ASSERT_TRUE(varying.update(state, nWSR));
+    for(size_t j=0; j<constant.num_controllables(); ++j)
+      EXPECT_NEAR(varying.get_command()(j), constant.get_command()(j), 1e-9);
+    state.head(constant.num_controllables()) += 0.1 * constant.get_command();
+    state(state.size() - 1) += 0.05;
+  }
+}
+
+TEST_F(ActiveSetQPSolverTest, Restrictions)
+{
+  giskard_core::QPProblemOptions options;
+  options.sparse_ = true;
+  giskard_core::QPController sparse = giskard_core::generate(spec, options);
+  EXPECT_THROW(sparse.set_solver(giskard_core::ActiveSetQPSolver()), std::invalid_argument);
+
+  giskard_core::ActiveSetQPSolver solver;
+  EXPECT_THROW(solver.init(giskard_core::QPProblemBuilder()), std::invalid_argument);
+
+  // a hard constraint that no velocity satisfies
+  spec.hard_constraints_[0].lower_ = giskard_core::double_const_spec(1e3);
+  spec.hard_constraints_[0].upper_ = giskard_core::double_const_spec(2e3);
+  giskard_core::QPController infeasible = giskard_core::generate(spec);
+  infeasible.set_solver(giskard_core::ActiveSetQPSolver());
+  EXPECT_FALSE(infeasible.start(initial_state(infeasible), nWSR));
+  EXPECT_FALSE(infeasible.get_solver().is_solved());
+}
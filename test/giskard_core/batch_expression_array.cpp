@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class BatchExpressionArrayTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      YAML::Node node = YAML::LoadFile("pr2_qp_position_control.yaml");
+      spec = node.as<giskard_core::QPControllerSpec>();
+      for(size_t i=0; i<spec.controllable_constraints_.size(); ++i)
+        controllables.push_back(spec.controllable_constraints_[i].input_->get_value());
+
+      giskard_core::VectorReferenceSpecPtr position(new giskard_core::VectorReferenceSpec());
+      position->set_reference_name("pr2_fk_pos");
+      giskard_core::DoubleXCoordOfSpecPtr x(new giskard_core::DoubleXCoordOfSpec());
+      x->set_vector(position);
+      giskard_core::DoubleYCoordOfSpecPtr y(new giskard_core::DoubleYCoordOfSpec());
+      y->set_vector(position);
+      giskard_core::DoubleZCoordOfSpecPtr z(new giskard_core::DoubleZCoordOfSpec());
+      z->set_vector(position);
+      giskard_core::DoubleReferenceSpecPtr error(new giskard_core::DoubleReferenceSpec());
+      error->set_reference_name("pr2_fk_error");
+
+      expressions.push_back(x);
+      expressions.push_back(y);
+      expressions.push_back(z);
+      expressions.push_back(error);
+    }
+
+    virtual void TearDown() {}
+
+    giskard_core::QPControllerSpec spec;
+    std::vector<std::string> controllables;
+    std::vector<giskard_core::DoubleSpecPtr> expressions;
+};
+
+TEST_F(BatchExpressionArrayTest, MatchesExpressionGraph)
+{
+  giskard_core::BatchExpressionArray<4> batch;
+  ASSERT_NO_THROW(batch.init(spec.scope_, expressions, controllables));
+  EXPECT_EQ(4u, batch.num_expressions());
+  EXPECT_EQ(controllables.size(), batch.num_derivatives());
+  EXPECT_EQ(controllables.size(), batch.num_observables());
+
+  // not a multiple of the number of lanes
+  size_t num_states = 11;
+  Eigen::MatrixXd observables(batch.num_observables(), num_states);
+  for(size_t i=0; i<num_states; ++i)
+    for(size_t j=0; j<batch.num_observables(); ++j)
+      observables(j, i) = 0.05 * i - 0.1 * j;
+  batch.update(observables);
+  ASSERT_EQ(4, batch.get_values().rows());
+  ASSERT_EQ(num_states, static_cast<size_t>(batch.get_values().cols()));
+
+  giskard_core::Scope scope = giskard_core::generate(spec.scope_, controllables);
+  std::vector< KDL::Expression<double>::Ptr > graphs;
+  for(size_t i=0; i<expressions.size(); ++i)
+    graphs.push_back(expressions[i]->get_expression(scope));
+
+  for(size_t i=0; i<num_states; ++i)
+  {
+    std::vector<double> state(observables.col(i).data(), observables.col(i).data() + observables.rows());
+    for(size_t k=0; k<graphs.size(); ++k)
+    {
+      graphs[k]->setInputValues(state);
+      EXPECT_NEAR(graphs[k]->value(), batch.get_values()(k, i), 1e-10);
+      for(size_t j=0; j<controllables.size(); ++j)
+        EXPECT_NEAR(graphs[k]->derivative(j), batch.get_derivatives(i)(k, j), 1e-10);
+    }
+  }
+}
+
+TEST_F(BatchExpressionArrayTest, LaneCounts)
+{
+  giskard_core::BatchExpressionArray<1> single;
+  giskard_core::BatchExpressionArray<8> wide;
+  single.init(spec.scope_, expressions, controllables);
+  wide.init(spec.scope_, expressions, controllables);
+
+  Eigen::MatrixXd observables = Eigen::MatrixXd::Random(single.num_observables(), 13);
+  single.update(observables);
+  wide.update(observables);
+  EXPECT_TRUE(single.get_values().isApprox(wide.get_values()));
+  for(size_t i=0; i<13; ++i)
+    EXPECT_TRUE(single.get_derivatives(i).isApprox(wide.get_derivatives(i)));
+
+  EXPECT_THROW(wide.update(Eigen::MatrixXd::Zero(1, 3)), std::invalid_argument);
+}
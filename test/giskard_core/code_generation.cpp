@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+// generated by giskard_codegen from pr2_qp_position_control.yaml at build time
+extern "C" void pr2_qp_position_control_codegen(const double* observables, double* H, double* g,
+    double* A, double* lb, double* ub, double* lbA, double* ubA);
+extern "C" void pr2_qp_position_control_codegen_dimensions(unsigned int* num_observables,
+    unsigned int* num_weights, unsigned int* num_constraints);
+
+// pretends that the generated code was made for one more observable
+void dimensions_with_extra_observable(unsigned int* num_observables,
+    unsigned int* num_weights, unsigned int* num_constraints)
+{
+  pr2_qp_position_control_codegen_dimensions(num_observables, num_weights, num_constraints);
+  ++(*num_observables);
+}
+
+class CodeGenerationTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      YAML::Node node = YAML::LoadFile("pr2_qp_position_control.yaml");
+      spec = node.as<giskard_core::QPControllerSpec>();
+    }
+
+    virtual void TearDown() {}
+
+    std::vector<double> evaluate(const giskard_core::Tape& tape, const Eigen::VectorXd& inputs)
+    {
+      std::vector<double> values(tape.size());
+      for(size_t i=0; i<tape.size(); ++i)
+      {
+        const giskard_core::TapeInstruction& instruction = tape.get_instruction(i);
+        if(instruction.operation_ == giskard_core::toConstant)
+          values[i] = instruction.value_;
+        else if(instruction.operation_ == giskard_core::toInput)
+          values[i] = inputs(static_cast<size_t>(instruction.value_));
+        else
+          values[i] = giskard_core::evaluate(instruction.operation_, values[instruction.arguments_[0]],
+              values[instruction.arguments_[1]], values[instruction.arguments_[2]]);
+      }
+      return values;
+    }
+
+    giskard_core::QPControllerSpec spec;
+};
+
+TEST_F(CodeGenerationTest, ConstantSpecs)
+{
+  giskard_core::Tape tape;
+  giskard_core::Scope scope;
+  giskard_core::TapeGenerator generator(tape, scope);
+
+  giskard_core::DoubleSpecPtr angle = giskard_core::double_const_spec(0.3);
+  giskard_core::VectorSpecPtr axis = giskard_core::vector_constructor_spec(
+      giskard_core::double_const_spec(0.0), giskard_core::double_const_spec(0.0),
+      giskard_core::double_const_spec(1.0));
+  giskard_core::VectorSpecPtr vector = giskard_core::vector_constructor_spec(
+      giskard_core::double_const_spec(1.0), giskard_core::double_const_spec(2.0),
+      giskard_core::double_const_spec(3.0));
+  giskard_core::AxisAngleSpecPtr rotation(new giskard_core::AxisAngleSpec());
+  rotation->set_axis(axis);
+  rotation->set_angle(angle);
+  giskard_core::VectorRotationMultiplicationSpecPtr rotated(new giskard_core::VectorRotationMultiplicationSpec());
+  rotated->set_rotation(rotation);
+  rotated->set_vector(vector);
+
+  giskard_core::TapeVector result = generator.generate_vector(rotated);
+  KDL::Vector expected = KDL::Rotation::Rot2(KDL::Vector(0, 0, 1), 0.3) * KDL::Vector(1, 2, 3);
+  for(size_t i=0; i<3; ++i)
+    EXPECT_TRUE(tape.is_constant(result[i]));
+  EXPECT_NEAR(expected.x(), tape.get_instruction(result[0]).value_, 1e-12);
+  EXPECT_NEAR(expected.y(), tape.get_instruction(result[1]).value_, 1e-12);
+  EXPECT_NEAR(expected.z(), tape.get_instruction(result[2]).value_, 1e-12);
+}
+
+TEST_F(CodeGenerationTest, RotationVector)
+{
+  giskard_core::Tape tape;
+  giskard_core::Scope scope;
+  scope.add_matrix_frame_input("f");
+  size_t index = scope.find_input("f")->idx_;
+  giskard_core::TapeGenerator generator(tape, scope);
+
+  giskard_core::VectorRotationVectorSpecPtr spec(new giskard_core::VectorRotationVectorSpec());
+  spec->set_rotation(giskard_core::orientation_of_spec(
+      giskard_core::MatrixFrameInputSpecPtr(new giskard_core::MatrixFrameInputSpec("f"))));
+  giskard_core::TapeVector result = generator.generate_vector(spec);
+
+  std::vector<KDL::Rotation> rotations;
+  KDL::Vector axes[] = {KDL::Vector(1, 0, 0), KDL::Vector(0, 1, 0), KDL::Vector(0, 0, 1),
+      KDL::Vector(1, 2, -3) / KDL::Vector(1, 2, -3).Norm(), KDL::Vector(-1, 1, 0) / std::sqrt(2.0)};
+  double angles[] = {M_PI, M_PI - 1e-3, 2.0, 0.3, 1e-9};
+  for(size_t i=0; i<5; ++i)
+    for(size_t j=0; j<5; ++j)
+      rotations.push_back(KDL::Rotation::Rot2(axes[i], angles[j]));
+
+  for(size_t i=0; i<rotations.size(); ++i)
+  {
+    Eigen::VectorXd inputs = Eigen::VectorXd::Zero(index + 12);
+    for(size_t j=0; j<3; ++j)
+      for(size_t k=0; k<3; ++k)
+        inputs(index + 3*j + k) = rotations[i](j, k);
+    std::vector<double> values = evaluate(tape, inputs);
+
+    KDL::Vector expected = rotations[i].GetRot();
+    EXPECT_NEAR(expected.x(), values[result[0]], 1e-6);
+    EXPECT_NEAR(expected.y(), values[result[1]], 1e-6);
+    EXPECT_NEAR(expected.z(), values[result[2]], 1e-6);
+  }
+}
+
+TEST_F(CodeGenerationTest, Dimensions)
+{
+  giskard_core::QPController controller = giskard_core::generate(spec);
+  giskard_core::QPTape qp = giskard_core::generate_tape(spec);
+
+  EXPECT_EQ(controller.num_controllables(), qp.num_controllables());
+  EXPECT_EQ(controller.num_soft_constraints(), qp.num_soft_constraints());
+  EXPECT_EQ(controller.get_qp_builder().num_weights(), qp.num_weights());
+  EXPECT_EQ(controller.get_qp_builder().num_constraints(), qp.num_constraints());
+
+  giskard_core::CodeGenerator generator(qp);
+  std::string code = generator.generate("pr2_qp");
+  EXPECT_LE(generator.num_observables(), controller.num_observables());
+  EXPECT_NE(std::string::npos, code.find("*num_observables = " +
+      std::to_string(controller.get_input_size()) + ";"));
+  EXPECT_NE(std::string::npos, code.find("extern \"C\" void pr2_qp("));
+  EXPECT_NE(std::string::npos, code.find("extern \"C\" void pr2_qp_dimensions("));
+}
+
+TEST_F(CodeGenerationTest, MatchesQPProblemBuilder)
+{
+  giskard_core::QPController controller = giskard_core::generate(spec);
+  giskard_core::QPTape qp = giskard_core::generate_tape(spec);
+  const giskard_core::QPProblemBuilder& builder = controller.get_qp_builder();
+
+  Eigen::VectorXd observables(controller.num_observables());
+  for(size_t i=0; i<controller.num_observables(); ++i)
+    observables(i) = 0.1 * i - 0.3;
+  ASSERT_TRUE(controller.start(observables, 100));
+
+  std::vector<double> values = evaluate(qp.tape_, observables);
+  size_t nc = qp.num_controllables();
+  size_t nh = qp.num_hard_constraints();
+  for(size_t i=0; i<nc; ++i)
+  {
+    EXPECT_NEAR(builder.get_H()(i, i), values[qp.controllable_weights_[i]], 1e-10);
+    EXPECT_NEAR(builder.get_lb()(i), values[qp.controllable_lower_bounds_[i]], 1e-10);
+    EXPECT_NEAR(builder.get_ub()(i), values[qp.controllable_upper_bounds_[i]], 1e-10);
+  }
+  for(size_t i=0; i<qp.num_soft_constraints(); ++i)
+  {
+    EXPECT_NEAR(builder.get_H()(nc + i, nc + i), values[qp.soft_weights_[i]], 1e-10);
+    EXPECT_NEAR(builder.get_lbA()(nh + i), values[qp.soft_lower_bounds_[i]], 1e-10);
+    EXPECT_NEAR(builder.get_ubA()(nh + i), values[qp.soft_upper_bounds_[i]], 1e-10);
+    for(size_t j=0; j<nc; ++j)
+    {
+      double derivative = qp.soft_derivatives_[i].count(j) ?
+          values[qp.soft_derivatives_[i].find(j)->second] : 0.0;
+      EXPECT_NEAR(builder.get_A()(nh + i, j), derivative, 1e-10);
+    }
+  }
+}
+
+TEST_F(CodeGenerationTest, CompiledEvaluator)
+{
+  giskard_core::QPController graph_controller = giskard_core::generate(spec);
+  giskard_core::QPController compiled_controller = giskard_core::generate(spec);
+  compiled_controller.set_evaluator(giskard_core::QPEvaluator(&pr2_qp_position_control_codegen,
+      &pr2_qp_position_control_codegen_dimensions));
+  ASSERT_TRUE(compiled_controller.get_qp_builder().has_evaluator());
+
+  Eigen::VectorXd observables(graph_controller.num_observables());
+  for(size_t i=0; i<graph_controller.num_observables(); ++i)
+    observables(i) = 0.1 * i - 0.3;
+
+  ASSERT_TRUE(graph_controller.start(observables, 100));
+  ASSERT_TRUE(compiled_controller.start(observables, 100));
+  for(size_t i=0; i<5; ++i)
+  {
+    ASSERT_TRUE(graph_controller.update(observables, 100));
+    ASSERT_TRUE(compiled_controller.update(observables, 100));
+
+    const giskard_core::QPProblemBuilder& graph = graph_controller.get_qp_builder();
+    const giskard_core::QPProblemBuilder& compiled = compiled_controller.get_qp_builder();
+    EXPECT_TRUE(graph.get_H().isApprox(compiled.get_H()));
+    EXPECT_TRUE(graph.get_g().isApprox(compiled.get_g()));
+    EXPECT_TRUE(graph.get_A().isApprox(compiled.get_A()));
+    EXPECT_TRUE(graph.get_lb().isApprox(compiled.get_lb()));
+    EXPECT_TRUE(graph.get_ub().isApprox(compiled.get_ub()));
+    EXPECT_TRUE(graph.get_lbA().isApprox(compiled.get_lbA()));
+    EXPECT_TRUE(graph.get_ubA().isApprox(compiled.get_ubA()));
+    EXPECT_TRUE(graph_controller.get_command().isApprox(compiled_controller.get_command()));
+
+    for(size_t j=0; j<graph_controller.num_controllables(); ++j)
+      observables(j) += graph_controller.get_command()(j);
+  }
+}
+
+TEST_F(CodeGenerationTest, RejectsOtherObservables)
+{
+  giskard_core::QPController controller = giskard_core::generate(spec);
+  EXPECT_THROW(controller.set_evaluator(giskard_core::QPEvaluator(&pr2_qp_position_control_codegen,
+      &dimensions_with_extra_observable)), std::invalid_argument);
+  EXPECT_FALSE(controller.get_qp_builder().has_evaluator());
+}
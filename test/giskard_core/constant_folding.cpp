@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class ConstantFoldingTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      std::string s =
+          "- a: {input-joint: a}\n"
+          "- offset: {double-add: [0.5, {double-mul: [2.0, 3.0]}]}\n"
+          "- axis: {vector3: [0, 0, 1]}\n"
+          "- rot: {axis-angle: [axis, {double-mul: [0.5, 3.0]}]}\n"
+          "- fixed: {frame: [rot, {vector3: [offset, 0, 0]}]}\n"
+          "- moving: {frame-mul: [fixed, {frame: [{axis-angle: [axis, a]}, {vector3: [offset, 0, 0]}]}]}\n";
+      scope_spec = YAML::Load(s).as<giskard_core::ScopeSpec>();
+    }
+
+    virtual void TearDown() {}
+
+    giskard_core::ScopeSpec scope_spec;
+};
+
+TEST_F(ConstantFoldingTest, ConstantEntries)
+{
+  giskard_core::Scope scope = giskard_core::generate(scope_spec);
+  ASSERT_TRUE(scope.get_fold_constants());
+
+  KDL::Expression<double>::Ptr offset = scope.find_double_expression("offset");
+  EXPECT_TRUE(giskard_core::is_constant<double>(offset));
+  EXPECT_DOUBLE_EQ(6.5, offset->value());
+
+  KDL::Expression<KDL::Frame>::Ptr fixed = scope.find_frame_expression("fixed");
+  EXPECT_TRUE(giskard_core::is_constant<KDL::Frame>(fixed));
+  EXPECT_TRUE(KDL::Equal(KDL::Frame(KDL::Rotation::RotZ(1.5), KDL::Vector(6.5, 0, 0)), fixed->value()));
+}
+
+TEST_F(ConstantFoldingTest, MixedEntries)
+{
+  std::vector<std::string> controllables;
+  controllables.push_back("a");
+  giskard_core::Scope scope = giskard_core::generate(scope_spec, controllables);
+
+  KDL::Expression<KDL::Frame>::Ptr moving = scope.find_frame_expression("moving");
+  EXPECT_FALSE(giskard_core::is_constant<KDL::Frame>(moving));
+
+  moving->setInputValue(0, 0.4);
+  KDL::Frame expected = KDL::Frame(KDL::Rotation::RotZ(1.5), KDL::Vector(6.5, 0, 0)) *
+      KDL::Frame(KDL::Rotation::RotZ(0.4), KDL::Vector(6.5, 0, 0));
+  EXPECT_TRUE(KDL::Equal(expected, moving->value()));
+  EXPECT_NEAR(1.0, moving->derivative(0).rot.z(), KDL::epsilon);
+}
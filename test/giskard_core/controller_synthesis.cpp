@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class ControllerSynthesisTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {}
+    virtual void TearDown() {}
+
+    giskard_core::SyntheticControllerOptions options(size_t num_joints, size_t num_branches,
+        size_t num_soft_constraints, size_t num_hard_constraints, size_t num_goal_inputs)
+    {
+      giskard_core::SyntheticControllerOptions result;
+      result.num_joints_ = num_joints;
+      result.num_branches_ = num_branches;
+      result.num_soft_constraints_ = num_soft_constraints;
+      result.num_hard_constraints_ = num_hard_constraints;
+      result.num_goal_inputs_ = num_goal_inputs;
+      return result;
+    }
+
+    giskard_core::QPControllerSpec synthesize(const giskard_core::SyntheticControllerOptions& options)
+    {
+      // round trip through the emitter, just like the tool
+      YAML::Emitter out;
+      out << giskard_core::synthesize_controller(options);
+      return YAML::Load(out.c_str()).as<giskard_core::QPControllerSpec>();
+    }
+};
+
+TEST_F(ControllerSynthesisTest, Dimensions)
+{
+  giskard_core::QPControllerSpec spec;
+  ASSERT_NO_THROW(spec = synthesize(options(12, 3, 20, 15, 2)));
+  EXPECT_EQ(12u, spec.controllable_constraints_.size());
+  EXPECT_EQ(20u, spec.soft_constraints_.size());
+  EXPECT_EQ(15u, spec.hard_constraints_.size());
+
+  giskard_core::QPController controller;
+  ASSERT_NO_THROW(controller = giskard_core::generate(spec));
+  EXPECT_EQ(12u, controller.num_controllables());
+  EXPECT_EQ(20u, controller.num_soft_constraints());
+  EXPECT_EQ(15u, controller.get_qp_builder().num_hard_constraints());
+  EXPECT_EQ(0u, controller.num_folded_hard_constraints());
+  EXPECT_EQ(12u + 2u * 3u, controller.get_input_size());
+  EXPECT_EQ(2u, controller.get_input_names(giskard_core::tVector3).size());
+}
+
+TEST_F(ControllerSynthesisTest, Kinematics)
+{
+  // a single chain of 7 joints, on a mount 10cm above the base
+  giskard_core::Scope scope = giskard_core::generate(synthesize(options(7, 1, 3, 0, 1)).scope_);
+  ASSERT_TRUE(scope.has_frame_expression("branch_0"));
+  KDL::Expression<KDL::Frame>::Ptr tip = scope.find_frame_expression("branch_0");
+  tip->setInputValues(std::vector<double>(7, 0.0));
+  EXPECT_TRUE(KDL::Equal(KDL::Vector(0.7, 0, 0.1), tip->value().p));
+
+  // a trunk of 2 joints, with two branches of 2 joints each on top
+  scope = giskard_core::generate(synthesize(options(6, 2, 3, 0, 1)).scope_);
+  ASSERT_TRUE(scope.has_frame_expression("trunk"));
+  ASSERT_TRUE(scope.has_frame_expression("branch_1"));
+  tip = scope.find_frame_expression("branch_1");
+  tip->setInputValues(std::vector<double>(6, 0.0));
+  EXPECT_TRUE(KDL::Equal(KDL::Vector(0.4, 0.2, 0.2), tip->value().p));
+}
+
+TEST_F(ControllerSynthesisTest, Control)
+{
+  giskard_core::QPController controller = giskard_core::generate(synthesize(options(7, 1, 3, 10, 1)));
+  Eigen::VectorXd observables = Eigen::VectorXd::Zero(controller.get_input_size());
+  std::vector<giskard_core::JointInputHandle> joints;
+  for (size_t i = 0; i < 7; ++i)
+  {
+    joints.push_back(controller.get_joint_input_handle(giskard_core::ControllerSynthesizer::joint_name(i)));
+    controller.set_input(observables, joints[i], 0.3);
+  }
+  controller.set_input(observables, "goal_0", Eigen::Vector3d(0.3, 0.3, 0.3));
+
+  giskard_core::Scope scope = controller.get_scope();
+  KDL::Expression<KDL::Vector>::Ptr position = scope.find_vector_expression("branch_0_position");
+  std::vector<double> q(7, 0.3);
+  position->setInputValues(q);
+  double initial_error = (position->value() - KDL::Vector(0.3, 0.3, 0.3)).Norm();
+
+  int nWSR = 100;
+  ASSERT_TRUE(controller.start(observables, nWSR));
+  for (size_t i = 0; i < 100; ++i)
+  {
+    ASSERT_TRUE(controller.update(observables, nWSR));
+    for (size_t j = 0; j < 7; ++j)
+    {
+      q[j] += 0.1 * controller.get_command()(j);
+      controller.set_input(observables, joints[j], q[j]);
+    }
+  }
+
+  position->setInputValues(q);
+  EXPECT_LT((position->value() - KDL::Vector(0.3, 0.3, 0.3)).Norm(), 0.1 * initial_error);
+}
+
+TEST_F(ControllerSynthesisTest, InvalidOptions)
+{
+  EXPECT_THROW(giskard_core::synthesize_controller(options(7, 0, 3, 0, 1)), std::invalid_argument);
+  EXPECT_THROW(giskard_core::synthesize_controller(options(2, 3, 3, 0, 1)), std::invalid_argument);
+}
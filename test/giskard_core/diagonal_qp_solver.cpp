@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "synthetic_solver_test.hpp"
+
+class DiagonalQPSolverTest : public SyntheticSolverTest
+{
+  protected:
+    // Both controllers get the same observables, the joints follow the first one.
+    void compare(giskard_core::QPController& a, giskard_core::QPController& b)
+    {
+      Eigen::VectorXd state = initial_state(a);
+      ASSERT_TRUE(a.start(state, nWSR));
+      ASSERT_TRUE(b.start(state, nWSR));
+      for(size_t i=0; i<20; ++i)
+      {
+        ASSERT_TRUE(a.update(state, nWSR));
+        ASSERT_TRUE(b.update(state, nWSR));
+        for(size_t j=0; j<a.num_controllables(); ++j)
+          EXPECT_NEAR(a.get_command()(j), b.get_command()(j), 1e-6);
+        EXPECT_EQ(a.get_working_set(), b.get_working_set());
+        state.head(a.num_controllables()) += 0.01 * a.get_command();
+      }
+    }
+};
+
+TEST_F(DiagonalQPSolverTest, Dense)
+{
+  giskard_core::QPController general = giskard_core::generate(spec);
+  giskard_core::QPController diagonal = general;
+  diagonal.set_solver(giskard_core::DiagonalQPSolver());
+  compare(general, diagonal);
+
+  // copies solve on their own
+  giskard_core::QPController copy = diagonal;
+  compare(general, copy);
+}
+
+TEST_F(DiagonalQPSolverTest, Sparse)
+{
+  giskard_core::QPProblemOptions options;
+  options.sparse_ = true;
+  giskard_core::QPController general = giskard_core::generate(spec, options);
+  giskard_core::QPController diagonal = general;
+  diagonal.set_solver(giskard_core::DiagonalQPSolver());
+  compare(general, diagonal);
+}
+
+TEST_F(DiagonalQPSolverTest, Restrictions)
+{
+  giskard_core::QPProblemOptions options;
+  options.soft_constraint_formulation_ = giskard_core::sfLeastSquares;
+  giskard_core::QPController least_squares = giskard_core::generate(spec, options);
+  // NOTE: The bounds of the synthetic soft constraints coincide.
+  ASSERT_LT(0u, least_squares.get_qp_builder().num_least_squares_soft_constraints());
+  EXPECT_THROW(least_squares.set_solver(giskard_core::DiagonalQPSolver()), std::invalid_argument);
+
+  // weights that are not positive
+  spec.controllable_constraints_[0].weight_ = giskard_core::double_const_spec(0.0);
+  giskard_core::QPController controller = giskard_core::generate(spec);
+  controller.set_solver(giskard_core::DiagonalQPSolver());
+  EXPECT_FALSE(controller.start(initial_state(controller), nWSR));
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2016-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class EncodedFrameInputTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      frame = KDL::Frame(KDL::Rotation::Quaternion(0.348, -0.52, 0.616, -0.479), KDL::Vector(0.1, -0.4, 1.2));
+      omega = KDL::Vector(0.3, -1.1, 0.7);
+    }
+
+    virtual void TearDown(){}
+
+    double evaluate(const KDL::Expression<double>::Ptr& expression, const Eigen::VectorXd& inputs)
+    {
+      expression->setInputValues(std::vector<double>(inputs.data(), inputs.data() + inputs.size()));
+      return expression->value();
+    }
+
+    std::vector<double> evaluate(const giskard_core::Tape& tape, const std::vector<double>& inputs)
+    {
+      std::vector<double> values(tape.size());
+      for(size_t i=0; i<tape.size(); ++i)
+      {
+        const giskard_core::TapeInstruction& instruction = tape.get_instruction(i);
+        if(instruction.operation_ == giskard_core::toConstant)
+          values[i] = instruction.value_;
+        else if(instruction.operation_ == giskard_core::toInput)
+          values[i] = inputs[static_cast<size_t>(instruction.value_)];
+        else
+          values[i] = giskard_core::evaluate(instruction.operation_, values[instruction.arguments_[0]],
+              values[instruction.arguments_[1]], values[instruction.arguments_[2]]);
+      }
+      return values;
+    }
+
+    KDL::Frame frame;
+    KDL::Vector omega;
+};
+
+TEST_F(EncodedFrameInputTest, QuaternionToRotation)
+{
+  double x, y, z, w;
+  frame.M.GetQuaternion(x, y, z, w);
+  EXPECT_TRUE(KDL::Equal(frame.M, giskard_core::quaternion_to_rotation(KDL::Vector(x, y, z), w), 1e-12));
+
+  // no need to normalize the quaternion
+  EXPECT_TRUE(KDL::Equal(frame.M,
+        giskard_core::quaternion_to_rotation(KDL::Vector(-2*x, -2*y, -2*z), -2*w), 1e-12));
+  EXPECT_TRUE(KDL::Equal(KDL::Rotation::Identity(),
+        giskard_core::quaternion_to_rotation(KDL::Vector::Zero(), 0.0)));
+}
+
+TEST_F(EncodedFrameInputTest, QuaternionFrameExpression)
+{
+  giskard_core::Scope scope;
+  scope.add_quaternion_frame_input("frame");
+  ASSERT_EQ(7u, scope.get_input_size());
+  EXPECT_THROW(scope.add_frame_input("frame"), std::invalid_argument);
+  EXPECT_THROW(scope.find_input<giskard_core::Scope::FrameInput>("frame"), std::invalid_argument);
+
+  double x, y, z, w;
+  frame.M.GetQuaternion(x, y, z, w);
+  std::vector<double> inputs = {x, y, z, w, frame.p.x(), frame.p.y(), frame.p.z()};
+  KDL::Expression<KDL::Frame>::Ptr expression =
+    scope.find_input<giskard_core::Scope::QuaternionFrameInput>("frame")->expr_;
+  expression->setInputValues(inputs);
+  EXPECT_TRUE(KDL::Equal(frame, expression->value(), 1e-12));
+
+  // moving the quaternion along q_dot = 0.5 * (omega, 0) * q rotates with omega
+  KDL::Vector v(x, y, z);
+  KDL::Vector v_dot = 0.5 * (w * omega + omega * v);
+  double w_dot = -0.5 * KDL::dot(omega, v);
+  double q_dot[] = {v_dot.x(), v_dot.y(), v_dot.z(), w_dot};
+  KDL::Vector result = KDL::Vector::Zero();
+  for(int i=0; i<4; ++i)
+    result += q_dot[i] * expression->derivative(i).rot;
+  EXPECT_TRUE(KDL::Equal(omega, result, 1e-12));
+  EXPECT_TRUE(KDL::Equal(KDL::Vector(0, 1, 0), expression->derivative(5).vel));
+}
+
+TEST_F(EncodedFrameInputTest, MatrixFrameExpression)
+{
+  giskard_core::Scope scope;
+  scope.add_matrix_frame_input("frame");
+  ASSERT_EQ(12u, scope.get_input_size());
+  EXPECT_THROW(scope.add_quaternion_frame_input("frame"), std::invalid_argument);
+
+  std::vector<double> inputs(frame.M.data, frame.M.data + 9);
+  inputs.push_back(frame.p.x());
+  inputs.push_back(frame.p.y());
+  inputs.push_back(frame.p.z());
+  KDL::Expression<KDL::Frame>::Ptr expression =
+    scope.find_input<giskard_core::Scope::MatrixFrameInput>("frame")->expr_;
+  expression->setInputValues(inputs);
+  EXPECT_TRUE(KDL::Equal(frame, expression->value(), 1e-12));
+
+  // moving the matrix along R_dot = [omega]x R rotates with omega
+  KDL::Vector result = KDL::Vector::Zero();
+  for(int j=0; j<3; ++j)
+  {
+    KDL::Vector column_dot = omega * KDL::Vector(frame.M(0, j), frame.M(1, j), frame.M(2, j));
+    for(int i=0; i<3; ++i)
+      result += column_dot(i) * expression->derivative(3*i + j).rot;
+  }
+  EXPECT_TRUE(KDL::Equal(omega, result, 1e-12));
+  EXPECT_TRUE(KDL::Equal(KDL::Vector(0, 0, 1), expression->derivative(11).vel));
+}
+
+TEST_F(EncodedFrameInputTest, DerivativeExpressions)
+{
+  double x, y, z, w;
+  frame.M.GetQuaternion(x, y, z, w);
+  std::vector<double> inputs = {2*x, 2*y, 2*z, 2*w};
+  KDL::Expression<KDL::Rotation>::Ptr quaternion = KDL::quaternion_rotation(
+      KDL::vector(KDL::input(0), KDL::input(1), KDL::input(2)), KDL::input(3));
+  quaternion->setInputValues(inputs);
+  quaternion->value();
+  for(int i=0; i<4; ++i)
+  {
+    KDL::Expression<KDL::Vector>::Ptr derivative = quaternion->derivativeExpression(i);
+    derivative->setInputValues(inputs);
+    EXPECT_TRUE(KDL::Equal(quaternion->derivative(i), derivative->value(), 1e-12));
+  }
+
+  inputs.assign(frame.M.data, frame.M.data + 9);
+  KDL::Expression<KDL::Vector>::Ptr columns[3];
+  for(int j=0; j<3; ++j)
+    columns[j] = KDL::vector(KDL::input(j), KDL::input(j + 3), KDL::input(j + 6));
+  KDL::Expression<KDL::Rotation>::Ptr matrix = KDL::matrix_rotation(columns[0], columns[1], columns[2]);
+  matrix->setInputValues(inputs);
+  matrix->value();
+  for(int i=0; i<9; ++i)
+  {
+    KDL::Expression<KDL::Vector>::Ptr derivative = matrix->derivativeExpression(i);
+    derivative->setInputValues(inputs);
+    EXPECT_TRUE(KDL::Equal(matrix->derivative(i), derivative->value(), 1e-12));
+  }
+}
+
+TEST_F(EncodedFrameInputTest, TapeGeneration)
+{
+  giskard_core::Scope scope;
+  scope.add_quaternion_frame_input("quaternion");
+  scope.add_matrix_frame_input("matrix");
+
+  giskard_core::Tape tape;
+  giskard_core::TapeGenerator generator(tape, scope);
+  giskard_core::FrameSpecPtr quaternion_spec(new giskard_core::QuaternionFrameInputSpec("quaternion"));
+  giskard_core::FrameSpecPtr matrix_spec(new giskard_core::MatrixFrameInputSpec("matrix"));
+  giskard_core::TapeFrame quaternion = generator.generate_frame(quaternion_spec);
+  giskard_core::TapeFrame matrix = generator.generate_frame(matrix_spec);
+
+  double x, y, z, w;
+  frame.M.GetQuaternion(x, y, z, w);
+  std::vector<double> inputs = {0.5*x, 0.5*y, 0.5*z, 0.5*w, frame.p.x(), frame.p.y(), frame.p.z()};
+  inputs.insert(inputs.end(), frame.M.data, frame.M.data + 9);
+  inputs.push_back(frame.p.x());
+  inputs.push_back(frame.p.y());
+  inputs.push_back(frame.p.z());
+
+  std::vector<double> values = evaluate(tape, inputs);
+  for(size_t i=0; i<9; ++i)
+  {
+    EXPECT_NEAR(frame.M.data[i], values[quaternion.rotation_[i]], 1e-12);
+    EXPECT_NEAR(frame.M.data[i], values[matrix.rotation_[i]], 1e-12);
+  }
+  for(size_t i=0; i<3; ++i)
+  {
+    EXPECT_NEAR(frame.p(i), values[quaternion.translation_[i]], 1e-12);
+    EXPECT_NEAR(frame.p(i), values[matrix.translation_[i]], 1e-12);
+  }
+
+  // no trigonometry on the tape
+  for(size_t i=0; i<tape.size(); ++i)
+  {
+    EXPECT_NE(giskard_core::toSin, tape.get_instruction(i).operation_);
+    EXPECT_NE(giskard_core::toCos, tape.get_instruction(i).operation_);
+  }
+}
+
+TEST_F(EncodedFrameInputTest, SetInputs)
+{
+  YAML::Node node = YAML::LoadFile("encoded_frame_input_test.yaml");
+
+  giskard_core::QPControllerSpec qp_spec;
+  ASSERT_NO_THROW(qp_spec = node.as< giskard_core::QPControllerSpec >());
+  giskard_core::QPController c = giskard_core::generate(qp_spec);
+  ASSERT_EQ(27u, c.get_input_size());
+
+  EXPECT_THROW(c.get_frame_input_handle("quaternion_frame_input"), std::invalid_argument);
+  EXPECT_THROW(c.get_quaternion_frame_input_handle("matrix_frame_input"), std::invalid_argument);
+  EXPECT_THROW(c.get_matrix_frame_input_handle("frame_input"), std::invalid_argument);
+  giskard_core::QuaternionFrameInputHandle quaternion = c.get_quaternion_frame_input_handle("quaternion_frame_input");
+  giskard_core::MatrixFrameInputHandle matrix = c.get_matrix_frame_input_handle("matrix_frame_input");
+
+  Eigen::Quaterniond eigRot(Eigen::AngleAxisd(-0.56, Eigen::Vector3d(0.6, 0, 0.8)));
+  Eigen::Vector3d eigVec(1, 2, 3);
+  Eigen::Affine3d eigFrame = Eigen::Translation3d(eigVec) * eigRot;
+  const KDL::Expression<double>::Ptr& distance = c.get_scope().find_double_expression("distance");
+
+  // all three frames agree, whichever way they are set
+  Eigen::VectorXd inputs = Eigen::VectorXd::Zero(c.get_input_size());
+  c.set_input(inputs, "frame_input", frame);
+  c.set_input(inputs, "quaternion_frame_input", frame);
+  c.set_input(inputs, "matrix_frame_input", frame);
+  EXPECT_NEAR(0.0, evaluate(distance, inputs), 1e-9);
+
+  c.set_input(inputs, "frame_input", eigFrame);
+  c.set_input(inputs, "quaternion_frame_input", eigFrame);
+  c.set_input(inputs, "matrix_frame_input", eigFrame);
+  EXPECT_NEAR(0.0, evaluate(distance, inputs), 1e-9);
+
+  c.set_input(inputs, "frame_input", frame.M, frame.p);
+  c.set_input(inputs, "quaternion_frame_input", frame.M, frame.p);
+  c.set_input(inputs, "matrix_frame_input", frame.M, frame.p);
+  EXPECT_NEAR(0.0, evaluate(distance, inputs), 1e-9);
+
+  c.set_input(inputs, "frame_input", eigRot, eigVec);
+  c.set_input(inputs, "quaternion_frame_input", eigRot, eigVec);
+  c.set_input(inputs, "matrix_frame_input", eigRot, eigVec);
+  EXPECT_NEAR(0.0, evaluate(distance, inputs), 1e-9);
+
+  // names and handles write the same entries
+  Eigen::VectorXd by_handle = inputs;
+  c.set_input(by_handle, quaternion, eigFrame);
+  c.set_input(by_handle, matrix, eigFrame);
+  EXPECT_TRUE(inputs.isApprox(by_handle));
+  c.set_input(by_handle, quaternion, eigRot.x(), eigRot.y(), eigRot.z(), eigRot.w(), 1, 2, 3);
+  c.set_input(by_handle, matrix, eigRot.toRotationMatrix(), eigVec);
+  EXPECT_TRUE(inputs.isApprox(by_handle));
+  EXPECT_DOUBLE_EQ(eigRot.w(), by_handle[quaternion.idx_ + 3]);
+
+  // too small input vectors
+  Eigen::VectorXd too_small = Eigen::VectorXd::Zero(matrix.idx_ + 11);
+  EXPECT_THROW(c.set_input(too_small, "matrix_frame_input", frame), std::invalid_argument);
+  EXPECT_THROW(c.set_input(too_small, "matrix_frame_input", eigFrame), std::invalid_argument);
+}
@@ -246,3 +246,106 @@ TEST_F(ExpressionArrayTest, DerivativeExpressions)
   EXPECT_DOUBLE_EQ(deriv_exps[2]->value(), 6.0);
   EXPECT_DOUBLE_EQ(deriv_exps[3]->value(), 7.0);
 }
+
+TEST_F(ExpressionArrayTest, LimitedDerivatives)
+{
+  DoubleExpressionArray a;
+  a.set_max_num_derivatives(2);
+  a.set_expressions(exps);
+  EXPECT_EQ(num_derivs, a.num_inputs());
+  EXPECT_EQ(2, a.num_derivatives());
+  EXPECT_EQ(2, a.get_max_num_derivatives());
+
+  a.update(eigen_state); 
+  Eigen::VectorXd values = a.get_values();
+  ASSERT_EQ(values.rows(), num_exps);
+  EXPECT_DOUBLE_EQ(6.0, values(0));
+  EXPECT_DOUBLE_EQ(14.0, values(1));
+  EXPECT_DOUBLE_EQ(36.0, values(2));
+
+  Eigen::MatrixXd derivatives = a.get_derivatives();
+  ASSERT_EQ(derivatives.rows(), num_exps);
+  ASSERT_EQ(derivatives.cols(), 2);
+  EXPECT_DOUBLE_EQ(derivatives(0, 0), 1.0);
+  EXPECT_DOUBLE_EQ(derivatives(0, 1), 2.0);
+  EXPECT_DOUBLE_EQ(derivatives(1, 0), 0.0);
+  EXPECT_DOUBLE_EQ(derivatives(1, 1), 0.0);
+  EXPECT_DOUBLE_EQ(derivatives(2, 0), 0.0);
+  EXPECT_DOUBLE_EQ(derivatives(2, 1), 5.0);
+
+  a.set_max_num_derivatives(std::numeric_limits<size_t>::max());
+  EXPECT_EQ(num_derivs, a.num_derivatives());
+  EXPECT_EQ(num_derivs, a.get_derivatives().cols());
+}
+
+TEST_F(ExpressionArrayTest, NonzeroDerivatives)
+{
+  DoubleExpressionArray a;
+  a.set_expressions(exps);
+
+  ASSERT_EQ(2, a.get_nonzero_derivatives(0).size());
+  EXPECT_EQ(0, a.get_nonzero_derivatives(0)[0]);
+  EXPECT_EQ(1, a.get_nonzero_derivatives(0)[1]);
+  ASSERT_EQ(2, a.get_nonzero_derivatives(1).size());
+  EXPECT_EQ(3, a.get_nonzero_derivatives(1)[0]);
+  EXPECT_EQ(4, a.get_nonzero_derivatives(1)[1]);
+  ASSERT_EQ(3, a.get_nonzero_derivatives(2).size());
+  EXPECT_EQ(1, a.get_nonzero_derivatives(2)[0]);
+  EXPECT_EQ(2, a.get_nonzero_derivatives(2)[1]);
+  EXPECT_EQ(3, a.get_nonzero_derivatives(2)[2]);
+  EXPECT_EQ(7, a.num_nonzero_derivatives());
+
+  // restricting the derivatives also restricts the structure
+  a.set_max_num_derivatives(2);
+  EXPECT_EQ(2, a.get_nonzero_derivatives(0).size());
+  EXPECT_EQ(0, a.get_nonzero_derivatives(1).size());
+  ASSERT_EQ(1, a.get_nonzero_derivatives(2).size());
+  EXPECT_EQ(1, a.get_nonzero_derivatives(2)[0]);
+  EXPECT_EQ(3, a.num_nonzero_derivatives());
+
+  // structural zeros stay zero across updates
+  a.update(eigen_state);
+  a.update(eigen_state);
+  EXPECT_DOUBLE_EQ(0.0, a.get_derivatives()(1, 0));
+  EXPECT_DOUBLE_EQ(0.0, a.get_derivatives()(2, 0));
+  EXPECT_DOUBLE_EQ(5.0, a.get_derivatives()(2, 1));
+}
+
+TEST_F(ExpressionArrayTest, IncrementalUpdates)
+{
+  DoubleExpressionArray a;
+  a.set_expressions(exps);
+
+  a.update(eigen_state);
+  EXPECT_EQ(3, a.num_updated_expressions());
+
+  // nothing changed
+  a.update(eigen_state);
+  EXPECT_EQ(0, a.num_updated_expressions());
+  EXPECT_DOUBLE_EQ(6.0, a.get_values()(0));
+  EXPECT_DOUBLE_EQ(14.0, a.get_values()(1));
+  EXPECT_DOUBLE_EQ(36.0, a.get_values()(2));
+
+  // only exp2 depends on input 4
+  eigen_state(4) = 3.0;
+  a.update(eigen_state);
+  EXPECT_EQ(1, a.num_updated_expressions());
+  EXPECT_DOUBLE_EQ(6.0, a.get_values()(0));
+  EXPECT_DOUBLE_EQ(18.0, a.get_values()(1));
+  EXPECT_DOUBLE_EQ(36.0, a.get_values()(2));
+  EXPECT_DOUBLE_EQ(4.0, a.get_derivatives()(1, 4));
+
+  // exp1 and exp3 depend on input 1
+  eigen_state(1) = 1.0;
+  a.update(eigen_state);
+  EXPECT_EQ(2, a.num_updated_expressions());
+  EXPECT_DOUBLE_EQ(4.0, a.get_values()(0));
+  EXPECT_DOUBLE_EQ(18.0, a.get_values()(1));
+  EXPECT_DOUBLE_EQ(31.0, a.get_values()(2));
+
+  // changing the expressions evaluates everything again
+  a.push_expression(exp1);
+  a.update(eigen_state);
+  EXPECT_EQ(4, a.num_updated_expressions());
+  EXPECT_DOUBLE_EQ(4.0, a.get_values()(3));
+}
@@ -255,6 +255,11 @@ TEST_F(PR2FKTest, QPPositionControl)
   ASSERT_NO_THROW(giskard_core::generate(spec));
   giskard_core::QPController controller = giskard_core::generate(spec);
 
+  // all joint limits end up as bounds of the controllables
+  EXPECT_EQ(6, controller.num_folded_hard_constraints());
+  EXPECT_EQ(1, controller.get_qp_builder().num_constraints());
+  EXPECT_EQ(1, controller.get_qp_builder().get_A().rows());
+
   // setup
   size_t iterations = 400;
   double dt = 0.01;
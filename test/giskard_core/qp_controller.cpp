@@ -21,6 +21,40 @@
 #include <gtest/gtest.h>
 #include <giskard_core/giskard_core.hpp>
 
+// Fails every hotstart, and optionally every solve from a guessed working
+// set, so that the recovery has to go on to its later stages.
+class FailingQPSolver : public giskard_core::QPOasesSolver
+{
+  public:
+    FailingQPSolver(bool fail_guessed_solves) : fail_guessed_solves_( fail_guessed_solves ) {}
+
+    virtual giskard_core::QPSolver* clone() const
+    {
+      return new FailingQPSolver(*this);
+    }
+
+    virtual qpOASES::returnValue solve(const giskard_core::QPProblemBuilder& qp, int& nWSR,
+        double* cputime, const giskard_core::QPWorkingSet* guess)
+    {
+      if(guess && fail_guessed_solves_)
+      {
+        nWSR = 0;
+        return qpOASES::RET_MAX_NWSR_REACHED;
+      }
+      return giskard_core::QPOasesSolver::solve(qp, nWSR, cputime, guess);
+    }
+
+    virtual qpOASES::returnValue hotstart(const giskard_core::QPProblemBuilder& qp, int& nWSR,
+        double* cputime)
+    {
+      nWSR = 0;
+      return qpOASES::RET_MAX_NWSR_REACHED;
+    }
+
+  private:
+    bool fail_guessed_solves_;
+};
+
 class QPControllerTest : public ::testing::Test
 {
   protected:
@@ -161,6 +195,280 @@ TEST_F(QPControllerTest, CommandMap)
   }
 }
 
+TEST_F(QPControllerTest, LeastSquaresSoftConstraints)
+{
+  // turn all soft constraints into equalities
+  soft_upper = soft_lower;
+
+  giskard_core::QPProblemOptions options;
+  options.soft_constraint_formulation_ = giskard_core::sfLeastSquares;
+
+  giskard_core::QPController slack, least_squares;
+  ASSERT_TRUE(slack.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper));
+  ASSERT_TRUE(least_squares.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper, options));
+
+  EXPECT_EQ(5, slack.get_qp_builder().num_weights());
+  EXPECT_EQ(2, least_squares.get_qp_builder().num_weights());
+
+  ASSERT_TRUE(slack.start(initial_state, nWSR));
+  ASSERT_TRUE(least_squares.start(initial_state, nWSR));
+  ASSERT_TRUE(slack.update(initial_state, nWSR));
+  ASSERT_TRUE(least_squares.update(initial_state, nWSR));
+
+  ASSERT_EQ(2, least_squares.get_command().rows());
+  for(size_t i=0; i<2; ++i)
+    EXPECT_NEAR(slack.get_command()(i), least_squares.get_command()(i), 1e-6);
+
+  ASSERT_EQ(3, least_squares.get_slack().rows());
+  for(size_t i=0; i<3; ++i)
+    EXPECT_NEAR(slack.get_slack()(i), least_squares.get_slack()(i), 1e-6);
+}
+
+TEST_F(QPControllerTest, SparseMatrices)
+{
+  giskard_core::QPProblemOptions options;
+  options.sparse_ = true;
+
+  giskard_core::QPController dense, sparse;
+  ASSERT_TRUE(dense.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper));
+  ASSERT_TRUE(sparse.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper, options));
+
+  ASSERT_TRUE(dense.start(initial_state, nWSR));
+  ASSERT_TRUE(sparse.start(initial_state, nWSR));
+
+  Eigen::VectorXd state = initial_state;
+  for(size_t i=0; i<10; ++i)
+  {
+    ASSERT_TRUE(dense.update(state, nWSR));
+    ASSERT_TRUE(sparse.update(state, nWSR));
+    for(size_t j=0; j<2; ++j)
+      EXPECT_NEAR(dense.get_command()(j), sparse.get_command()(j), 1e-6);
+    state += dense.get_command();
+  }
+}
+
+TEST_F(QPControllerTest, WorkingSet)
+{
+  giskard_core::QPController cold, hot;
+  ASSERT_TRUE(cold.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper));
+  ASSERT_TRUE(hot.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper));
+  EXPECT_TRUE(cold.get_working_set().empty());
+
+  ASSERT_TRUE(cold.start(initial_state, nWSR));
+  Eigen::VectorXd state = initial_state;
+  for(size_t i=0; i<5; ++i)
+  {
+    ASSERT_TRUE(cold.update(state, nWSR));
+    state += cold.get_command();
+  }
+
+  // export, persist as YAML, and import into a controller with the same structure
+  giskard_core::QPWorkingSet working_set = cold.get_working_set();
+  ASSERT_EQ(5u, working_set.bounds_.size());
+  ASSERT_EQ(5u, working_set.constraints_.size());
+  YAML::Node node;
+  node = working_set;
+  ASSERT_EQ(working_set, node.as<giskard_core::QPWorkingSet>());
+
+  ASSERT_TRUE(hot.start(state, nWSR, node.as<giskard_core::QPWorkingSet>()));
+  ASSERT_TRUE(hot.update(state, nWSR));
+  ASSERT_TRUE(cold.update(state, nWSR));
+  for(size_t i=0; i<2; ++i)
+    EXPECT_NEAR(cold.get_command()(i), hot.get_command()(i), 1e-6);
+
+  // restarting from the live solver gives the same solution as a cold start
+  ASSERT_TRUE(hot.restart(initial_state, nWSR));
+  ASSERT_TRUE(cold.start(initial_state, nWSR));
+  ASSERT_TRUE(hot.update(initial_state, nWSR));
+  ASSERT_TRUE(cold.update(initial_state, nWSR));
+  for(size_t i=0; i<2; ++i)
+    EXPECT_NEAR(cold.get_command()(i), hot.get_command()(i), 1e-6);
+
+  working_set.bounds_.pop_back();
+  EXPECT_THROW(hot.start(state, nWSR, working_set), std::invalid_argument);
+}
+
+TEST_F(QPControllerTest, Recovery)
+{
+  giskard_core::QPController controller;
+  ASSERT_TRUE(controller.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper));
+  EXPECT_FALSE(controller.get_recovery_options().enabled_);
+  controller.enable_statistics(10);
+
+  ASSERT_TRUE(controller.start(initial_state, nWSR));
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  Eigen::VectorXd command = controller.get_command();
+
+  // without any working set recalculations, the hotstart cannot finish
+  int no_nWSR = 0;
+  EXPECT_FALSE(controller.update(initial_state, no_nWSR));
+  EXPECT_EQ(giskard_core::rsNone, controller.get_statistics().get_latest_record().recovery_stage_);
+
+  giskard_core::QPRecoveryOptions options;
+  options.enabled_ = true;
+  options.nWSR_ = nWSR;
+  options.cputime_ = 1.0;
+  controller.set_recovery_options(options);
+  ASSERT_TRUE(controller.start(initial_state, nWSR));
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+
+  ASSERT_TRUE(controller.update(initial_state, no_nWSR));
+  const giskard_core::UpdateRecord& record = controller.get_statistics().get_latest_record();
+  EXPECT_EQ(giskard_core::rsRetry, record.recovery_stage_);
+  EXPECT_GT(record.nWSR_, 0);
+  EXPECT_EQ(0, record.return_value_);
+  EXPECT_EQ(1u, controller.get_statistics().num_recoveries());
+  for(size_t i=0; i<2; ++i)
+    EXPECT_NEAR(command(i), controller.get_command()(i), 1e-6);
+
+  // once recovered, the regular hotstarts work again
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  EXPECT_EQ(giskard_core::rsNone, controller.get_statistics().get_latest_record().recovery_stage_);
+}
+
+TEST_F(QPControllerTest, RecoveryStages)
+{
+  giskard_core::QPRecoveryOptions options;
+  options.enabled_ = true;
+  options.nWSR_ = nWSR;
+
+  // the retry fails, so the working set of the last solution has to do
+  giskard_core::QPController controller;
+  ASSERT_TRUE(controller.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper));
+  controller.enable_statistics(10);
+  controller.set_recovery_options(options);
+  ASSERT_TRUE(controller.start(initial_state, nWSR));
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  Eigen::VectorXd command = controller.get_command();
+
+  controller.set_solver(FailingQPSolver(false));
+  ASSERT_TRUE(controller.start(initial_state, nWSR));
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  const giskard_core::UpdateRecord& record = controller.get_statistics().get_latest_record();
+  EXPECT_EQ(giskard_core::rsWorkingSet, record.recovery_stage_);
+  EXPECT_EQ(0, record.return_value_);
+  for(size_t i=0; i<2; ++i)
+    EXPECT_NEAR(command(i), controller.get_command()(i), 1e-6);
+
+  // the working set fails as well, so only the cold start is left
+  controller.set_solver(FailingQPSolver(true));
+  ASSERT_TRUE(controller.start(initial_state, nWSR));
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  const giskard_core::UpdateRecord& cold_record = controller.get_statistics().get_latest_record();
+  EXPECT_EQ(giskard_core::rsColdStart, cold_record.recovery_stage_);
+  EXPECT_EQ(0, cold_record.return_value_);
+  EXPECT_EQ(2u, controller.get_statistics().num_recoveries());
+  for(size_t i=0; i<2; ++i)
+    EXPECT_NEAR(command(i), controller.get_command()(i), 1e-6);
+}
+
+TEST_F(QPControllerTest, Deadline)
+{
+  giskard_core::QPController controller;
+  ASSERT_TRUE(controller.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper));
+  EXPECT_EQ(0.0, controller.get_deadline());
+  ASSERT_TRUE(controller.start(initial_state, nWSR));
+
+  // a deadline that has passed before the solver runs, without a solution to fall back to
+  controller.set_deadline(1e-6);
+  EXPECT_FALSE(controller.update(initial_state, nWSR));
+  EXPECT_EQ(giskard_core::usZero, controller.get_update_status());
+  EXPECT_TRUE(controller.get_command().isZero());
+
+  controller.set_deadline(1e6);
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  EXPECT_EQ(giskard_core::usSolved, controller.get_update_status());
+  Eigen::VectorXd command = controller.get_command();
+
+  controller.enable_statistics(10);
+  controller.set_deadline(1e-6);
+  EXPECT_FALSE(controller.update(initial_state, nWSR));
+  EXPECT_EQ(giskard_core::usLastSolution, controller.get_update_status());
+  EXPECT_EQ(giskard_core::usLastSolution, controller.get_statistics().get_latest_record().status_);
+  const giskard_core::QPProblemBuilder& builder = controller.get_qp_builder();
+  for(size_t i=0; i<2; ++i)
+  {
+    EXPECT_DOUBLE_EQ(std::min(std::max(command(i), builder.get_lb()(i)), builder.get_ub()(i)),
+        controller.get_command()(i));
+    EXPECT_LE(builder.get_lb()(i), controller.get_command()(i));
+    EXPECT_GE(builder.get_ub()(i), controller.get_command()(i));
+  }
+
+  // without a deadline, a failed update leaves the command as it was
+  controller.set_deadline(0.0);
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  command = controller.get_command();
+  EXPECT_FALSE(controller.update(initial_state, 0));
+  EXPECT_EQ(giskard_core::usFailed, controller.get_update_status());
+  EXPECT_EQ(command, controller.get_command());
+
+  // with a deadline, infeasible QPs fail instead of falling back
+  controller.set_deadline(1e6);
+  ASSERT_TRUE(controller.update(initial_state, nWSR));
+  command = controller.get_command();
+  Eigen::VectorXd infeasible_state = initial_state;
+  infeasible_state(0) = 10.0;
+  EXPECT_FALSE(controller.update(infeasible_state, nWSR));
+  EXPECT_NE(qpOASES::RET_MAX_NWSR_REACHED, controller.get_statistics().get_latest_record().return_value_);
+  EXPECT_EQ(giskard_core::usFailed, controller.get_update_status());
+  EXPECT_EQ(command, controller.get_command());
+}
+
+TEST_F(QPControllerTest, ConstantMatrices)
+{
+  // same QP, but with a weight that is only constant by value
+  std::vector< KDL::Expression<double>::Ptr > weights = controllable_weights;
+  weights[0] = KDL::Constant(mu * 1.1) + KDL::Constant(0.0) * KDL::input(3);
+  giskard_core::QPProblemOptions options;
+  options.detect_constant_matrices_ = true;
+  giskard_core::QPController constant, varying;
+  ASSERT_TRUE(constant.init(controllable_lower, controllable_upper, controllable_weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper, options));
+  ASSERT_TRUE(varying.init(controllable_lower, controllable_upper, weights,
+       controllable_names, soft_expressions, soft_lower, soft_upper, soft_weights,
+       soft_names, hard_expressions, hard_lower, hard_upper, options));
+  EXPECT_TRUE(constant.get_qp_builder().has_constant_matrices());
+  EXPECT_FALSE(varying.get_qp_builder().has_constant_matrices());
+
+  Eigen::VectorXd state = Eigen::VectorXd::Zero(4);
+  state.head(2) = initial_state;
+  ASSERT_TRUE(constant.start(state, nWSR));
+  ASSERT_TRUE(varying.start(state, nWSR));
+  for(size_t i=0; i<10; ++i)
+  {
+    ASSERT_TRUE(constant.update(state, nWSR));
+    ASSERT_TRUE(varying.update(state, nWSR));
+    for(size_t j=0; j<2; ++j)
+      EXPECT_NEAR(varying.get_command()(j), constant.get_command()(j), 1e-6);
+    state.head(2) += constant.get_command();
+  }
+
+  // a copy hotstarts on its own matrices
+  giskard_core::QPController copy = constant;
+  ASSERT_TRUE(copy.update(state, nWSR));
+  ASSERT_TRUE(constant.update(state, nWSR));
+  for(size_t j=0; j<2; ++j)
+    EXPECT_NEAR(constant.get_command()(j), copy.get_command()(j), 1e-6);
+}
 
 // Tests for all 'set_input' functions
 TEST_F(QPControllerTest, SetInputs) {
@@ -331,4 +639,64 @@ TEST_F(QPControllerTest, InputGetters) {
   
   EXPECT_EQ(scope.get_inputs<giskard_core::Scope::FrameInput>(), c.get_inputs<giskard_core::Scope::FrameInput>());
   EXPECT_EQ(scope.get_input_map<giskard_core::Scope::FrameInput>(), c.get_input_map<giskard_core::Scope::FrameInput>());
-}
\ No newline at end of file
+}
+
+TEST_F(QPControllerTest, InputHandles) {
+  YAML::Node node = YAML::LoadFile("named_input_test.yaml");
+
+  giskard_core::QPControllerSpec qp_spec;
+  ASSERT_NO_THROW(qp_spec = node.as< giskard_core::QPControllerSpec >());
+  giskard_core::QPController c = giskard_core::generate(qp_spec);
+
+  // Resolve handles of wrong types or for missing inputs
+  EXPECT_THROW(c.get_joint_input_handle("scalar_input"), std::invalid_argument);
+  EXPECT_THROW(c.get_scalar_input_handle("joint_input"), std::invalid_argument);
+  EXPECT_THROW(c.get_vector_input_handle("frame_input"), std::invalid_argument);
+  EXPECT_THROW(c.get_rotation_input_handle("bla"), std::invalid_argument);
+  EXPECT_THROW(c.get_frame_input_handle("rotation_input"), std::invalid_argument);
+
+  giskard_core::JointInputHandle joint = c.get_joint_input_handle("joint_input");
+  giskard_core::ScalarInputHandle scalar = c.get_scalar_input_handle("scalar_input");
+  giskard_core::Vec3InputHandle vector = c.get_vector_input_handle("vector_input");
+  giskard_core::RotationInputHandle rotation = c.get_rotation_input_handle("rotation_input");
+  giskard_core::RotationInputHandle rotation2 = c.get_rotation_input_handle("rotation_input2");
+  giskard_core::FrameInputHandle frame = c.get_frame_input_handle("frame_input");
+  giskard_core::FrameInputHandle frame2 = c.get_frame_input_handle("frame_input2");
+
+  KDL::Vector kdlVec(1,2,3);
+  KDL::Rotation kdlRot = KDL::Rotation::Rot(KDL::Vector(1,0,0), 1.56);
+  KDL::Frame kdlFrame(kdlRot, kdlVec);
+  Eigen::Vector3d eigVec(1,2,3);
+  Eigen::Quaterniond eigRot2(Eigen::AngleAxisd(-0.56, Eigen::Vector3d(0,1,0)));
+  Eigen::Affine3d eigFrame2 = Eigen::Translation3d(eigVec) * eigRot2;
+
+  // Handles write the same entries as names
+  Eigen::VectorXd by_name = Eigen::VectorXd::Zero(c.get_input_size());
+  c.set_input(by_name, "joint_input", 1.2);
+  c.set_input(by_name, "scalar_input", 3.5);
+  c.set_input(by_name, "vector_input", kdlVec);
+  c.set_input(by_name, "rotation_input", kdlRot);
+  c.set_input(by_name, "rotation_input2", eigRot2);
+  c.set_input(by_name, "frame_input", kdlFrame);
+  c.set_input(by_name, "frame_input2", eigFrame2);
+
+  Eigen::VectorXd by_handle = Eigen::VectorXd::Zero(c.get_input_size());
+  c.set_input(by_handle, joint, 1.2);
+  c.set_input(by_handle, scalar, 3.5);
+  c.set_input(by_handle, vector, kdlVec);
+  c.set_input(by_handle, rotation, kdlRot);
+  c.set_input(by_handle, rotation2, eigRot2);
+  c.set_input(by_handle, frame, kdlFrame);
+  c.set_input(by_handle, frame2, eigFrame2);
+  EXPECT_TRUE(by_name == by_handle);
+
+  by_handle.setZero();
+  c.set_input(by_handle, joint, 1.2);
+  c.set_input(by_handle, scalar, 3.5);
+  c.set_input(by_handle, vector, eigVec);
+  c.set_input(by_handle, rotation, 1, 0, 0, 1.56);
+  c.set_input(by_handle, rotation2, eigRot2);
+  c.set_input(by_handle, frame, 1, 0, 0, 1.56, 1, 2, 3);
+  c.set_input(by_handle, frame2, eigRot2, eigVec);
+  EXPECT_TRUE(by_name.isApprox(by_handle));
+}
@@ -221,3 +221,178 @@ TEST_F(QPProblemBuilderTest, Update)
   ubA << 3.0, 3.1, 1.1, -1.3, 0.35;
   CompareVectors(lbA, b.get_lbA());
 }
+
+TEST_F(QPProblemBuilderTest, ConstantMatrices)
+{
+  giskard_core::QPProblemBuilder b;
+  EXPECT_FALSE(b.has_constant_matrices());
+
+  // only detected on request
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, hard_expressions, hard_lower, hard_upper);
+  EXPECT_FALSE(b.has_constant_matrices());
+
+  giskard_core::QPProblemOptions options;
+  options.detect_constant_matrices_ = true;
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, hard_expressions, hard_lower, hard_upper, options);
+  EXPECT_TRUE(b.has_constant_matrices());
+
+  // bounds may change, they only go into the vectors of the QP
+  std::vector< KDL::Expression<double>::Ptr > lower = hard_lower;
+  lower[0] = KDL::Constant(-3.0) - KDL::input(2);
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, hard_expressions, lower, hard_upper, options);
+  EXPECT_TRUE(b.has_constant_matrices());
+
+  std::vector< KDL::Expression<double>::Ptr > weights = soft_weights;
+  weights[1] = KDL::Constant(2.0) * KDL::input(2);
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, weights, hard_expressions, hard_lower, hard_upper, options);
+  EXPECT_FALSE(b.has_constant_matrices());
+
+  std::vector< KDL::Expression<double>::Ptr > expressions = hard_expressions;
+  expressions[1] = KDL::sin(KDL::input(1));
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, expressions, hard_lower, hard_upper, options);
+  EXPECT_FALSE(b.has_constant_matrices());
+
+  // linear in the controllables, but the coefficient is a goal
+  expressions[1] = KDL::input(2) * KDL::input(1);
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, expressions, hard_lower, hard_upper, options);
+  EXPECT_FALSE(b.has_constant_matrices());
+}
+
+TEST_F(QPProblemBuilderTest, SlerpConstraint)
+{
+  // slerp has no derivative expressions, so init must not ask for them
+  std::vector< KDL::Expression<double>::Ptr > expressions = hard_expressions;
+  expressions[1] = KDL::coord_x(KDL::slerp(KDL::rot_x(KDL::input(0)), KDL::rot_y(KDL::input(1)),
+      KDL::Constant(0.5)) * KDL::Constant(KDL::Vector(0.0, 0.0, 1.0)));
+
+  giskard_core::QPProblemBuilder b;
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, expressions, hard_lower, hard_upper);
+  EXPECT_FALSE(b.has_constant_matrices());
+
+  b.update(initial_state);
+  EXPECT_DOUBLE_EQ(-3.0, b.get_lbA()(0));
+  EXPECT_DOUBLE_EQ(3.1, b.get_ubA()(1));
+}
+
+TEST_F(QPProblemBuilderTest, SingleExpressionArray)
+{
+  giskard_core::QPProblemBuilder b;
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, hard_expressions, hard_lower, hard_upper);
+
+  EXPECT_EQ(2*3 + 3*4 + 2*3, b.get_expression_array().num_expressions());
+  EXPECT_EQ(2, b.num_observables());
+  EXPECT_EQ(2, b.get_expression_array().num_derivatives());
+
+  EXPECT_EQ(controllable_lower, b.get_controllable_lower_bounds());
+  EXPECT_EQ(controllable_upper, b.get_controllable_upper_bounds());
+  EXPECT_EQ(controllable_weights, b.get_controllable_weights());
+  EXPECT_EQ(soft_expressions, b.get_soft_expressions());
+  EXPECT_EQ(soft_lower, b.get_soft_lower_bounds());
+  EXPECT_EQ(soft_upper, b.get_soft_upper_bounds());
+  EXPECT_EQ(soft_weights, b.get_soft_weights());
+  EXPECT_EQ(hard_expressions, b.get_hard_expressions());
+  EXPECT_EQ(hard_lower, b.get_hard_lower_bounds());
+  EXPECT_EQ(hard_upper, b.get_hard_upper_bounds());
+}
+
+TEST_F(QPProblemBuilderTest, LeastSquaresSoftConstraints)
+{
+  // the first and last soft constraint become equalities
+  soft_upper[0] = soft_lower[0];
+  soft_upper[2] = soft_lower[2];
+
+  giskard_core::QPProblemOptions options;
+  options.soft_constraint_formulation_ = giskard_core::sfLeastSquares;
+
+  giskard_core::QPProblemBuilder b;
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, hard_expressions, hard_lower, hard_upper, options);
+  b.update(initial_state);
+
+  EXPECT_EQ(3, b.num_weights());
+  EXPECT_EQ(3, b.num_constraints());
+  EXPECT_EQ(3, b.num_soft_constraints());
+  EXPECT_EQ(1, b.num_slack_variables());
+  EXPECT_EQ(2, b.num_least_squares_soft_constraints());
+
+  using Eigen::operator<<;
+  Eigen::MatrixXd H(3,3);
+  H << mu * 1.1 + (mu + 11) + 4 * (mu + 1.3), 2 * (mu + 1.3), 0,
+       2 * (mu + 1.3), mu * 1.2 + (mu + 1.3), 0,
+       0, 0, mu + 12;
+  CompareMatrices(H, b.get_H());
+
+  Eigen::VectorXd g(3);
+  g << -(mu + 11) * 0.75 - 2 * (mu + 1.3) * 0.3, -(mu + 1.3) * 0.3, 0;
+  CompareVectors(g, b.get_g());
+
+  Eigen::MatrixXd A(3,3);
+  A << 1, 0, 0,
+       0, 1, 0,
+       0, 1, 1;
+  CompareMatrices(A, b.get_A());
+
+  Eigen::VectorXd lbA(3);
+  lbA << -3.0, -3.1, -1.5;
+  CompareVectors(lbA, b.get_lbA());
+
+  Eigen::VectorXd ubA(3);
+  ubA << 3.0, 3.1, -1.3;
+  CompareVectors(ubA, b.get_ubA());
+
+  // residuals of the least-squares soft constraints are reported as slack
+  Eigen::VectorXd solution(3), slack;
+  solution << 0.1, -0.2, 0.4;
+  b.calculate_slack(solution, slack);
+  Eigen::VectorXd expected_slack(3);
+  expected_slack << 0.75 - 0.1, 0.4, 0.3 - 2 * 0.1 + 0.2;
+  CompareVectors(expected_slack, slack);
+}
+
+TEST_F(QPProblemBuilderTest, SparseMatrices)
+{
+  giskard_core::QPProblemOptions options;
+  options.sparse_ = true;
+
+  giskard_core::QPProblemBuilder b;
+  b.init(controllable_lower, controllable_upper, controllable_weights, soft_expressions,
+      soft_lower, soft_upper, soft_weights, hard_expressions, hard_lower, hard_upper, options);
+  b.update(initial_state);
+
+  ASSERT_TRUE(b.is_sparse());
+  EXPECT_EQ(0, b.get_H().rows());
+  EXPECT_EQ(0, b.get_A().rows());
+
+  // only the diagonal of H and the dependencies of each row of A
+  EXPECT_EQ(5, b.get_sparse_H().nonZeros());
+  EXPECT_EQ(2 + 2 + 2 + 3, b.get_sparse_A().nonZeros());
+
+  using Eigen::operator<<;
+  Eigen::MatrixXd H(5,5);
+  H << mu * 1.1, 0, 0, 0, 0,
+       0, mu * 1.2, 0, 0., 0,
+       0, 0, mu + 11, 0, 0,
+       0, 0, 0, mu + 12, 0,
+       0, 0, 0, 0, mu +1.3; 
+  CompareMatrices(H, Eigen::MatrixXd(b.get_sparse_H()));
+
+  Eigen::MatrixXd A(5,5);
+  A << 1, 0, 0, 0, 0,
+       0, 1, 0, 0, 0,
+       1, 0, 1, 0, 0,
+       0, 1, 0, 1, 0,
+       2, 1, 0, 0, 1; 
+  CompareMatrices(A, Eigen::MatrixXd(b.get_sparse_A()));
+
+  Eigen::VectorXd lbA(5);
+  lbA << -3.0, -3.1, 0.75, -1.5, 0.3;
+  CompareVectors(lbA, b.get_lbA());
+}
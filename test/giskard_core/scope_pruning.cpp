@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class ScopePruningTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      std::string s =
+          "scope:\n"
+          "  - a: {input-joint: a}\n"
+          "  - b: {input-joint: b}\n"
+          "  - unused_offset: {input-scalar: unused_offset}\n"
+          "  - unused_helper: {double-add: [a, unused_offset]}\n"
+          "  - goal: {input-scalar: goal}\n"
+          "  - error: {double-sub: [goal, a]}\n"
+          "  - distance: {abs: error}\n"
+          "  - b_feedback: {double-mul: [2.0, b, {input-scalar: b_gain}]}\n"
+          "controllable-constraints:\n"
+          "  - controllable-constraint: [-0.5, 0.5, 1.0, a]\n"
+          "  - controllable-constraint: [-0.5, 0.5, 1.0, b]\n"
+          "soft-constraints:\n"
+          "  - soft-constraint: [error, error, 10.0, a, a goal]\n"
+          "hard-constraints: []\n"
+          "monitored-outputs: [distance]\n";
+      spec = YAML::Load(s).as<giskard_core::QPControllerSpec>();
+    }
+
+    virtual void TearDown() {}
+
+    std::vector<std::string> names(const giskard_core::ScopeSpec& scope_spec)
+    {
+      std::vector<std::string> result;
+      for(size_t i=0; i<scope_spec.size(); ++i)
+        result.push_back(scope_spec[i].name);
+      return result;
+    }
+
+    giskard_core::QPControllerSpec spec;
+};
+
+TEST_F(ScopePruningTest, MonitoredOutputs)
+{
+  ASSERT_EQ(1u, spec.monitored_outputs_.size());
+  EXPECT_EQ("distance", spec.monitored_outputs_[0]);
+
+  YAML::Node node;
+  node = spec;
+  EXPECT_TRUE(node["monitored-outputs"]);
+  EXPECT_EQ(spec.monitored_outputs_, node.as<giskard_core::QPControllerSpec>().monitored_outputs_);
+}
+
+TEST_F(ScopePruningTest, PruneScope)
+{
+  std::vector<std::string> expected;
+  expected.push_back("a");
+  expected.push_back("b");
+  expected.push_back("goal");
+  expected.push_back("error");
+  expected.push_back("distance");
+  EXPECT_EQ(expected, names(giskard_core::prune_scope(spec)));
+
+  spec.monitored_outputs_.push_back("b_feedback");
+  expected.push_back("b_feedback");
+  EXPECT_EQ(expected, names(giskard_core::prune_scope(spec)));
+
+  spec.monitored_outputs_.push_back("does_not_exist");
+  EXPECT_THROW(giskard_core::prune_scope(spec), std::domain_error);
+}
+
+TEST_F(ScopePruningTest, UnusedInputs)
+{
+  std::vector<std::string> expected;
+  expected.push_back("unused_offset");
+  expected.push_back("b_gain");
+  EXPECT_EQ(expected, giskard_core::find_unused_inputs(spec));
+}
+
+TEST_F(ScopePruningTest, GeneratePrunedController)
+{
+  giskard_core::QPProblemOptions options;
+  options.prune_scope_ = true;
+  giskard_core::QPController full = giskard_core::generate(spec);
+  giskard_core::QPController pruned = giskard_core::generate(spec, options);
+
+  EXPECT_EQ(5u, full.get_input_size());
+  EXPECT_EQ(3u, pruned.get_input_size());
+  EXPECT_FALSE(pruned.get_scope().has_double_expression("unused_helper"));
+  EXPECT_TRUE(pruned.get_scope().has_double_expression("distance"));
+
+  Eigen::VectorXd full_state(5), pruned_state(3);
+  full_state << 0.1, -0.2, 0.0, 0.4, 0.0;
+  pruned_state << 0.1, -0.2, 0.4;
+  ASSERT_TRUE(full.start(full_state, 100));
+  ASSERT_TRUE(pruned.start(pruned_state, 100));
+  EXPECT_TRUE(full.get_command().isApprox(pruned.get_command()));
+}
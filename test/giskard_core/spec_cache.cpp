@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class SpecCacheTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      std::string s =
+          "scope:\n"
+          "  - a: {input-joint: a}\n"
+          "  - b: {input-joint: b}\n"
+          "controllable-constraints:\n"
+          "  - controllable-constraint: [-0.5, 0.5, 1.0, a]\n"
+          "  - controllable-constraint: [-0.5, 0.5, 1.0, b]\n"
+          "soft-constraints:\n"
+          "  - soft-constraint:\n"
+          "      - {double-sub: [1.0, {double-mul: [a, b]}]}\n"
+          "      - {double-sub: [2.0, {double-mul: [a, b]}]}\n"
+          "      - 10.0\n"
+          "      - {double-mul: [a, b]}\n"
+          "      - product goal\n"
+          "hard-constraints:\n"
+          "  - hard-constraint: [{double-sub: [-1.0, a]}, {double-sub: [1.0, a]}, a]\n";
+      spec = YAML::Load(s).as<giskard_core::QPControllerSpec>();
+    }
+
+    virtual void TearDown() {}
+
+    giskard_core::QPControllerSpec spec;
+};
+
+TEST_F(SpecCacheTest, CountsRepeatedSpecs)
+{
+  giskard_core::SpecCachePtr cache(new giskard_core::SpecCache());
+  giskard_core::generate_expressions(spec, cache);
+  EXPECT_EQ(1u, cache->num_shared());
+
+  giskard_core::QPControllerExpressions expressions = giskard_core::generate_expressions(spec);
+  EXPECT_EQ(1u, expressions.soft_expressions_.size());
+}
+
+TEST_F(SpecCacheTest, SharesExpressions)
+{
+  giskard_core::SpecCachePtr cache(new giskard_core::SpecCache());
+  giskard_core::generate_expressions(spec, cache);
+  cache->start_sharing();
+  giskard_core::QPControllerExpressions expressions = giskard_core::generate_expressions(spec, cache);
+
+  const giskard_core::DoubleSpec& product = *(spec.soft_constraints_[0].expression_);
+  KDL::Expression<double>::Ptr shared = cache->find<double>(product);
+  ASSERT_TRUE(shared.get());
+  EXPECT_EQ(shared, expressions.soft_expressions_[0]);
+  EXPECT_EQ(1u, cache->num_shared());
+}
+
+TEST_F(SpecCacheTest, SameCommands)
+{
+  giskard_core::QPProblemOptions options;
+  options.common_subexpression_elimination_ = false;
+  giskard_core::QPController plain = giskard_core::generate(spec, options);
+  giskard_core::QPController shared = giskard_core::generate(spec);
+
+  Eigen::VectorXd observables(2);
+  observables << 0.3, -0.2;
+  ASSERT_TRUE(plain.start(observables, 100));
+  ASSERT_TRUE(shared.start(observables, 100));
+  for(size_t i=0; i<5; ++i)
+  {
+    ASSERT_TRUE(plain.update(observables, 100));
+    ASSERT_TRUE(shared.update(observables, 100));
+    EXPECT_TRUE(plain.get_command().isApprox(shared.get_command()));
+    observables += plain.get_command();
+  }
+}
+
+TEST_F(SpecCacheTest, ScopeEntriesEvaluateOnTheirOwn)
+{
+  std::string s =
+      "scope:\n"
+      "  - a: {input-joint: a}\n"
+      "  - b: {input-joint: b}\n"
+      "  - product_plus: {double-add: [{double-mul: [a, b]}, 1.0]}\n"
+      "  - product_minus: {double-sub: [{double-mul: [a, b]}, 1.0]}\n"
+      "controllable-constraints:\n"
+      "  - controllable-constraint: [-0.5, 0.5, 1.0, a]\n"
+      "  - controllable-constraint: [-0.5, 0.5, 1.0, b]\n"
+      "soft-constraints:\n"
+      "  - soft-constraint:\n"
+      "      - {double-sub: [1.0, product_plus]}\n"
+      "      - {double-sub: [2.0, product_plus]}\n"
+      "      - 10.0\n"
+      "      - product_plus\n"
+      "      - product goal\n"
+      "hard-constraints:\n"
+      "  - hard-constraint: [{double-sub: [-1.0, a]}, {double-sub: [1.0, a]}, a]\n";
+  giskard_core::QPController controller =
+      giskard_core::generate(YAML::Load(s).as<giskard_core::QPControllerSpec>());
+
+  Eigen::VectorXd observables(2);
+  observables << 0.3, -0.2;
+  ASSERT_TRUE(controller.start(observables, 100));
+  ASSERT_TRUE(controller.update(observables, 100));
+
+  // both entries share {double-mul: [a, b]}, but only one reaches the QP
+  observables << 0.7, 0.4;
+  std::vector<double> inputs(observables.data(), observables.data() + observables.size());
+  const KDL::Expression<double>::Ptr& plus = controller.get_scope().find_double_expression("product_plus");
+  const KDL::Expression<double>::Ptr& minus = controller.get_scope().find_double_expression("product_minus");
+  plus->setInputValues(inputs);
+  minus->setInputValues(inputs);
+  EXPECT_DOUBLE_EQ(0.7 * 0.4 + 1.0, plus->value());
+  EXPECT_DOUBLE_EQ(0.7 * 0.4 - 1.0, minus->value());
+}
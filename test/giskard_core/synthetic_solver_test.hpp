@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef GISKARD_CORE_TEST_SYNTHETIC_SOLVER_TEST_HPP
+#define GISKARD_CORE_TEST_SYNTHETIC_SOLVER_TEST_HPP
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+// Fixture for the tests of the solver backends: a synthetic controller with
+// two branches and hard constraints, and a state that it can start from.
+class SyntheticSolverTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      giskard_core::SyntheticControllerOptions options;
+      options.num_joints_ = 14;
+      options.num_branches_ = 2;
+      options.num_soft_constraints_ = 12;
+      options.num_hard_constraints_ = 4;
+      options.num_goal_inputs_ = 2;
+      spec = giskard_core::synthesize_controller(options).as<giskard_core::QPControllerSpec>();
+
+      nWSR = 1000;
+    }
+
+    virtual void TearDown(){}
+
+    Eigen::VectorXd initial_state(const giskard_core::QPController& controller) const
+    {
+      Eigen::VectorXd result = Eigen::VectorXd::Zero(controller.get_input_size());
+      for(size_t i=0; i<controller.num_controllables(); ++i)
+        result(i) = 0.1 * i;
+      for(size_t i=controller.num_controllables(); i<controller.get_input_size(); ++i)
+        result(i) = 0.3;
+      return result;
+    }
+
+    giskard_core::QPControllerSpec spec;
+    int nWSR;
+};
+
+#endif // GISKARD_CORE_TEST_SYNTHETIC_SOLVER_TEST_HPP
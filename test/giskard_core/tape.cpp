@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class TapeTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {}
+    virtual void TearDown() {}
+
+    std::vector<double> evaluate(const giskard_core::Tape& tape, const std::vector<double>& inputs)
+    {
+      std::vector<double> values(tape.size());
+      for(size_t i=0; i<tape.size(); ++i)
+      {
+        const giskard_core::TapeInstruction& instruction = tape.get_instruction(i);
+        if(instruction.operation_ == giskard_core::toConstant)
+          values[i] = instruction.value_;
+        else if(instruction.operation_ == giskard_core::toInput)
+          values[i] = inputs[static_cast<size_t>(instruction.value_)];
+        else
+          values[i] = giskard_core::evaluate(instruction.operation_, values[instruction.arguments_[0]],
+              values[instruction.arguments_[1]], values[instruction.arguments_[2]]);
+      }
+      return values;
+    }
+};
+
+TEST_F(TapeTest, HashConsing)
+{
+  giskard_core::Tape tape;
+  size_t x = tape.input(0);
+  size_t y = tape.input(1);
+
+  EXPECT_EQ(x, tape.input(0));
+  EXPECT_EQ(tape.add(x, y), tape.add(x, y));
+  EXPECT_EQ(tape.add(x, y), tape.add(y, x));
+  EXPECT_EQ(tape.mul(x, y), tape.mul(y, x));
+  EXPECT_NE(tape.sub(x, y), tape.sub(y, x));
+  EXPECT_EQ(tape.sin(x), tape.sin(x));
+  EXPECT_EQ(2, tape.num_inputs());
+}
+
+TEST_F(TapeTest, ConstantFolding)
+{
+  giskard_core::Tape tape;
+  size_t x = tape.input(0);
+
+  EXPECT_TRUE(tape.is_constant(tape.add(tape.constant(1.0), tape.constant(2.0)), 3.0));
+  EXPECT_TRUE(tape.is_constant(tape.mul(tape.constant(0.0), x), 0.0));
+  EXPECT_TRUE(tape.is_constant(tape.sub(x, x), 0.0));
+  EXPECT_TRUE(tape.is_constant(tape.cos(tape.constant(0.0)), 1.0));
+  EXPECT_EQ(x, tape.add(x, tape.constant(0.0)));
+  EXPECT_EQ(x, tape.mul(tape.constant(1.0), x));
+  EXPECT_EQ(x, tape.div(x, tape.constant(1.0)));
+  EXPECT_EQ(x, tape.neg(tape.neg(x)));
+  EXPECT_EQ(x, tape.select(tape.constant(1.0), x, tape.input(1)));
+}
+
+TEST_F(TapeTest, Derivatives)
+{
+  giskard_core::Tape tape;
+  size_t x = tape.input(0);
+  size_t y = tape.input(1);
+  size_t z = tape.input(2);
+  size_t f = tape.add(tape.mul(x, tape.sin(x)), tape.mul(tape.constant(3.0), z));
+  tape.set_num_derivatives(2);
+
+  // only derivatives w.r.t. the first inputs, z is not a controllable
+  std::map<size_t, size_t> derivatives = tape.get_derivatives(f);
+  ASSERT_EQ(1u, derivatives.size());
+  ASSERT_EQ(1u, derivatives.count(0));
+  EXPECT_EQ(0u, tape.get_derivatives(z).size());
+  EXPECT_EQ(1u, tape.get_derivatives(y).size());
+
+  std::vector<double> inputs;
+  inputs.push_back(0.3);
+  inputs.push_back(-1.2);
+  inputs.push_back(2.0);
+  std::vector<double> values = evaluate(tape, inputs);
+  EXPECT_DOUBLE_EQ(0.3 * std::sin(0.3) + 6.0, values[f]);
+  EXPECT_DOUBLE_EQ(std::sin(0.3) + 0.3 * std::cos(0.3), values[derivatives[0]]);
+}
+
+TEST_F(TapeTest, DerivativesMatchFiniteDifferences)
+{
+  giskard_core::Tape tape;
+  size_t x = tape.input(0);
+  size_t y = tape.input(1);
+  size_t f = tape.add(tape.atan2(tape.sqrt(tape.mul(x, x)), tape.div(y, tape.constant(2.0))),
+      tape.maximum(tape.fmod(x, tape.constant(0.4)), tape.acos(tape.mul(x, y))));
+  tape.set_num_derivatives(2);
+  std::map<size_t, size_t> derivatives = tape.get_derivatives(f);
+
+  std::vector<double> inputs;
+  inputs.push_back(0.7);
+  inputs.push_back(0.9);
+  std::vector<double> values = evaluate(tape, inputs);
+  for(size_t i=0; i<2; ++i)
+  {
+    std::vector<double> perturbed = inputs;
+    perturbed[i] += 1e-7;
+    double finite_difference = (evaluate(tape, perturbed)[f] - values[f]) / 1e-7;
+    EXPECT_NEAR(finite_difference, values[derivatives[i]], 1e-5);
+  }
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2015-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class TapeInterpreterTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      YAML::Node node = YAML::LoadFile("pr2_qp_position_control.yaml");
+      spec = node.as<giskard_core::QPControllerSpec>();
+    }
+
+    virtual void TearDown() {}
+
+    giskard_core::QPControllerSpec spec;
+};
+
+TEST_F(TapeInterpreterTest, SingleSoftConstraint)
+{
+  giskard_core::QPTape qp;
+  giskard_core::Tape& tape = qp.tape_;
+  size_t x = tape.input(0);
+  size_t y = tape.input(1);
+  size_t z = tape.input(2);
+  qp.controllable_names_.push_back("x");
+  qp.controllable_names_.push_back("y");
+  for(size_t i=0; i<2; ++i)
+  {
+    qp.controllable_lower_bounds_.push_back(tape.constant(-1.0));
+    qp.controllable_upper_bounds_.push_back(tape.constant(1.0));
+    qp.controllable_weights_.push_back(tape.constant(0.5));
+  }
+  size_t expression = tape.add(tape.mul(x, tape.sin(y)), z);
+  qp.soft_expressions_.push_back(expression);
+  qp.soft_lower_bounds_.push_back(tape.sub(tape.constant(1.0), expression));
+  qp.soft_upper_bounds_.push_back(tape.sub(tape.constant(2.0), expression));
+  qp.soft_weights_.push_back(tape.constant(10.0));
+  qp.soft_constraint_names_.push_back("s");
+  tape.set_num_derivatives(2);
+  qp.soft_derivatives_.push_back(tape.get_derivatives(expression));
+  qp.create_outputs();
+
+  giskard_core::TapeInterpreter interpreter;
+  interpreter.init(qp);
+  EXPECT_EQ(3u, interpreter.num_observables());
+  EXPECT_EQ(3u, interpreter.num_weights());
+  EXPECT_EQ(1u, interpreter.num_constraints());
+
+  double observables[] = {0.3, 0.7, -0.2};
+  Eigen::MatrixXd H = Eigen::MatrixXd::Zero(3, 3);
+  Eigen::VectorXd g = Eigen::VectorXd::Zero(3), A = Eigen::VectorXd::Zero(3),
+      lb(3), ub(3), lbA(1), ubA(1);
+  interpreter.evaluate(observables, H.data(), g.data(), A.data(), lb.data(), ub.data(),
+      lbA.data(), ubA.data());
+
+  EXPECT_DOUBLE_EQ(0.5, H(0, 0));
+  EXPECT_DOUBLE_EQ(0.5, H(1, 1));
+  EXPECT_DOUBLE_EQ(10.0, H(2, 2));
+  EXPECT_DOUBLE_EQ(std::sin(0.7), A(0));
+  EXPECT_DOUBLE_EQ(0.3 * std::cos(0.7), A(1));
+  EXPECT_DOUBLE_EQ(1.0, A(2));
+  EXPECT_DOUBLE_EQ(-1.0, lb(0));
+  EXPECT_DOUBLE_EQ(1.0, ub(1));
+  EXPECT_DOUBLE_EQ(-1e9, lb(2));
+  EXPECT_DOUBLE_EQ(1.0 - 0.3 * std::sin(0.7) + 0.2, lbA(0));
+  EXPECT_DOUBLE_EQ(2.0 - 0.3 * std::sin(0.7) + 0.2, ubA(0));
+}
+
+TEST_F(TapeInterpreterTest, MatchesExpressionGraph)
+{
+  giskard_core::QPProblemOptions options;
+  options.tape_ = true;
+  giskard_core::QPController graph_controller = giskard_core::generate(spec);
+  giskard_core::QPController tape_controller = giskard_core::generate(spec, options);
+  ASSERT_FALSE(graph_controller.get_qp_builder().has_tape());
+  ASSERT_TRUE(tape_controller.get_qp_builder().has_tape());
+
+  Eigen::VectorXd observables(graph_controller.num_observables());
+  for(size_t i=0; i<graph_controller.num_observables(); ++i)
+    observables(i) = 0.1 * i - 0.3;
+
+  ASSERT_TRUE(graph_controller.start(observables, 100));
+  ASSERT_TRUE(tape_controller.start(observables, 100));
+  for(size_t i=0; i<5; ++i)
+  {
+    ASSERT_TRUE(graph_controller.update(observables, 100));
+    ASSERT_TRUE(tape_controller.update(observables, 100));
+
+    const giskard_core::QPProblemBuilder& graph = graph_controller.get_qp_builder();
+    const giskard_core::QPProblemBuilder& tape = tape_controller.get_qp_builder();
+    EXPECT_TRUE(graph.get_H().isApprox(tape.get_H()));
+    EXPECT_TRUE(graph.get_A().isApprox(tape.get_A()));
+    EXPECT_TRUE(graph.get_lb().isApprox(tape.get_lb()));
+    EXPECT_TRUE(graph.get_ub().isApprox(tape.get_ub()));
+    EXPECT_TRUE(graph.get_lbA().isApprox(tape.get_lbA()));
+    EXPECT_TRUE(graph.get_ubA().isApprox(tape.get_ubA()));
+    EXPECT_TRUE(graph_controller.get_command().isApprox(tape_controller.get_command()));
+
+    for(size_t j=0; j<graph_controller.num_controllables(); ++j)
+      observables(j) += graph_controller.get_command()(j);
+  }
+}
+
+TEST_F(TapeInterpreterTest, RejectsSparseProblems)
+{
+  giskard_core::QPProblemOptions options;
+  options.sparse_ = true;
+  giskard_core::QPController controller = giskard_core::generate(spec, options);
+  EXPECT_THROW(controller.set_tape(giskard_core::generate_tape(spec)), std::invalid_argument);
+
+  options.tape_ = true;
+  EXPECT_THROW(giskard_core::generate(spec, options), std::invalid_argument);
+}
+
+TEST_F(TapeInterpreterTest, RejectsOtherObservables)
+{
+  // an observable that no constraint reads, so pruning drops it
+  giskard_core::ScopeEntry feedback;
+  feedback.name = "feedback";
+  feedback.spec = giskard_core::DoubleInputSpecPtr(new giskard_core::DoubleInputSpec("feedback"));
+  spec.scope_.insert(spec.scope_.begin(), feedback);
+
+  giskard_core::QPProblemOptions options;
+  options.prune_scope_ = true;
+  giskard_core::QPController controller = giskard_core::generate(spec, options);
+  EXPECT_THROW(controller.set_tape(giskard_core::generate_tape(spec)), std::invalid_argument);
+  EXPECT_FALSE(controller.get_qp_builder().has_tape());
+
+  giskard_core::QPControllerSpec pruned_spec = spec;
+  pruned_spec.scope_ = giskard_core::prune_scope(spec);
+  EXPECT_NO_THROW(controller.set_tape(giskard_core::generate_tape(pruned_spec)));
+  EXPECT_TRUE(controller.get_qp_builder().has_tape());
+}
+
+TEST_F(TapeInterpreterTest, IncrementalEvaluation)
+{
+  giskard_core::QPTape qp = giskard_core::generate_tape(spec);
+  giskard_core::TapeInterpreter incremental, full;
+  incremental.init(qp);
+
+  size_t nw = qp.num_weights(), nc = qp.num_constraints();
+  Eigen::VectorXd observables(incremental.num_observables());
+  for(size_t i=0; i<incremental.num_observables(); ++i)
+    observables(i) = 0.1 * i - 0.3;
+
+  Eigen::VectorXd H = Eigen::VectorXd::Zero(nw * nw), g = Eigen::VectorXd::Zero(nw),
+      A = Eigen::VectorXd::Zero(nc * nw), lb(nw), ub(nw), lbA(nc), ubA(nc);
+  incremental.evaluate(observables.data(), H.data(), g.data(), A.data(), lb.data(), ub.data(),
+      lbA.data(), ubA.data());
+  size_t num_instructions = incremental.num_executed_instructions();
+  EXPECT_LT(0u, num_instructions);
+
+  // nothing changed
+  incremental.evaluate(observables.data(), H.data(), g.data(), A.data(), lb.data(), ub.data(),
+      lbA.data(), ubA.data());
+  EXPECT_EQ(0u, incremental.num_executed_instructions());
+
+  // the last joint of the chain only affects a part of the forward kinematics
+  observables(qp.num_controllables() - 1) += 0.2;
+  incremental.evaluate(observables.data(), H.data(), g.data(), A.data(), lb.data(), ub.data(),
+      lbA.data(), ubA.data());
+  EXPECT_LT(0u, incremental.num_executed_instructions());
+  EXPECT_GT(num_instructions, incremental.num_executed_instructions());
+
+  full.init(qp);
+  Eigen::VectorXd H2 = Eigen::VectorXd::Zero(nw * nw), g2 = Eigen::VectorXd::Zero(nw),
+      A2 = Eigen::VectorXd::Zero(nc * nw), lb2(nw), ub2(nw), lbA2(nc), ubA2(nc);
+  full.evaluate(observables.data(), H2.data(), g2.data(), A2.data(), lb2.data(), ub2.data(),
+      lbA2.data(), ubA2.data());
+  EXPECT_EQ(num_instructions, full.num_executed_instructions());
+  EXPECT_TRUE(H.isApprox(H2));
+  EXPECT_TRUE(A.isApprox(A2));
+  EXPECT_TRUE(lb.isApprox(lb2));
+  EXPECT_TRUE(ub.isApprox(ub2));
+  EXPECT_TRUE(lbA.isApprox(lbA2));
+  EXPECT_TRUE(ubA.isApprox(ubA2));
+}
+
+TEST_F(TapeInterpreterTest, IncrementalEvaluationOfManyObservables)
+{
+  // the goal is the 65th observable, one more than the bits of a machine word
+  giskard_core::QPTape qp;
+  giskard_core::Tape& tape = qp.tape_;
+  size_t x = tape.input(0);
+  size_t goal = tape.input(64);
+  qp.controllable_names_.push_back("x");
+  qp.controllable_lower_bounds_.push_back(tape.constant(-1.0));
+  qp.controllable_upper_bounds_.push_back(tape.constant(1.0));
+  qp.controllable_weights_.push_back(tape.constant(0.5));
+  size_t target = tape.cos(goal);
+  qp.soft_expressions_.push_back(x);
+  qp.soft_lower_bounds_.push_back(tape.sub(target, x));
+  qp.soft_upper_bounds_.push_back(tape.sub(tape.add(target, tape.constant(0.1)), x));
+  qp.soft_weights_.push_back(tape.constant(10.0));
+  qp.soft_constraint_names_.push_back("s");
+  tape.set_num_derivatives(1);
+  qp.soft_derivatives_.push_back(tape.get_derivatives(x));
+  qp.create_outputs();
+
+  giskard_core::TapeInterpreter interpreter;
+  interpreter.init(qp);
+  ASSERT_EQ(65u, interpreter.num_observables());
+
+  Eigen::VectorXd observables = Eigen::VectorXd::Zero(65);
+  observables(0) = 0.3;
+  observables(64) = 0.7;
+  Eigen::VectorXd H = Eigen::VectorXd::Zero(4), g = Eigen::VectorXd::Zero(2),
+      A = Eigen::VectorXd::Zero(2), lb(2), ub(2), lbA(1), ubA(1);
+  interpreter.evaluate(observables.data(), H.data(), g.data(), A.data(), lb.data(), ub.data(),
+      lbA.data(), ubA.data());
+  EXPECT_EQ(4u, interpreter.num_executed_instructions());
+
+  // only the two subtractions read the joint
+  observables(0) = 0.4;
+  interpreter.evaluate(observables.data(), H.data(), g.data(), A.data(), lb.data(), ub.data(),
+      lbA.data(), ubA.data());
+  EXPECT_EQ(2u, interpreter.num_executed_instructions());
+  EXPECT_DOUBLE_EQ(std::cos(0.7) - 0.4, lbA(0));
+  EXPECT_DOUBLE_EQ(std::cos(0.7) + 0.1 - 0.4, ubA(0));
+
+  observables(64) = 0.8;
+  interpreter.evaluate(observables.data(), H.data(), g.data(), A.data(), lb.data(), ub.data(),
+      lbA.data(), ubA.data());
+  EXPECT_EQ(4u, interpreter.num_executed_instructions());
+  EXPECT_DOUBLE_EQ(std::cos(0.8) - 0.4, lbA(0));
+}
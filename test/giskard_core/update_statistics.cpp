@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2016-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+class UpdateStatisticsTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {}
+    virtual void TearDown() {}
+
+    giskard_core::UpdateRecord record(double evaluation_time, int return_value = 0)
+    {
+      giskard_core::UpdateRecord result;
+      result.evaluation_time_ = evaluation_time;
+      result.copy_time_ = 1.0;
+      result.solve_time_ = 2.0;
+      result.nWSR_ = static_cast<int>(evaluation_time);
+      result.return_value_ = return_value;
+      return result;
+    }
+};
+
+TEST_F(UpdateStatisticsTest, Disabled)
+{
+  giskard_core::UpdateStatistics statistics;
+  statistics.record(record(1.0));
+  EXPECT_EQ(0u, statistics.capacity());
+  EXPECT_EQ(0u, statistics.size());
+  EXPECT_THROW(statistics.get_record(0), std::out_of_range);
+  EXPECT_THROW(statistics.get_latest_record(), std::out_of_range);
+
+  giskard_core::UpdateSummary summary = statistics.summarize(&giskard_core::UpdateRecord::solve_time_);
+  EXPECT_DOUBLE_EQ(0.0, summary.min_);
+  EXPECT_DOUBLE_EQ(0.0, summary.max_);
+}
+
+TEST_F(UpdateStatisticsTest, RingBuffer)
+{
+  giskard_core::UpdateStatistics statistics(3);
+  statistics.record(record(1.0));
+  statistics.record(record(2.0));
+  ASSERT_EQ(2u, statistics.size());
+  EXPECT_DOUBLE_EQ(1.0, statistics.get_record(0).evaluation_time_);
+  EXPECT_DOUBLE_EQ(2.0, statistics.get_latest_record().evaluation_time_);
+  EXPECT_THROW(statistics.get_record(2), std::out_of_range);
+
+  for(size_t i=3; i<=7; ++i)
+    statistics.record(record(i));
+  ASSERT_EQ(3u, statistics.size());
+  EXPECT_EQ(3u, statistics.capacity());
+  EXPECT_DOUBLE_EQ(5.0, statistics.get_record(0).evaluation_time_);
+  EXPECT_DOUBLE_EQ(6.0, statistics.get_record(1).evaluation_time_);
+  EXPECT_DOUBLE_EQ(7.0, statistics.get_latest_record().evaluation_time_);
+
+  statistics.clear();
+  EXPECT_EQ(0u, statistics.size());
+  EXPECT_THROW(statistics.get_latest_record(), std::out_of_range);
+  statistics.record(record(8.0));
+  ASSERT_EQ(1u, statistics.size());
+  EXPECT_DOUBLE_EQ(8.0, statistics.get_latest_record().evaluation_time_);
+}
+
+TEST_F(UpdateStatisticsTest, Summaries)
+{
+  giskard_core::UpdateStatistics statistics(100);
+  for(size_t i=0; i<50; ++i)
+    statistics.record(record(1000.0, 1));
+  // 1 to 100 in a scrambled order, which push out all records before
+  for(size_t i=0; i<100; ++i)
+    statistics.record(record((i * 37) % 100 + 1, i % 10 == 0 ? 1 : 0));
+
+  giskard_core::UpdateSummary summary = statistics.summarize(&giskard_core::UpdateRecord::evaluation_time_);
+  EXPECT_DOUBLE_EQ(1.0, summary.min_);
+  EXPECT_DOUBLE_EQ(100.0, summary.max_);
+  EXPECT_DOUBLE_EQ(50.5, summary.mean_);
+  EXPECT_DOUBLE_EQ(99.0, summary.p99_);
+
+  summary = statistics.summarize(&giskard_core::UpdateRecord::nWSR_);
+  EXPECT_DOUBLE_EQ(1.0, summary.min_);
+  EXPECT_DOUBLE_EQ(100.0, summary.max_);
+
+  summary = statistics.summarize_total_time();
+  EXPECT_DOUBLE_EQ(4.0, summary.min_);
+  EXPECT_DOUBLE_EQ(103.0, summary.max_);
+
+  // summarizing does not reorder the records
+  EXPECT_DOUBLE_EQ(1.0, statistics.get_record(0).evaluation_time_);
+  EXPECT_DOUBLE_EQ(64.0, statistics.get_latest_record().evaluation_time_);
+  EXPECT_EQ(10u, statistics.num_failures());
+}
+
+TEST_F(UpdateStatisticsTest, Controller)
+{
+  giskard_core::QPControllerSpec spec =
+      YAML::LoadFile("pr2_qp_position_control.yaml").as<giskard_core::QPControllerSpec>();
+  giskard_core::QPController controller = giskard_core::generate(spec);
+  Eigen::VectorXd observables = Eigen::VectorXd::Zero(controller.get_input_size());
+
+  int nWSR = 100;
+  ASSERT_TRUE(controller.start(observables, nWSR));
+  EXPECT_FALSE(controller.has_statistics());
+  ASSERT_TRUE(controller.update(observables, nWSR));
+  EXPECT_EQ(0u, controller.get_statistics().size());
+
+  EXPECT_THROW(controller.enable_statistics(0), std::invalid_argument);
+  controller.enable_statistics(10);
+  ASSERT_TRUE(controller.has_statistics());
+  Eigen::VectorXd command;
+  for(size_t i=0; i<15; ++i)
+  {
+    ASSERT_TRUE(controller.update(observables, nWSR));
+    command = controller.get_command();
+    observables.segment(0, controller.num_controllables()) += 0.01 * command;
+  }
+
+  const giskard_core::UpdateStatistics& statistics = controller.get_statistics();
+  ASSERT_EQ(10u, statistics.size());
+  EXPECT_EQ(0u, statistics.num_failures());
+  for(size_t i=0; i<statistics.size(); ++i)
+  {
+    const giskard_core::UpdateRecord& record = statistics.get_record(i);
+    EXPECT_GE(record.evaluation_time_, 0.0);
+    EXPECT_GE(record.copy_time_, 0.0);
+    EXPECT_GT(record.solve_time_, 0.0);
+    EXPECT_GE(record.nWSR_, 0);
+    EXPECT_LE(record.nWSR_, nWSR);
+    EXPECT_GE(record.active_set_size_, 0);
+    EXPECT_LE(record.active_set_size_, static_cast<int>(
+        controller.get_qp_builder().num_weights() + controller.get_qp_builder().num_constraints()));
+  }
+
+  giskard_core::UpdateSummary summary = statistics.summarize_total_time();
+  EXPECT_LE(summary.min_, summary.mean_);
+  EXPECT_LE(summary.mean_, summary.max_);
+  EXPECT_LE(summary.p99_, summary.max_);
+
+  controller.disable_statistics();
+  EXPECT_FALSE(controller.has_statistics());
+  ASSERT_TRUE(controller.update(observables, nWSR));
+}
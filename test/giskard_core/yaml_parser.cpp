@@ -258,6 +258,30 @@ TEST_F(YamlParserTest, FrameInputExpression)
   EXPECT_EQ("someinput", s6->get_name());
 };
 
+TEST_F(YamlParserTest, EncodedFrameInputExpressions)
+{
+  YAML::Node node = YAML::Load("{input-quaternion-frame: someinput}");
+  ASSERT_NO_THROW(node.as<giskard_core::FrameSpecPtr>());
+  giskard_core::FrameSpecPtr s1 = node.as<giskard_core::FrameSpecPtr>();
+  ASSERT_TRUE(boost::dynamic_pointer_cast<giskard_core::QuaternionFrameInputSpec>(s1).get());
+  EXPECT_EQ("someinput", boost::dynamic_pointer_cast<giskard_core::QuaternionFrameInputSpec>(s1)->get_name()->get_value());
+
+  node = YAML::Load("{input-matrix-frame: someinput}");
+  ASSERT_NO_THROW(node.as<giskard_core::FrameSpecPtr>());
+  giskard_core::FrameSpecPtr s2 = node.as<giskard_core::FrameSpecPtr>();
+  ASSERT_TRUE(boost::dynamic_pointer_cast<giskard_core::MatrixFrameInputSpec>(s2).get());
+  EXPECT_FALSE(s1->equals(*s2));
+
+  // roundtrip with generation
+  YAML::Node node2;
+  node2 = s1;
+  ASSERT_NO_THROW(node2.as<giskard_core::FrameSpecPtr>());
+  EXPECT_TRUE(s1->equals(*node2.as<giskard_core::FrameSpecPtr>()));
+  node2 = s2;
+  ASSERT_NO_THROW(node2.as<giskard_core::FrameSpecPtr>());
+  EXPECT_TRUE(s2->equals(*node2.as<giskard_core::FrameSpecPtr>()));
+};
+
 TEST_F(YamlParserTest, RotationVectorSpec)
 {
   std::string v = "{rot-vector: {quaternion: [0.70710678118, 0.0, -0.70710678118, 0.0]}}";
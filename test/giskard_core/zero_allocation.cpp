@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2016-2017 Georg Bartels <georg.bartels@cs.uni-bremen.de>
+ * 
+ * This file is part of giskard.
+ * 
+ * giskard is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <gtest/gtest.h>
+#include <giskard_core/giskard_core.hpp>
+
+// Counts all allocations through operator new while enabled. Eigen allocates
+// with malloc directly, which EIGEN_RUNTIME_NO_MALLOC catches instead.
+namespace
+{
+  size_t num_allocations = 0;
+  bool count_allocations = false;
+}
+
+void* operator new(std::size_t size)
+{
+  if(count_allocations)
+    ++num_allocations;
+  if(void* p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+class ZeroAllocationTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      specs.push_back(YAML::LoadFile("pr2_qp_position_control.yaml").as<giskard_core::QPControllerSpec>());
+      specs.push_back(YAML::LoadFile("pr2_cart_cart_control.yaml").as<giskard_core::QPControllerSpec>());
+      num_cycles = 300;
+
+      // within the joint limits of both controllers
+      joint_positions["torso_lift_joint"] = 0.2;
+      joint_positions["l_shoulder_pan_joint"] = 1.0;
+      joint_positions["l_shoulder_lift_joint"] = 0.5;
+      joint_positions["l_upper_arm_roll_joint"] = 1.5;
+      joint_positions["l_elbow_flex_joint"] = -1.0;
+      joint_positions["l_forearm_roll_joint"] = 0.0;
+      joint_positions["l_wrist_flex_joint"] = -1.0;
+      joint_positions["l_wrist_roll_joint"] = 0.0;
+      joint_positions["r_shoulder_pan_joint"] = -1.0;
+      joint_positions["r_shoulder_lift_joint"] = 0.5;
+      joint_positions["r_upper_arm_roll_joint"] = -1.5;
+      joint_positions["r_elbow_flex_joint"] = -1.0;
+      joint_positions["r_forearm_roll_joint"] = 0.0;
+      joint_positions["r_wrist_flex_joint"] = -1.0;
+      joint_positions["r_wrist_roll_joint"] = 0.0;
+    }
+
+    virtual void TearDown() {}
+
+    void init(giskard_core::QPProblemBuilder& builder, const giskard_core::QPControllerSpec& spec,
+        const giskard_core::QPProblemOptions& options)
+    {
+      giskard_core::QPControllerExpressions e = giskard_core::generate_expressions(spec);
+      builder.init(e.controllable_lower_, e.controllable_upper_, e.controllable_weights_,
+          e.soft_expressions_, e.soft_lower_, e.soft_upper_, e.soft_weights_,
+          e.hard_expressions_, e.hard_lower_, e.hard_upper_, options);
+      observables = Eigen::VectorXd::Zero(e.scope_.get_input_size());
+      for(int i=0; i<observables.size(); ++i)
+        observables(i) = 0.1 * i - 0.3;
+    }
+
+    // Number of allocations during num_cycles updates after the first one,
+    // while the joints move and the goals jump every now and then. With a
+    // solver, every update also hotstarts it, and all hotstarts have to
+    // succeed.
+    size_t count_update_allocations(giskard_core::QPProblemBuilder& builder,
+        giskard_core::QPSolver* solver = 0)
+    {
+      builder.update(observables);
+      Eigen::VectorXd solution = Eigen::VectorXd::Zero(builder.num_weights());
+      if(solver)
+      {
+        int nWSR = 1000;
+        solver->init(builder);
+        EXPECT_EQ(qpOASES::SUCCESSFUL_RETURN, solver->solve(builder, nWSR, 0, 0));
+      }
+
+      size_t num_failures = 0;
+      num_allocations = 0;
+      count_allocations = true;
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+      Eigen::internal::set_is_malloc_allowed(false);
+#endif
+      for(size_t i=0; i<num_cycles; ++i)
+      {
+        for(size_t j=0; j<builder.num_controllables(); ++j)
+          observables(j) += 0.001;
+        if(i % 50 == 0)
+          observables(observables.size() - 1) += 0.1;
+        builder.update(observables);
+        if(solver)
+        {
+          int nWSR = 1000;
+          if(solver->hotstart(builder, nWSR, 0) != qpOASES::SUCCESSFUL_RETURN)
+            ++num_failures;
+          solver->get_primal_solution(solution);
+        }
+      }
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+      Eigen::internal::set_is_malloc_allowed(true);
+#endif
+      count_allocations = false;
+      EXPECT_EQ(0u, num_failures);
+
+      return num_allocations;
+    }
+
+    // Number of allocations during num_cycles controller updates after the
+    // first one, while the joints follow the commands and the goals jump
+    // every now and then. All updates have to succeed.
+    size_t count_update_allocations(giskard_core::QPController& controller)
+    {
+      Eigen::VectorXd state = Eigen::VectorXd::Zero(controller.get_scope().get_input_size());
+      const std::vector<std::string>& names = controller.get_controllable_names();
+      std::vector<size_t> joints;
+      for(size_t j=0; j<names.size(); ++j)
+      {
+        joints.push_back(controller.get_joint_input_handle(names[j]).idx_);
+        state(joints.back()) = joint_positions[names[j]];
+      }
+      int nWSR = 1000;
+      EXPECT_TRUE(controller.start(state, nWSR));
+      EXPECT_TRUE(controller.update(state, nWSR));
+
+      size_t num_failures = 0;
+      num_allocations = 0;
+      count_allocations = true;
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+      Eigen::internal::set_is_malloc_allowed(false);
+#endif
+      for(size_t i=0; i<num_cycles; ++i)
+      {
+        for(size_t j=0; j<joints.size(); ++j)
+          state(joints[j]) += controller.get_command()(j);
+        if(i % 50 == 0)
+          state(state.size() - 1) += 0.1;
+        if(!controller.update(state, nWSR))
+          ++num_failures;
+      }
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+      Eigen::internal::set_is_malloc_allowed(true);
+#endif
+      count_allocations = false;
+      EXPECT_EQ(0u, num_failures);
+
+      return num_allocations;
+    }
+
+    std::vector<giskard_core::QPControllerSpec> specs;
+    Eigen::VectorXd observables;
+    std::map<std::string, double> joint_positions;
+    size_t num_cycles;
+};
+
+TEST_F(ZeroAllocationTest, DenseSlack)
+{
+  for(size_t i=0; i<specs.size(); ++i)
+  {
+    giskard_core::QPProblemBuilder builder;
+    init(builder, specs[i], giskard_core::QPProblemOptions());
+    EXPECT_EQ(0u, count_update_allocations(builder));
+  }
+}
+
+TEST_F(ZeroAllocationTest, Sparse)
+{
+  giskard_core::QPProblemOptions options;
+  options.sparse_ = true;
+  for(size_t i=0; i<specs.size(); ++i)
+  {
+    giskard_core::QPProblemBuilder builder;
+    init(builder, specs[i], options);
+    EXPECT_EQ(0u, count_update_allocations(builder));
+  }
+}
+
+TEST_F(ZeroAllocationTest, LeastSquares)
+{
+  giskard_core::QPProblemOptions options;
+  options.soft_constraint_formulation_ = giskard_core::sfLeastSquares;
+  for(size_t i=0; i<specs.size(); ++i)
+  {
+    giskard_core::QPProblemBuilder builder;
+    init(builder, specs[i], options);
+    EXPECT_EQ(0u, count_update_allocations(builder));
+
+    options.sparse_ = true;
+    init(builder, specs[i], options);
+    EXPECT_EQ(0u, count_update_allocations(builder));
+    options.sparse_ = false;
+  }
+}
+
+TEST_F(ZeroAllocationTest, Tape)
+{
+  giskard_core::QPProblemBuilder builder;
+  init(builder, specs[0], giskard_core::QPProblemOptions());
+  builder.set_tape(giskard_core::generate_tape(specs[0]));
+  EXPECT_EQ(0u, count_update_allocations(builder));
+}
+
+TEST_F(ZeroAllocationTest, ActiveSetQPSolver)
+{
+  for(size_t i=0; i<specs.size(); ++i)
+  {
+    giskard_core::QPProblemBuilder builder;
+    init(builder, specs[i], giskard_core::QPProblemOptions());
+    giskard_core::ActiveSetQPSolver solver;
+    EXPECT_EQ(0u, count_update_allocations(builder, &solver));
+  }
+}
+
+// NOTE: qpOASES allocates temporaries in every hotstart, so this runs on the
+//       ActiveSetQPSolver.
+TEST_F(ZeroAllocationTest, QPController)
+{
+  for(size_t i=0; i<specs.size(); ++i)
+  {
+    giskard_core::QPController controller = giskard_core::generate(specs[i]);
+    controller.set_solver(giskard_core::ActiveSetQPSolver());
+    controller.enable_statistics(10);
+    controller.set_deadline(1e6);
+    giskard_core::QPRecoveryOptions recovery;
+    recovery.enabled_ = true;
+    controller.set_recovery_options(recovery);
+    EXPECT_EQ(0u, count_update_allocations(controller));
+    EXPECT_EQ(0u, controller.get_statistics().num_failures());
+  }
+}